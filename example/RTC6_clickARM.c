@@ -71,6 +71,12 @@ void display_values()
 }
 
 
+// called by the library whenever the RTC needs another bus clock
+static void bus_clock( uint16_t khz )
+{
+    I2C1_Init_Advanced( khz * 1000UL, &_GPIO_MODULE_I2C1_PB67 );
+}
+
 void main() 
 {
 
@@ -88,9 +94,8 @@ void main()
     time_test.year = 15;
 
 
-    //I2C1_Init_Advanced( 100000, &_GPIO_MODULE_I2C1_PB67 );
+    rtc_hal_set_clock( bus_clock );
     rtc_init( RTC6_MCP7941X, -1 );
-    Delay_ms(1000);
     rtc_set_gmt_time(time_test);
 
 
@@ -99,6 +104,7 @@ void main()
       Delay_ms( 200 );
       time = rtc_get_gmt_time();
       local_time = rtc_get_local_time();
-      display_values();
+      if( time && local_time )
+          display_values();
     }
 }
\ No newline at end of file
@@ -0,0 +1,191 @@
+/*
+ * Linux daemon that owns the RTC bus and publishes the time in a shared
+ * memory page, see rtc_shm.h for the reader side.
+ *
+ *   gcc -Ilibrary/include -Iexample example/RTC_shm_daemon.c \
+ *       library/src/rtc.c library/src/rtc_hal.c -o rtc_shm_daemon -lrt
+ *   RTC_I2C_DEV=/dev/i2c-1 ./rtc_shm_daemon mcp7941x -1
+ *
+ * The I2C_RDWR transfers are not implemented by i2c-stub. To run without
+ * hardware, build against the fake bus instead. The chip sits on it with
+ * its oscillator running and a fixed time of 2016-01-01 00:00:00:
+ *
+ *   gcc -DRTC_HAL_FAKE -Ilibrary/include -Iexample \
+ *       example/RTC_shm_daemon.c library/src/rtc.c library/src/rtc_hal.c \
+ *       library/src/rtc_hal_fake.c -o rtc_shm_fake -lrt
+ *   ./rtc_shm_fake mcp7941x -1 100 &
+ *   od -A d -t u1 /dev/shm/rtc_time
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "rtc.h"
+#include "rtc_shm.h"
+#ifdef RTC_HAL_FAKE
+#include "rtc_hal.h"
+#endif
+
+static const char *chip_names[] =
+{
+    "pcf8583", "ds1307", "bq32000", "mcp7941x", "ds3231"
+};
+static const rtc_type_t chip_types[] =
+{
+    RTC_PCF8583, RTC2_DS1307, RTC3_BQ32000, RTC6_MCP7941X, RTC_DS3231
+};
+
+static volatile sig_atomic_t running = 1;
+
+static void stop( int sig )
+{
+    ( void )sig;
+    running = 0;
+}
+
+static void gmt_from_epoch( uint32_t epoch, rtc_time_t *out )
+{
+    time_t t = epoch;
+    struct tm tm;
+
+    gmtime_r( &t, &tm );
+    out->seconds = tm.tm_sec;
+    out->minutes = tm.tm_min;
+    out->hours = tm.tm_hour;
+    out->weekday = tm.tm_wday ? tm.tm_wday : 7;     // 1 is Monday
+    out->monthday = tm.tm_mday;
+    out->month = tm.tm_mon + 1;
+    out->year = tm.tm_year - 100;
+}
+
+#ifdef RTC_HAL_FAKE
+/*
+ * Puts the chip on the fake bus, 2016-01-01 00:00:00 Friday
+ */
+static void fake_chip( rtc_type_t type )
+{
+    static const uint8_t slaves[] = { 0x50, 0x68, 0x68, 0x6F, 0x68 };
+    uint8_t *regs = rtc_hal_fake_attach( slaves[type], 0, 0 );
+
+    if( type == RTC_PCF8583 )
+    {
+        regs[0x05] = 0x01;
+        regs[0x06] = 0x01;
+        return;
+    }
+
+    regs[0x03] = 0x05;
+    regs[0x04] = 0x01;
+    regs[0x05] = 0x01;
+    regs[0x06] = 0x16;
+    if( type == RTC6_MCP7941X )
+    {
+        regs[0x00] = 0x80;          // ST
+        regs[0x03] |= 0x20;         // OSCRUN
+        rtc_hal_fake_attach( 0x57, 8, 5 );
+    }
+}
+#endif
+
+static uint32_t epoch_from_time( const rtc_time_t *in )
+{
+    struct tm tm;
+
+    memset( &tm, 0, sizeof( tm ) );
+    tm.tm_sec = in->seconds;
+    tm.tm_min = in->minutes;
+    tm.tm_hour = in->hours;
+    tm.tm_mday = in->monthday;
+    tm.tm_mon = in->month - 1;
+    tm.tm_year = in->year + 100;
+
+    return ( uint32_t )timegm( &tm );
+}
+
+int main( int argc, char **argv )
+{
+    rtc_shm_page_t *page;
+    rtc_shm_page_t next;
+    rtc_time_t *local;
+    struct timespec tick;
+    unsigned period = 1000;
+    size_t i;
+    int fd;
+
+    if( argc < 3 )
+    {
+        fprintf( stderr, "usage: %s <chip> <gmt offset> [period ms]\n", argv[0] );
+        return 1;
+    }
+
+    for( i = 0; i < sizeof( chip_names ) / sizeof( chip_names[0] ); i++ )
+        if( !strcmp( argv[1], chip_names[i] ) )
+            break;
+
+#ifdef RTC_HAL_FAKE
+    if( i < sizeof( chip_names ) / sizeof( chip_names[0] ) )
+        fake_chip( chip_types[i] );
+#endif
+
+    if( i == sizeof( chip_names ) / sizeof( chip_names[0] ) ||
+        rtc_init( chip_types[i], atoi( argv[2] ) ) )
+    {
+        fprintf( stderr, "unknown chip or offset\n" );
+        return 1;
+    }
+
+    if( argc > 3 )
+        period = atoi( argv[3] );
+
+    fd = shm_open( RTC_SHM_NAME, O_CREAT | O_RDWR, 0644 );
+    if( fd < 0 || ftruncate( fd, sizeof( rtc_shm_page_t ) ) )
+    {
+        perror( "shm_open" );
+        return 1;
+    }
+
+    page = mmap( NULL, sizeof( rtc_shm_page_t ), PROT_READ | PROT_WRITE,
+                 MAP_SHARED, fd, 0 );
+    close( fd );
+    if( page == MAP_FAILED )
+    {
+        perror( "mmap" );
+        return 1;
+    }
+
+    signal( SIGINT, stop );
+    signal( SIGTERM, stop );
+
+    tick.tv_sec = period / 1000;
+    tick.tv_nsec = ( long )( period % 1000 ) * 1000000L;
+
+    while( running )
+    {
+        // one bus read for the time, the gmt side comes from the cache
+        local = rtc_get_local_time();
+        if( !local )
+        {
+            // bus failed, readers keep the last good page
+            nanosleep( &tick, NULL );
+            continue;
+        }
+        next.local = *local;
+        next.gmt_epoch = rtc_get_cached_unix_time();
+        gmt_from_epoch( next.gmt_epoch, &next.gmt );
+        next.local_epoch = epoch_from_time( &next.local );
+        next.power_failed = rtc_is_power_failure();
+
+        rtc_shm_write( page, &next );
+        nanosleep( &tick, NULL );
+    }
+
+    munmap( page, sizeof( rtc_shm_page_t ) );
+    shm_unlink( RTC_SHM_NAME );
+
+    return 0;
+}
@@ -0,0 +1,67 @@
+/*
+ * Time page published by RTC_shm_daemon.c
+ *
+ * The daemon is the only process on the bus, readers map the page
+ * read-only and copy it out under a sequence lock, no syscalls per read:
+ *
+ *   int fd = shm_open( RTC_SHM_NAME, O_RDONLY, 0 );
+ *   const rtc_shm_page_t *page = mmap( NULL, sizeof( rtc_shm_page_t ),
+ *                                      PROT_READ, MAP_SHARED, fd, 0 );
+ *   rtc_shm_page_t now;
+ *
+ *   rtc_shm_read( page, &now );
+ */
+#ifndef RTC_SHM_H_
+#define RTC_SHM_H_
+
+#include <stdint.h>
+#include "rtc.h"
+
+#define RTC_SHM_NAME "/rtc_time"
+
+typedef struct
+{
+    uint32_t   seq;           // odd while the daemon is writing
+    rtc_time_t gmt;
+    rtc_time_t local;
+    uint32_t   gmt_epoch;
+    uint32_t   local_epoch;
+    uint8_t    power_failed;
+} rtc_shm_page_t;
+
+static inline void rtc_shm_read( const rtc_shm_page_t *page,
+                                 rtc_shm_page_t *out )
+{
+    uint32_t start;
+
+    do
+    {
+        while( ( start = __atomic_load_n( &page->seq, __ATOMIC_ACQUIRE ) ) & 1 )
+            ;
+        out->gmt = page->gmt;
+        out->local = page->local;
+        out->gmt_epoch = page->gmt_epoch;
+        out->local_epoch = page->local_epoch;
+        out->power_failed = page->power_failed;
+        __atomic_thread_fence( __ATOMIC_ACQUIRE );
+    } while( __atomic_load_n( &page->seq, __ATOMIC_RELAXED ) != start );
+
+    out->seq = start;
+}
+
+static inline void rtc_shm_write( rtc_shm_page_t *page,
+                                  const rtc_shm_page_t *in )
+{
+    uint32_t seq = page->seq;
+
+    __atomic_store_n( &page->seq, seq + 1, __ATOMIC_RELAXED );
+    __atomic_thread_fence( __ATOMIC_RELEASE );
+    page->gmt = in->gmt;
+    page->local = in->local;
+    page->gmt_epoch = in->gmt_epoch;
+    page->local_epoch = in->local_epoch;
+    page->power_failed = in->power_failed;
+    __atomic_store_n( &page->seq, seq + 2, __ATOMIC_RELEASE );
+}
+
+#endif
@@ -77,11 +77,61 @@
 /******************************************************************************
 * Configuration Constants
 *******************************************************************************/
+/**
+ * @def Number of software timers multiplexed onto the hardware alarm
+ */
+#ifndef RTC_TIMER_MAX
+#define RTC_TIMER_MAX 16
+#endif
+
+/**
+ * @def Longest wait for the oscillator to report running, in ms
+ */
+#ifndef RTC_OSC_TIMEOUT_MS
+#define RTC_OSC_TIMEOUT_MS 1000
+#endif
+
+/**
+ * @def UNIX time packed timestamps count from, 2000-01-01 by default
+ */
+#ifndef RTC_PACK_EPOCH
+#define RTC_PACK_EPOCH 946684800UL
+#endif
+
+/**
+ * @def Define RTC_RECORD_CRC8 to check records with a 1 byte CRC-8
+ * instead of the 2 byte CRC-16
+ */
+#ifdef RTC_RECORD_CRC8
+#define RTC_RECORD_CRC_SIZE 1
+#else
+#define RTC_RECORD_CRC_SIZE 2
+#endif
+
+/**
+ * @def Largest record payload, record and CRC fill the MCP7941X SRAM
+ */
+#define RTC_RECORD_MAX ( 64 - RTC_RECORD_CRC_SIZE )
+
+/**
+ * @def SRAM taken by rtc_commit_write for a record of the given size
+ */
+#define RTC_COMMIT_SIZE( size ) ( 1 + 2 * ( ( size ) + RTC_RECORD_CRC_SIZE ) )
+
+/**
+ * @def Largest committed record, fills the MCP7941X SRAM
+ */
+#define RTC_COMMIT_MAX ( ( 64 - 1 ) / 2 - RTC_RECORD_CRC_SIZE )
 
 
 /******************************************************************************
 * Macros
 *******************************************************************************/
+/**
+ * @def Bits returned by rtc_alarm_service()
+ */
+#define RTC_ALARM_0_FIRED ( 1 << RTC_ALARM_0 )
+#define RTC_ALARM_1_FIRED ( 1 << RTC_ALARM_1 )
 
 
 /******************************************************************************
@@ -95,9 +145,28 @@ typedef enum
     RTC_PCF8583,   /**< RTC1 Click module */
     RTC2_DS1307,   /**< RTC2 Click module */
     RTC3_BQ32000,  /**< RTC3 Click module */
-    RTC6_MCP7941X  /**< RTC6 Click module */
+    RTC6_MCP7941X, /**< RTC6 Click module */
+    RTC_DS3231     /**< DS3231 / DS3232 TCXO module */
 } rtc_type_t;
 
+/**
+ * @enum Operation IDs recorded by the bus trace, see RTC_HAL_TRACE
+ */
+typedef enum
+{
+    RTC_OP_NONE,      /**< bus access outside of a library call */
+    RTC_OP_INIT,      /**< rtc_init and oscillator checks */
+    RTC_OP_CONFIG,    /**< square wave and battery settings */
+    RTC_OP_GET_TIME,  /**< time and timestamp reads */
+    RTC_OP_SET_TIME,  /**< time writes */
+    RTC_OP_POWER,     /**< power failure and outage records */
+    RTC_OP_TRIM,      /**< temperature, aging and calibration */
+    RTC_OP_ALARM,     /**< alarm setup and service */
+    RTC_OP_TIMER,     /**< software timer service */
+    RTC_OP_SRAM,      /**< SRAM access */
+    RTC_OP_EEPROM     /**< EEPROM and unique ID access */
+} rtc_op_t;
+
 /**
  * @struct Time definition of time elements
  *
@@ -113,8 +182,42 @@ typedef struct
     uint8_t year;
 } rtc_time_t;
 
+/**
+ * @struct Dates held field by field, each member points to an array
+ */
+typedef struct
+{
+    uint8_t *seconds;
+    uint8_t *minutes;
+    uint8_t *hours;
+    uint8_t *weekday;
+    uint8_t *monthday;
+    uint8_t *month;
+    uint8_t *year;
+} rtc_time_soa_t;
+
+/**
+ * @struct Timestamp with sub-second resolution
+ */
+typedef struct
+{
+    uint32_t epoch;      /**< gmt time in UNIX epoch time */
+    uint8_t  hundredths; /**< 1/100 s, 0 on chips without the counter */
+} rtc_stamp_t;
+
+/**
+ * @def Stored size of a packed timestamp, seconds only or with hundredths.
+ * Packed stamps count from RTC_PACK_EPOCH, unlike the outage log records
+ * which hold plain UNIX seconds.
+ */
+#define RTC_PACKED_SIZE            4
+#define RTC_PACKED_HUNDREDTHS_SIZE 5
+
 /**
  * @enum Output Modes
+ *
+ * @note On the DS3231 RTC_32_768KHZ enables the dedicated 32kHz pin, other
+ * frequencies are driven on the INT/SQW pin
  */
 typedef enum
 {
@@ -182,6 +285,94 @@ typedef enum
     SUNDAY,
 } rtc_day_t;
 
+/**
+ * @struct Clock state found at boot
+ */
+typedef struct
+{
+    bool osc_running;     /**< oscillator confirmed running */
+    bool osc_started;     /**< oscillator was stopped and had to be started */
+    bool osc_failed;      /**< oscillator stop flag set by the chip */
+    bool battery_enabled; /**< battery switchover is enabled */
+    bool power_failed;    /**< main supply was lost since last cleared */
+    bool time_valid;      /**< time kept counting since it was set */
+} rtc_boot_status_t;
+
+/**
+ * @struct Power outage record
+ */
+typedef struct
+{
+    rtc_time_t power_down; /**< main supply lost, minute resolution */
+    rtc_time_t power_up;   /**< main supply restored, minute resolution */
+    uint32_t   duration;   /**< outage length in seconds */
+} rtc_outage_t;
+
+/**
+ * @struct Recurrence rule, a field matches when its bit is set
+ *
+ * Month days and weekdays must both match. Weekdays are derived from the
+ * date, bit 1 is MONDAY and bit 7 is SUNDAY.
+ */
+typedef struct
+{
+    uint32_t minutes_lo; /**< minutes 0 to 31 */
+    uint32_t minutes_hi; /**< minutes 32 to 59 */
+    uint32_t hours;      /**< hours 0 to 23 */
+    uint32_t monthdays;  /**< days 1 to 31 */
+    uint16_t months;     /**< JANUARY to DECEMBER */
+    uint8_t  weekdays;   /**< MONDAY to SUNDAY */
+    uint8_t  second;     /**< second of the minute to fire at */
+} rtc_rule_t;
+
+/**
+ * @brief Software timer callback
+ *
+ * @param id - handle of the timer that expired
+ * @param arg - argument given to rtc_timer_start()
+ */
+typedef void ( *rtc_timer_cb_t )( int id, void *arg );
+
+/**
+ * @enum Battery backed memories
+ */
+typedef enum
+{
+    RTC_MEM_SRAM,     /**< DS1307, MCP7941X and DS3232 SRAM */
+    RTC_MEM_EEPROM    /**< MCP7941X EEPROM */
+} rtc_mem_t;
+
+/**
+ * @enum EEPROM write protected regions, BP1:BP0 of the STATUS register
+ */
+typedef enum
+{
+    RTC_EEPROM_PROTECT_NONE,     /**< all writable */
+    RTC_EEPROM_PROTECT_QUARTER,  /**< 0x60 to 0x7F */
+    RTC_EEPROM_PROTECT_HALF,     /**< 0x40 to 0x7F */
+    RTC_EEPROM_PROTECT_ALL       /**< 0x00 to 0x7F */
+} rtc_eeprom_protect_t;
+
+/**
+ * @struct Sequential read position, set up by rtc_cursor_open()
+ */
+typedef struct
+{
+    rtc_mem_t mem;
+    uint16_t  pos;        /**< next address, relative to the memory start */
+    uint16_t  end;        /**< one past the last address */
+} rtc_cursor_t;
+
+/**
+ * @brief Receives a chunk read by rtc_cursor_stream()
+ *
+ * @param data - chunk, only valid during the call
+ * @param size - bytes in the chunk
+ * @param arg - argument given to rtc_cursor_stream()
+ */
+typedef void ( *rtc_chunk_cb_t )( const uint8_t *data, uint16_t size,
+                                  void *arg );
+
 /******************************************************************************
 * Variables
 *******************************************************************************/
@@ -201,6 +392,8 @@ extern "C" {
 /**
  * @brief Initializes RTC based on type and time zone
  *
+ * Does not wait for the oscillator, see rtc_is_ready.
+ *
  * @param rtc_type_t type - type of RTC supported
  * @param time_zone - gmt offset of the zone
  *
@@ -215,6 +408,43 @@ extern "C" {
  */
 int rtc_init( rtc_type_t type, int8_t time_zone );
 
+/**
+ * @brief Initializes RTC and reports whether the time can be trusted
+ *
+ * The control block is read in one burst, the oscillator is only started
+ * when it was stopped and, on the MCP7941X, OSCRUN is polled for at most
+ * RTC_OSC_TIMEOUT_MS.
+ *
+ * @param rtc_type_t type - type of RTC supported
+ * @param time_zone - gmt offset of the zone
+ * @param status[OUT] - clock state, may be NULL
+ *
+ * @return
+ *  @retval 0 - successful
+ *  @retval -1 - error occured or the oscillator did not start in time
+ *
+ * @code
+ * rtc_boot_status_t boot;
+ *
+ * if( rtc_init_boot( RTC6_MCP7941X, -8, &boot ) || !boot.time_valid )
+ *     resync_time();
+ * @endcode
+ */
+int rtc_init_boot( rtc_type_t type, int8_t time_zone,
+                   rtc_boot_status_t *status );
+
+/**
+ * @brief Checks if the oscillator started by rtc_init is running
+ *
+ * rtc_init returns without waiting for the oscillator, the first time read
+ * blocks until it runs or RTC_OSC_TIMEOUT_MS passes. Polling this from
+ * the main loop keeps that read from blocking at all.
+ *
+ * @retval true - oscillator running, time reads will not wait
+ * @retval false - still starting up
+ */
+bool rtc_is_ready( void );
+
 /**
  * @brief Enables Daylight Savings Time compensation
  *
@@ -266,14 +496,17 @@ void rtc_battery_disable( void );
 /**
  * @brief Gets the current gmt time set in the RTC
  *
- * @return Returns gmt time
+ * @return Returns gmt time, NULL when the bus read failed
+ *
+ * @note The PCF8583 only counts years modulo 4, the base year is kept in
+ * RAM at 0xF5 to 0xF7 and advanced when the counter wraps
  */
 rtc_time_t *rtc_get_gmt_time( void );
 
 /**
  * @brief Calculates the current local time
  *
- * @return Returns local time
+ * @return Returns local time, NULL when the bus read failed
  */
 rtc_time_t *rtc_get_local_time( void );
 
@@ -300,23 +533,101 @@ int rtc_set_local_time( rtc_time_t time );
  * @brief Calculates the current gmt time in UNIX epoch time
  *
  * @return uint32_t
- * @retval gmt time converted to UNIX epoch time
+ * @retval gmt time converted to UNIX epoch time, 0 when the bus read failed
  */
 uint32_t rtc_get_gmt_unix_time( void );
 
 /**
  * @brief Calculates the current local time in UNIX epoch time
  * @return uint32_t
- * @retval Returns local time converted to UNIX epoch time
+ * @retval Returns local time converted to UNIX epoch time, 0 when the bus
+ * read failed
  */
 uint32_t rtc_get_local_unix_time( void );
 
+/**
+ * @brief Checks for bus failures since the last call
+ *
+ * Functions returning int report failed transfers with -1, time reads with
+ * NULL or 0. This catches failures in functions that return nothing.
+ *
+ * @retval -1 a transfer failed after all retries
+ * @retval  0 no failures
+ *
+ * @code
+ * rtc_write_sram_bulk( 0, log, sizeof( log ) );
+ * if( rtc_get_error() )
+ *     retry_later();
+ * @endcode
+ */
+int rtc_get_error( void );
+
+/**
+ * @brief Fastest i2c clock the chip supports
+ *
+ * rtc_init passes it to rtc_hal_set_speed, and so does every library call
+ * that switches slaves. With a hook set through rtc_hal_set_clock the bus
+ * runs at this speed for the chip's transfers only, e.g. 400 kHz for the
+ * MCP7941X on a bus shared with a DS1307. The MCP7941X only manages
+ * 400 kHz at Vcc >= 2.5 V, below that leave the hook unset and the bus
+ * at 100 kHz.
+ *
+ * @param type[IN] - chip
+ *
+ * @return clock in kHz, 0 for an unknown type
+ */
+uint16_t rtc_get_bus_khz( rtc_type_t type );
+
+/**
+ * @brief Reads a timestamp with 1/100 s resolution
+ *
+ * The PCF8583 hundredths, seconds and date registers are fetched in a
+ * single 6 byte burst so the fields are consistent with each other.
+ *
+ * @param stamp[OUT] - timestamp read
+ *
+ * @retval -1 failed
+ * @retval  0 successful
+ *
+ * @note Only the PCF8583 provides hundredths, other models return 0
+ */
+int rtc_get_stamp( rtc_stamp_t *stamp );
+
+/**
+ * @brief Interval between two timestamps
+ *
+ * @param start[IN] - earlier timestamp
+ * @param end[IN] - later timestamp
+ *
+ * @return int32_t - elapsed time in 1/100 s, negative if end is before start
+ *
+ * @code
+ * rtc_stamp_t a, b;
+ * rtc_get_stamp( &a );
+ * // wait for the pulse
+ * rtc_get_stamp( &b );
+ * width = rtc_stamp_diff( &a, &b ) * 10; // in ms
+ * @endcode
+ */
+int32_t rtc_stamp_diff( rtc_stamp_t *start, rtc_stamp_t *end );
+
+/**
+ * @brief Gmt time of the last read or write in UNIX epoch time
+ *
+ * @return uint32_t - cached gmt time, the chip is only read if nothing
+ * was cached yet
+ */
+uint32_t rtc_get_cached_unix_time( void );
+
 /**
  * @brief Checks if the current year is a leap one
  *
  * @return bool
  * @retval true on a leap year
  * @retval false if not a leap year
+ *
+ * @note Uses the last time read, the chip is only read if nothing was
+ * cached yet
  */
 bool rtc_is_leap_year( void );
 
@@ -340,6 +651,260 @@ bool rtc_is_power_failure( void );
  */
 rtc_time_t *rtc_get_last_power_failure( void );
 
+/**
+ * @brief Reads and clears the last power outage
+ *
+ * The power down and power up stamps are read in one 8 byte burst and
+ * their year is inferred from the current date. When the outage log is
+ * enabled the record is appended to it. PWRFAIL is cleared last, which
+ * re-arms the stamps for the next outage.
+ *
+ * @param outage[OUT] - decoded outage
+ *
+ * @retval -1 not supported, bus failure or the log record was not
+ * written, PWRFAIL stays set and the next call reads the outage again
+ * @retval  0 no outage recorded
+ * @retval  1 outage decoded and cleared
+ *
+ * @note Only supported by the MCP7941X
+ */
+int rtc_get_outage( rtc_outage_t *outage );
+
+/**
+ * @brief Enables logging outages to the EEPROM
+ *
+ * Each record takes 8 bytes, the power down and power up times as little
+ * endian UNIX seconds, not in the packed timestamp format. The log wraps
+ * around once full. The region is scanned once to find the newest
+ * record.
+ *
+ * @param addr[IN] - EEPROM address of the log, page aligned
+ * @param entries[IN] - number of records the log holds
+ *
+ * @retval -1 region does not fit the EEPROM or is not page aligned
+ * @retval  0 successful
+ *
+ * @note Only supported by the MCP7941X
+ */
+int rtc_outage_log_init( uint8_t addr, uint8_t entries );
+
+/**
+ * @brief Reads a record from the outage log
+ *
+ * @param index[IN] - 0 is the newest record
+ * @param down[OUT] - power down time in UNIX epoch time
+ * @param up[OUT] - power up time in UNIX epoch time
+ *
+ * @retval -1 no such record
+ * @retval  0 successful
+ */
+int rtc_outage_log_read( uint8_t index, uint32_t *down, uint32_t *up );
+
+/****************************************
+ ********* Calendar *********************
+ ***************************************/
+/**
+ * @brief Checks if a year is a leap one
+ *
+ * @param year[IN] - full year, e.g. 2016
+ *
+ * @return bool - true on a leap year
+ */
+bool rtc_cal_is_leap( uint16_t year );
+
+/**
+ * @brief Number of days in a month
+ *
+ * @param year[IN] - full year, e.g. 2016
+ * @param month[IN] - JANUARY to DECEMBER
+ *
+ * @return uint8_t - 28 to 31, 0 on an invalid month
+ */
+uint8_t rtc_cal_days_in_month( uint16_t year, uint8_t month );
+
+/**
+ * @brief Day of the year
+ *
+ * @param epoch[IN] - UNIX epoch time
+ *
+ * @return uint16_t - 1 to 366
+ */
+uint16_t rtc_cal_day_of_year( uint32_t epoch );
+
+/**
+ * @brief ISO 8601 week number
+ *
+ * @param epoch[IN] - UNIX epoch time
+ *
+ * @return uint8_t - 1 to 53
+ */
+uint8_t rtc_cal_iso_week( uint32_t epoch );
+
+/**
+ * @brief Week of the month, weeks start on Monday
+ *
+ * @param epoch[IN] - UNIX epoch time
+ *
+ * @return uint8_t - 1 to 6
+ *
+ * @code
+ * week = rtc_cal_week_of_month( rtc_get_cached_unix_time() );
+ * @endcode
+ */
+uint8_t rtc_cal_week_of_month( uint32_t epoch );
+
+/**
+ * @brief Converts an array of epochs to dates
+ *
+ * Same result as the single time conversions, years 2000 to 2106, without
+ * their per record branches.
+ *
+ * @param epochs[IN] - UNIX epoch times
+ * @param times[OUT] - dates, weekday 1 is Monday
+ * @param count[IN] - number of records
+ */
+void rtc_cal_to_times( const uint32_t *epochs, rtc_time_t *times, size_t count );
+
+/**
+ * @brief Converts an array of dates to epochs
+ *
+ * @param times[IN] - dates, weekday is ignored
+ * @param epochs[OUT] - UNIX epoch times
+ * @param count[IN] - number of records
+ *
+ * @code
+ * rtc_time_t log[32];
+ * uint32_t stamps[32];
+ *
+ * rtc_read_sram_bulk( 0, log, sizeof( log ) );
+ * rtc_cal_to_epochs( log, stamps, 32 );
+ * @endcode
+ */
+void rtc_cal_to_epochs( const rtc_time_t *times, uint32_t *epochs, size_t count );
+
+/**
+ * @brief Converts an array of epochs to dates held field by field
+ *
+ * Same result as rtc_cal_to_times. Hosted builds convert 4 records per
+ * step with SSE2 or NEON and 8 with AVX2 ( -mavx2 ), the rest and other
+ * targets use the scalar code. Define RTC_CAL_NO_SIMD to always use it.
+ *
+ * @param epochs[IN] - UNIX epoch times
+ * @param times[OUT] - field arrays, count entries each
+ * @param count[IN] - number of records
+ *
+ * @code
+ * uint8_t fields[7][1024];
+ * rtc_time_soa_t days = { fields[0], fields[1], fields[2], fields[3],
+ *                         fields[4], fields[5], fields[6] };
+ *
+ * rtc_cal_to_times_soa( stamps, &days, 1024 );
+ * @endcode
+ */
+void rtc_cal_to_times_soa( const uint32_t *epochs, const rtc_time_soa_t *times,
+                           size_t count );
+
+/**
+ * @brief Converts dates held field by field to epochs
+ *
+ * Same result as rtc_cal_to_epochs, with the same kernels as
+ * rtc_cal_to_times_soa.
+ *
+ * @param times[IN] - field arrays, weekday is ignored and may be NULL
+ * @param epochs[OUT] - UNIX epoch times
+ * @param count[IN] - number of records
+ */
+void rtc_cal_to_epochs_soa( const rtc_time_soa_t *times, uint32_t *epochs,
+                            size_t count );
+
+/****************************************
+ ********* Temperature / Trim ***********
+ ***************************************/
+/**
+ * @brief Reads the die temperature of the TCXO
+ *
+ * @return int16_t - temperature in quarter degrees Celsius
+ *
+ * @note Only supported by the DS3231, the chip refreshes the value every
+ * 64 seconds
+ */
+int16_t rtc_get_temperature( void );
+
+/**
+ * @brief Sets the aging offset used to trim the TCXO
+ *
+ * @param offset[IN] - signed offset, one step is roughly 0.1ppm at 25C,
+ * positive values slow the clock down
+ *
+ * @retval -1 not supported
+ * @retval  0 successful
+ *
+ * @note Only supported by the DS3231
+ */
+int rtc_set_aging_offset( int8_t offset );
+
+/**
+ * @brief Reads the aging offset currently programmed in the TCXO
+ *
+ * @return int8_t - signed aging offset
+ *
+ * @note Only supported by the DS3231
+ */
+int8_t rtc_get_aging_offset( void );
+
+/****************************************
+ ********* Calibration ******************
+ ***************************************/
+/**
+ * @brief Discards all reference samples taken so far
+ */
+void rtc_calib_reset( void );
+
+/**
+ * @brief Records a reference timestamp against the current RTC time
+ *
+ * Call right at the reference edge ( GPS PPS, NTP reply... ), the first
+ * sample starts the measurement and every following one extends it.
+ *
+ * @param ref_epoch[IN] - reference gmt time in UNIX epoch time
+ *
+ * @return int - number of samples taken so far
+ */
+int rtc_calib_add_reference( uint32_t ref_epoch );
+
+/**
+ * @brief Drift measured from the reference samples
+ *
+ * @return int16_t - drift in 0.1ppm, positive when the RTC runs fast,
+ * 0 with less than two samples
+ */
+int16_t rtc_calib_get_drift( void );
+
+/**
+ * @brief Compensates the measured drift
+ *
+ * MCP7941X programs OSCTRIM, selecting coarse trim only when the fine
+ * range is exceeded. DS3231 adjusts the aging offset. Chips without trim
+ * hardware keep the drift for rtc_calib_correct(). The result is kept in
+ * the last 8 bytes of the battery backed SRAM where available.
+ *
+ * @retval -1 less than two samples, no measurable interval or bus error
+ * @retval  0 successful
+ */
+int rtc_calib_apply( void );
+
+/**
+ * @brief Software drift correction for chips without trim hardware
+ *
+ * Steps the RTC by the whole seconds accumulated since the last correction.
+ * Call periodically, e.g. once an hour.
+ *
+ * @return int - seconds the clock was stepped by
+ *
+ * @note Does nothing on MCP7941X and DS3231, trimming is done in hardware
+ */
+int rtc_calib_correct( void );
+
 /****************************************
  ********* Alarms ***********************
  ***************************************/
@@ -374,6 +939,159 @@ void rtc_disable_alarm( rtc_alarm_t alarm );
  */
 rtc_time_t *rtc_read_alarm( rtc_alarm_t alarm );
 
+/**
+ * @brief Reads and acknowledges the alarm interrupt flags
+ *
+ * Both flags are read in one burst and the fired ones cleared in one
+ * write, which releases the MFP / INT pin. Short enough to be called
+ * from the alarm ISR as long as it does not preempt another rtc_* call.
+ *
+ * @return uint8_t - RTC_ALARM_0_FIRED | RTC_ALARM_1_FIRED, 0 if none
+ *
+ * @code
+ * fired = rtc_alarm_service();
+ * if( fired & RTC_ALARM_1_FIRED )
+ *     ...
+ * @endcode
+ *
+ * @note Not supported by all models
+ */
+uint8_t rtc_alarm_service( void );
+
+/****************************************
+ ********* Timers ***********************
+ ***************************************/
+/**
+ * @brief Schedules a software timer
+ *
+ * Timers are kept in a min-heap on their deadline, only the nearest one
+ * is programmed into RTC_ALARM_0. Insert, cancel and expiry are O(log n).
+ *
+ * @param deadline[IN] - gmt time in UNIX epoch time to expire at
+ * @param cb[IN] - function called from rtc_timer_service()
+ * @param arg[IN] - passed to the callback
+ *
+ * @return int - timer handle, -1 if all RTC_TIMER_MAX timers are in use
+ *
+ * @note RTC_ALARM_0 is owned by the timers while any is pending. The
+ * alarm does not match the year, so a deadline within a second of the
+ * clock, or one passed while the alarm was written, runs its callback
+ * before this returns.
+ */
+int rtc_timer_start( uint32_t deadline, rtc_timer_cb_t cb, void *arg );
+
+/**
+ * @brief Cancels a pending timer
+ *
+ * @param id[IN] - handle returned by rtc_timer_start()
+ *
+ * @retval -1 not pending
+ * @retval  0 successful
+ */
+int rtc_timer_cancel( int id );
+
+/**
+ * @brief Deadline of the nearest pending timer
+ *
+ * @return uint32_t - UNIX epoch time, 0 if no timer is pending
+ */
+uint32_t rtc_timer_next( void );
+
+/**
+ * @brief Runs expired timers and arms the alarm for the next one
+ *
+ * Call when the alarm interrupt fires. Timers may be started or canceled
+ * from the callbacks.
+ *
+ * @return uint16_t - number of timers that expired
+ */
+uint16_t rtc_timer_service( void );
+
+/**
+ * @brief Advances the shadow clock by one second
+ *
+ * For chips without alarms ( DS1307, BQ32000 ), call on every 1Hz square
+ * wave edge. The bus is only touched when the nearest timer is due.
+ */
+void rtc_timer_tick( void );
+
+/****************************************
+ ********* Recurring Alarms *************
+ ***************************************/
+/**
+ * @brief Initializes a rule that matches every minute at second 0
+ *
+ * @param rule[OUT] - rule to initialize
+ */
+void rtc_rule_init( rtc_rule_t *rule );
+
+/**
+ * @brief Restricts the minutes a rule fires at
+ *
+ * @param rule[IN/OUT] - rule to modify
+ * @param first[IN] - first minute
+ * @param last[IN] - last minute, inclusive
+ * @param step[IN] - every n-th minute from first
+ */
+void rtc_rule_minutes( rtc_rule_t *rule, uint8_t first, uint8_t last,
+                       uint8_t step );
+
+/**
+ * @brief Restricts the hours a rule fires at, see rtc_rule_minutes()
+ */
+void rtc_rule_hours( rtc_rule_t *rule, uint8_t first, uint8_t last,
+                     uint8_t step );
+
+/**
+ * @brief Restricts the month days a rule fires on, see rtc_rule_minutes()
+ */
+void rtc_rule_monthdays( rtc_rule_t *rule, uint8_t first, uint8_t last,
+                         uint8_t step );
+
+/**
+ * @brief Restricts the months a rule fires in, see rtc_rule_minutes()
+ */
+void rtc_rule_months( rtc_rule_t *rule, rtc_month_t first, rtc_month_t last,
+                      uint8_t step );
+
+/**
+ * @brief Restricts the weekdays a rule fires on, see rtc_rule_minutes()
+ *
+ * @code
+ * // every 15 minutes between 08:00 and 18:00 on weekdays
+ * rtc_rule_init( &rule );
+ * rtc_rule_minutes( &rule, 0, 59, 15 );
+ * rtc_rule_hours( &rule, 8, 17, 1 );
+ * rtc_rule_weekdays( &rule, MONDAY, FRIDAY, 1 );
+ * @endcode
+ */
+void rtc_rule_weekdays( rtc_rule_t *rule, rtc_day_t first, rtc_day_t last,
+                        uint8_t step );
+
+/**
+ * @brief Calculates the next time a rule fires
+ *
+ * @param rule[IN] - recurrence rule
+ * @param after[IN] - UNIX epoch time to search from, exclusive
+ *
+ * @return uint32_t - UNIX epoch time of the next occurrence, 0 if none
+ * within the next 8 years
+ */
+uint32_t rtc_rule_next( const rtc_rule_t *rule, uint32_t after );
+
+/**
+ * @brief Schedules a software timer at the next occurrence of a rule
+ *
+ * Call again from the callback to keep the rule running.
+ *
+ * @param rule[IN] - recurrence rule
+ * @param cb[IN] - timer callback
+ * @param arg[IN] - passed to the callback
+ *
+ * @return int - timer handle, -1 on failure
+ */
+int rtc_rule_schedule( const rtc_rule_t *rule, rtc_timer_cb_t cb, void *arg );
+
 
 /****************************************
  ********* Memory ***********************
@@ -387,8 +1105,11 @@ rtc_time_t *rtc_read_alarm( rtc_alarm_t alarm );
  * Valid Addresses: 
  * RTC2 0x00 to 0x38
  * RTC6 0x00 to 0x40
+ * DS3232 0x00 to 0xEB
  *
  * @note Not supported by all models
+ * @note The last 8 bytes hold the calibration record once
+ * rtc_calib_apply() has been used
  */
 void rtc_write_sram( uint8_t addr, uint8_t data_in );
 
@@ -424,11 +1145,42 @@ uint8_t rtc_read_sram( uint8_t addr );
  */
 void rtc_read_sram_bulk( uint8_t addr, void *data_out, uint8_t data_size );
 
+/**
+ * @brief Write protects a region at the top of the EEPROM
+ *
+ * STATUS is read once and cached, setting the region already in place
+ * costs no bus access.
+ *
+ * @param region[IN] - region to protect, the rest becomes writable
+ *
+ * @return
+ *  @retval 0 - successful
+ *  @retval -1 - not an MCP7941X or bus failure
+ *
+ * @note Not supported by all models
+ */
+int rtc_eeprom_set_protect( rtc_eeprom_protect_t region );
 
+/**
+ * @brief Reads the protected region, from the cache after the first call
+ *
+ * @return int - rtc_eeprom_protect_t, -1 if not an MCP7941X or bus failure
+ */
+int rtc_eeprom_get_protect( void );
+
+/**
+ * @brief Protects the whole EEPROM
+ */
 void rtc_eeprom_write_protect_on( void );
 
+/**
+ * @brief Removes the EEPROM protection
+ */
 void rtc_eeprom_write_protect_off( void );
 
+/**
+ * @brief Checks if the whole EEPROM is protected
+ */
 bool rtc_eeprom_is_locked( void );
 
 /**
@@ -457,10 +1209,295 @@ bool rtc_write_eeprom( uint8_t addr, void *data_in, uint8_t data_size );
  */
 void rtc_read_eeprom( uint8_t addr, void *data_out, uint8_t data_size );
 
+/**
+ * @brief Writes a block of any length to the EEPROM
+ *
+ * The block is split at the 8 byte page boundaries, each page write waits
+ * out the 5 ms write cycle, so 128 bytes take about 80 ms.
+ *
+ * @param addr[IN] - first address, 0 to 127
+ * @param data_in[IN] - data to write
+ * @param size[IN] - number of bytes
+ *
+ * @return
+ *  @retval 0 - successful
+ *  @retval -1 - not an MCP7941X, block past the end or in the protected
+ *  region, or bus failure
+ *
+ * @note Not supported by all models
+ */
+int rtc_eeprom_write_block( uint16_t addr, const void *data_in, size_t size );
+
+/**
+ * @brief Reads a block of any length from the EEPROM in one transfer
+ *
+ * @param addr[IN] - first address, 0 to 127
+ * @param data_out[OUT] - buffer
+ * @param size[IN] - number of bytes
+ *
+ * @return
+ *  @retval 0 - successful
+ *  @retval -1 - not an MCP7941X, block past the end or bus failure
+ *
+ * @note Not supported by all models
+ */
+int rtc_eeprom_read_block( uint16_t addr, void *data_out, size_t size );
+
+/**
+ * @brief Starts a sequential read of SRAM or EEPROM
+ *
+ * @param cursor[OUT] - read position
+ * @param mem[IN] - memory to read
+ * @param addr[IN] - first address, 0 is the start of the memory
+ * @param size[IN] - bytes to read, 0 reads to the end of the memory
+ *
+ * @return
+ *  @retval 0 - successful
+ *  @retval -1 - the chip has no such memory or the range does not fit it
+ */
+int rtc_cursor_open( rtc_cursor_t *cursor, rtc_mem_t mem, uint16_t addr,
+                     uint16_t size );
+
+/**
+ * @brief Reads the next bytes under the cursor in one sequential transfer
+ *
+ * @param cursor[IN/OUT] - read position, advanced by the bytes read
+ * @param data_out[OUT] - buffer
+ * @param max[IN] - buffer size
+ *
+ * @return int - bytes read, 0 at the end, -1 on a bus failure
+ */
+int rtc_cursor_read( rtc_cursor_t *cursor, void *data_out, uint16_t max );
+
+/**
+ * @brief Reads up to the end of the cursor range, passing each chunk on
+ *
+ * The rest of the range is one sequential transfer on the byte-wise and
+ * TIVA backends, the buffer only sets how often the callback runs. STM32,
+ * FT90x and Linux read RTC_HAL_BURST_MAX bytes per transfer.
+ *
+ * @param cursor[IN/OUT] - read position
+ * @param buffer[IN] - scratch for one chunk
+ * @param buffer_size[IN] - chunk size
+ * @param cb[IN] - chunk callback
+ * @param arg[IN] - passed to the callback
+ *
+ * @return
+ *  @retval 0 - successful
+ *  @retval -1 - bus failure, the cursor stays on the failed chunk
+ *
+ * @code
+ * static void to_uart( const uint8_t *data, uint16_t size, void *arg )
+ * {
+ *     while( size-- )
+ *         UART1_Write( *data++ );
+ * }
+ *
+ * rtc_cursor_t log;
+ * uint8_t chunk[32];
+ *
+ * if( !rtc_cursor_open( &log, RTC_MEM_EEPROM, 0, 0 ) )
+ *     rtc_cursor_stream( &log, chunk, sizeof( chunk ), to_uart, NULL );
+ * @endcode
+ */
+int rtc_cursor_stream( rtc_cursor_t *cursor, uint8_t *buffer,
+                       uint16_t buffer_size, rtc_chunk_cb_t cb, void *arg );
+
+/**
+ * @brief CRC-8, polynomial 0x07, MSB first
+ *
+ * Nibble tables, 16 bytes of ROM. 0x00 starts a new CRC, the result of
+ * a previous call continues it.
+ *
+ * @param crc[IN] - start value
+ * @param data[IN] - data
+ * @param size[IN] - number of bytes
+ *
+ * @return uint8_t - CRC, 0xF4 for "123456789" from 0x00
+ */
+uint8_t rtc_crc8( uint8_t crc, const void *data, size_t size );
+
+/**
+ * @brief CRC-16/CCITT, polynomial 0x1021, MSB first
+ *
+ * @param crc[IN] - start value, 0xFFFF for a new CRC
+ * @param data[IN] - data
+ * @param size[IN] - number of bytes
+ *
+ * @return uint16_t - CRC, 0x29B1 for "123456789" from 0xFFFF
+ */
+uint16_t rtc_crc16( uint16_t crc, const void *data, size_t size );
+
+/**
+ * @brief Writes a record followed by its CRC
+ *
+ * The CRC is computed while the record is copied into the transfer
+ * buffer, record and CRC go out in one write.
+ *
+ * @param mem[IN] - memory
+ * @param addr[IN] - address, the record takes size + RTC_RECORD_CRC_SIZE
+ * @param data_in[IN] - record
+ * @param size[IN] - record size, up to RTC_RECORD_MAX
+ *
+ * @return
+ *  @retval 0 - successful
+ *  @retval -1 - record does not fit or bus failure
+ */
+int rtc_record_write( rtc_mem_t mem, uint16_t addr, const void *data_in,
+                      uint8_t size );
+
+/**
+ * @brief Reads a record written by rtc_record_write and checks its CRC
+ *
+ * One streamed read for record and CRC, the CRC runs on the bytes as
+ * they arrive.
+ *
+ * @param mem[IN] - memory
+ * @param addr[IN] - address
+ * @param data_out[OUT] - record, also filled when the CRC does not match
+ * @param size[IN] - record size, up to RTC_RECORD_MAX
+ *
+ * @return
+ *  @retval 0 - record intact
+ *  @retval -1 - CRC mismatch, e.g. a write cut by a brown-out, or bus failure
+ *
+ * @code
+ * if( rtc_record_read( RTC_MEM_SRAM, 0, &config, sizeof( config ) ) )
+ *     config_defaults( &config );
+ * @endcode
+ */
+int rtc_record_read( rtc_mem_t mem, uint16_t addr, void *data_out,
+                     uint8_t size );
+
+/**
+ * @brief Replaces a record in SRAM so a power loss never leaves it half
+ * written
+ *
+ * The new copy is written as a checked record to the inactive one of two
+ * slots, then a single sequence byte switches to it. Until that byte is
+ * written rtc_commit_read returns the previous copy.
+ *
+ * @param addr[IN] - SRAM address, the record takes RTC_COMMIT_SIZE( size )
+ * @param data_in[IN] - record
+ * @param size[IN] - record size, up to RTC_COMMIT_MAX, the same on every
+ * write and read of the address
+ *
+ * @return
+ *  @retval 0 - committed
+ *  @retval -1 - record does not fit or bus failure, the old copy stays
+ */
+int rtc_commit_write( uint16_t addr, const void *data_in, uint8_t size );
+
+/**
+ * @brief Reads the last committed copy with one bulk read
+ *
+ * @param addr[IN] - SRAM address
+ * @param data_out[OUT] - record
+ * @param size[IN] - record size
+ *
+ * @return
+ *  @retval 0 - committed copy read
+ *  @retval 1 - committed copy damaged later, the one before it was read
+ *  @retval -1 - no intact copy, e.g. never written, or bus failure
+ *
+ * @code
+ * rtc_commit_write( 0, &state, sizeof( state ) );
+ * ...
+ * if( rtc_commit_read( 0, &state, sizeof( state ) ) < 0 )
+ *     state_defaults( &state );
+ * @endcode
+ */
+int rtc_commit_read( uint16_t addr, void *data_out, uint8_t size );
+
+/**
+ * @brief Packs a time into seconds since RTC_PACK_EPOCH
+ *
+ * @param time[IN] - gmt time
+ *
+ * @return uint32_t - packed time, 0 for times before RTC_PACK_EPOCH
+ */
+uint32_t rtc_pack_time( const rtc_time_t *time );
+
+/**
+ * @brief Unpacks a time packed with rtc_pack_time
+ *
+ * @param packed[IN] - seconds since RTC_PACK_EPOCH
+ * @param time[OUT] - gmt time
+ */
+void rtc_unpack_time( uint32_t packed, rtc_time_t *time );
+
+/**
+ * @brief Stores a timestamp packed in SRAM
+ *
+ * @param addr[IN] - SRAM address, same range as rtc_write_sram_bulk
+ * @param stamp[IN] - timestamp to store
+ * @param size[IN] - RTC_PACKED_SIZE or RTC_PACKED_HUNDREDTHS_SIZE
+ *
+ * @return
+ *  @retval 0 - successful
+ *  @retval -1 - bad size, stamp before RTC_PACK_EPOCH, no SRAM, past the
+ *  end of it or bus failure
+ *
+ * @code
+ * rtc_stamp_t events[12];      // 60 bytes of SRAM, 84 as rtc_time_t
+ *
+ * rtc_get_stamp( &events[n] );
+ * rtc_write_stamp_sram( n * RTC_PACKED_HUNDREDTHS_SIZE, &events[n],
+ *                       RTC_PACKED_HUNDREDTHS_SIZE );
+ * @endcode
+ */
+int rtc_write_stamp_sram( uint8_t addr, const rtc_stamp_t *stamp, uint8_t size );
+
+/**
+ * @brief Reads a packed timestamp from SRAM
+ *
+ * @param addr[IN] - SRAM address
+ * @param stamp[OUT] - timestamp, hundredths are 0 for RTC_PACKED_SIZE
+ * @param size[IN] - RTC_PACKED_SIZE or RTC_PACKED_HUNDREDTHS_SIZE
+ *
+ * @return
+ *  @retval 0 - successful
+ *  @retval -1 - bad size, no SRAM, past the end of it or bus failure
+ */
+int rtc_read_stamp_sram( uint8_t addr, rtc_stamp_t *stamp, uint8_t size );
+
+/**
+ * @brief Stores a timestamp packed in EEPROM
+ *
+ * @param addr[IN] - EEPROM address
+ * @param stamp[IN] - timestamp to store
+ * @param size[IN] - RTC_PACKED_SIZE or RTC_PACKED_HUNDREDTHS_SIZE
+ *
+ * @return
+ *  @retval 0 - successful
+ *  @retval -1 - bad size, stamp before RTC_PACK_EPOCH, no EEPROM, past
+ *  the end of it, protected or bus failure
+ *
+ * @note A record crossing an 8 byte page takes two write cycles, a 4 byte
+ * record never crosses one when the address is a multiple of 4
+ */
+int rtc_write_stamp_eeprom( uint8_t addr, const rtc_stamp_t *stamp, uint8_t size );
+
+/**
+ * @brief Reads a packed timestamp from EEPROM
+ *
+ * @param addr[IN] - EEPROM address
+ * @param stamp[OUT] - timestamp, hundredths are 0 for RTC_PACKED_SIZE
+ * @param size[IN] - RTC_PACKED_SIZE or RTC_PACKED_HUNDREDTHS_SIZE
+ *
+ * @return
+ *  @retval 0 - successful
+ *  @retval -1 - bad size, no EEPROM, past the end of it or bus failure
+ */
+int rtc_read_stamp_eeprom( uint8_t addr, rtc_stamp_t *stamp, uint8_t size );
+
 /**
  * @brief Reads unique ID from EEPROM registers of the RTC
  *
- * @returns uint8_t* - 8 bytes
+ * Only the first call after rtc_init or rtc_write_unique_id goes to the
+ * bus. EUI-48 parts keep the ID in bytes 2 to 7.
+ *
+ * @returns uint8_t* - 8 bytes, NULL if the read failed
  *
  * @note Not supported by all models
  */
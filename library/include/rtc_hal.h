@@ -36,6 +36,8 @@
 * Includes
 *******************************************************************************/
 #include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
 
 /******************************************************************************
 * Preprocessor Constants
@@ -45,6 +47,43 @@
 /******************************************************************************
 * Configuration Constants
 *******************************************************************************/
+/**
+ * @def i2c-dev bus used on Linux, RTC_I2C_DEV in the environment overrides it
+ */
+#ifndef RTC_HAL_I2C_DEV
+#define RTC_HAL_I2C_DEV "/dev/i2c-1"
+#endif
+
+/**
+ * @def Extra attempts after a failed transfer, waiting RTC_HAL_BACKOFF_MS
+ * before the first and twice as long before each next one
+ */
+#ifndef RTC_HAL_RETRIES
+#define RTC_HAL_RETRIES 2
+#endif
+
+#ifndef RTC_HAL_BACKOFF_MS
+#define RTC_HAL_BACKOFF_MS 1
+#endif
+
+/**
+ * @def Stack frame for STM32 and FT90x writes, which copy the register
+ * byte and the data into one buffer. Longer writes go out as several
+ * bursts of this size, each starting at its own register. The other
+ * backends send any length as one transaction. Also the chunk of
+ * rtc_hal_read_stream() on STM32, FT90x and Linux.
+ */
+#ifndef RTC_HAL_BURST_MAX
+#define RTC_HAL_BURST_MAX 64
+#endif
+
+/**
+ * @def Define RTC_HAL_TRACE to record every bus transfer, entries kept
+ * in the trace ring, must be a power of 2
+ */
+#ifndef RTC_HAL_TRACE_SIZE
+#define RTC_HAL_TRACE_SIZE 64
+#endif
 
 
 /******************************************************************************
@@ -55,6 +94,51 @@
 /******************************************************************************
 * Typedefs
 *******************************************************************************/
+/**
+ * @struct One register read of a batch
+ */
+typedef struct
+{
+    uint8_t address;        /**< register address inside the slave */
+    void *data_out;         /**< buffer for the read data */
+    size_t num_bytes;       /**< number of bytes to read */
+} rtc_hal_read_t;
+
+/**
+ * @struct Pin access for bus recovery
+ *
+ * The hooks drive the bus lines as open drain GPIOs, restore hands the
+ * pins back to the i2c peripheral and may be NULL.
+ */
+typedef struct
+{
+    void ( *scl )( uint8_t level );
+    void ( *sda )( uint8_t level );
+    uint8_t ( *sda_read )( void );
+    void ( *restore )( void );
+} rtc_hal_recovery_t;
+
+/**
+ * @brief Sets the bus clock in kHz, e.g. re-runs the i2c init
+ */
+typedef void ( *rtc_hal_clock_t )( uint16_t khz );
+
+/**
+ * @brief Takes one byte of rtc_hal_read_stream()
+ */
+typedef void ( *rtc_hal_stream_t )( uint8_t data, void *arg );
+
+/**
+ * @struct Bus trace entry, 8 bytes, decoded by tools/rtc_trace.py
+ */
+typedef struct
+{
+    uint32_t ticks;         /**< duration in user tick units */
+    uint8_t op;             /**< rtc_op_t of the library call, bit 7 on failure */
+    uint8_t slave;          /**< address byte, bit 0 set on reads */
+    uint8_t reg;            /**< first register */
+    uint8_t len;            /**< bytes transferred, 255 if more */
+} rtc_hal_trace_t;
 
 
 /******************************************************************************
@@ -80,7 +164,7 @@ void rtc_hal_init( uint8_t address_id );
 /**
  * @brief Changes the i2c slave address
  *
- * @param address_id - Desired i2c slave address
+ * @param address_id - Desired 7-bit i2c slave address
  */
 void rtc_hal_set_slave( uint8_t address_id );
 
@@ -90,8 +174,13 @@ void rtc_hal_set_slave( uint8_t address_id );
  * @param address[IN] - Desired slave register address to write to
  * @param data_in[IN] - Desired data to be written
  * @param num_bytes[IN] - Number of bytes to write
+ *
+ * @return
+ *  @retval 0 - successful
+ *  @retval -1 - not acknowledged after RTC_HAL_RETRIES retries, or more
+ *  than 256 bytes on Linux
  */
-void rtc_hal_write( uint8_t address, void *data_in, size_t num_bytes );
+int rtc_hal_write( uint8_t address, void *data_in, size_t num_bytes );
 
 /**
  * @brief Reads data from slave through i2c
@@ -99,8 +188,242 @@ void rtc_hal_write( uint8_t address, void *data_in, size_t num_bytes );
  * @param address[IN] - Desired register address inside the i2c slave
  * @param data_out[OUT] - Buffer to store the read data to
  * @param num_bytes[IN] - Number of bytes to be read
+ *
+ * @return
+ *  @retval 0 - successful
+ *  @retval -1 - not acknowledged after RTC_HAL_RETRIES retries
+ */
+int rtc_hal_read ( uint8_t address, void *data_out, size_t num_bytes );
+
+/**
+ * @brief Reads data from slave through i2c, handing over each byte as it
+ * comes off the bus
+ *
+ * The byte-wise backends and TIVA read the whole length as one
+ * transaction. STM32, FT90x and Linux read into a stack buffer of
+ * RTC_HAL_BURST_MAX bytes, one transaction per chunk.
+ *
+ * @param address[IN] - Desired register address inside the i2c slave
+ * @param num_bytes[IN] - Number of bytes to be read
+ * @param cb[IN] - called once per byte, in address order
+ * @param arg[IN] - passed to the callback
+ *
+ * @return
+ *  @retval 0 - successful
+ *  @retval -1 - not acknowledged after RTC_HAL_RETRIES retries, or a
+ *  transfer failed after bytes were handed over, which is not retried
+ */
+int rtc_hal_read_stream( uint8_t address, size_t num_bytes,
+                         rtc_hal_stream_t cb, void *arg );
+
+/**
+ * @brief Reads several register blocks from the current slave
+ *
+ * On Linux the whole batch is one I2C_RDWR ioctl with repeated starts,
+ * elsewhere the reads are issued one after another.
+ *
+ * @param reads[IN/OUT] - Reads to perform
+ * @param count[IN] - Number of entries in reads
+ *
+ * @return
+ *  @retval 0 - successful
+ *  @retval -1 - a read failed, later ones were not issued
+ */
+int rtc_hal_read_batch( rtc_hal_read_t *reads, size_t count );
+
+/**
+ * @brief Sets the pins used to free a stuck bus, NULL disables recovery
+ *
+ * @param recovery[IN] - pin hooks, must stay valid while set
+ */
+void rtc_hal_set_recovery( const rtc_hal_recovery_t *recovery );
+
+/**
+ * @brief Frees a bus held low by a slave
+ *
+ * Clocks SCL up to 9 times until SDA is released, then sends a STOP.
+ * Failed transfers run it before each retry.
+ *
+ * @return
+ *  @retval 0 - SDA released
+ *  @retval -1 - no pin hooks or SDA still low
+ */
+int rtc_hal_recover( void );
+
+/**
+ * @brief Sets the hook switching the bus clock, NULL leaves the clock alone
+ *
+ * Transfers call it when the slave needs a different clock than the last
+ * one set. Call it again after changing the clock outside the library.
+ *
+ * @param clock[IN] - clock hook
+ */
+void rtc_hal_set_clock( rtc_hal_clock_t clock );
+
+/**
+ * @brief Sets the fastest clock the slave supports, applied by the next
+ * transfer through the clock hook
+ *
+ * @param khz[IN] - clock in kHz
+ */
+void rtc_hal_set_speed( uint16_t khz );
+
+/**
+ * @brief Blocking delay
+ *
+ * @param ms[IN] - Milliseconds to wait
  */
-void rtc_hal_read ( uint8_t address, void *data_out, size_t num_bytes );
+void rtc_hal_delay( uint16_t ms );
+
+#ifdef RTC_HAL_TRACE
+/**
+ * @brief Clears the trace ring and sets the tick source for durations
+ *
+ * @param tick[IN] - free running counter, e.g. a timer or DWT cycle count
+ */
+void rtc_hal_trace_init( uint32_t ( *tick )( void ) );
+
+/**
+ * @brief Tags following transfers with the library call making them
+ *
+ * @param op[IN] - rtc_op_t value
+ */
+void rtc_hal_trace_op( uint8_t op );
+
+/**
+ * @brief Keeps the current tag while a call nests other tagged calls
+ *
+ * Holds count, every hold needs its release. While held
+ * rtc_hal_trace_op() is ignored, so the outer call tags all transfers.
+ *
+ * @param hold[IN] - true to hold, false to release
+ */
+void rtc_hal_trace_hold( bool hold );
+
+/**
+ * @brief Trace ring access
+ *
+ * Entries are written before head moves, a reader copies up to
+ * RTC_HAL_TRACE_SIZE entries behind head without locking. A transfer may
+ * overwrite the oldest of them meanwhile: read head again after copying
+ * and drop every entry RTC_HAL_TRACE_SIZE or more behind the new head.
+ *
+ * @param head[OUT] - number of entries ever written
+ *
+ * @return const volatile rtc_hal_trace_t* - RTC_HAL_TRACE_SIZE entries
+ */
+const volatile rtc_hal_trace_t *rtc_hal_trace_ring( uint16_t *head );
+#endif
+
+#ifdef RTC_HAL_FAKE
+/*
+ * In-process bus for host builds, library/src/rtc_hal_fake.c. Slaves are
+ * 256 byte register files driven through the byte-wise backend, time is
+ * simulated so bus and write cycle times can be measured.
+ */
+
+/**
+ * @def Wire log entries, written bytes are logged as is
+ */
+#define RTC_HAL_FAKE_START      0x100   /**< START or repeated START */
+#define RTC_HAL_FAKE_STOP       0x200   /**< STOP */
+#define RTC_HAL_FAKE_NACK       0x400   /**< byte not acknowledged */
+#define RTC_HAL_FAKE_READ       0x800   /**< byte read by the master */
+
+#ifndef RTC_HAL_FAKE_WIRE_SIZE
+#define RTC_HAL_FAKE_WIRE_SIZE  1024
+#endif
+
+/**
+ * @def Simulated cost of re-initialising the i2c peripheral for a new clock
+ */
+#ifndef RTC_HAL_FAKE_CLOCK_US
+#define RTC_HAL_FAKE_CLOCK_US   50
+#endif
+
+/**
+ * @struct Fake bus counters since rtc_hal_fake_clear
+ */
+typedef struct
+{
+    uint32_t starts;        /**< STARTs including repeated ones */
+    uint32_t bytes;         /**< bytes on the wire, address bytes included */
+    uint32_t nacks;         /**< bytes not acknowledged */
+    uint32_t time_us;       /**< simulated bus and delay time */
+} rtc_hal_fake_stats_t;
+
+/**
+ * @brief Removes all slaves and clears the counters, the clock goes back
+ * to 100 kHz
+ */
+void rtc_hal_fake_reset( void );
+
+/**
+ * @brief Clears the counters, the wire log and the simulated time
+ */
+void rtc_hal_fake_clear( void );
+
+/**
+ * @brief Puts a slave on the bus
+ *
+ * @param slave[IN] - 7-bit address
+ * @param page[IN] - writes wrap inside pages of this size, 0 for none
+ * @param write_ms[IN] - after a write the slave NACKs for this long
+ *
+ * @return uint8_t* - 256 byte register file, NULL if 4 slaves are attached
+ */
+uint8_t *rtc_hal_fake_attach( uint8_t slave, uint8_t page, uint8_t write_ms );
+
+/**
+ * @brief Cuts the bus after some more bytes
+ *
+ * From then on slaves neither acknowledge nor store anything, as after a
+ * power loss or with a dead slave.
+ *
+ * @param bytes[IN] - bytes the master may still write, -1 restores the bus
+ */
+void rtc_hal_fake_cut( int32_t bytes );
+
+/**
+ * @brief NACKs the next address bytes, a glitch the retries recover from
+ *
+ * @param addresses[IN] - address bytes to NACK
+ */
+void rtc_hal_fake_nack( uint8_t addresses );
+
+/**
+ * @brief Bus clock hook for rtc_hal_set_clock, scales the simulated time
+ *
+ * Each call costs RTC_HAL_FAKE_CLOCK_US of simulated time, as the
+ * peripheral re-init on a target would.
+ *
+ * @param khz[IN] - clock in kHz
+ */
+void rtc_hal_fake_clock( uint16_t khz );
+
+/**
+ * @brief Counters since rtc_hal_fake_clear
+ */
+const rtc_hal_fake_stats_t *rtc_hal_fake_stats( void );
+
+/**
+ * @brief Wire log since rtc_hal_fake_clear
+ *
+ * @param count[OUT] - entries, at most RTC_HAL_FAKE_WIRE_SIZE are kept
+ *
+ * @return const uint16_t* - bytes and RTC_HAL_FAKE_x codes
+ */
+const uint16_t *rtc_hal_fake_wire( size_t *count );
+
+/*
+ * Bus primitives and delay used by rtc_hal.c
+ */
+void rtc_hal_fake_start( void );
+void rtc_hal_fake_stop( void );
+bool rtc_hal_fake_write( uint8_t data );
+uint8_t rtc_hal_fake_read( bool ack );
+void rtc_hal_fake_delay( uint16_t ms );
+#endif
 
 #ifdef __cplusplus
 } // extern "C"
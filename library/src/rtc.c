@@ -24,6 +24,22 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stddef.h>
+/*
+ * Vector kernels for the SoA calendar conversions on hosted builds, the
+ * widest instruction set the compiler targets is used
+ */
+#if !defined( RTC_CAL_NO_SIMD )
+#if defined( __AVX2__ )
+#define CAL_AVX2
+#include <immintrin.h>
+#elif defined( __SSE2__ )
+#define CAL_SSE2
+#include <emmintrin.h>
+#elif defined( __ARM_NEON )
+#define CAL_NEON
+#include <arm_neon.h>
+#endif
+#endif
 
 /******************************************************************************
 * Module Preprocessor Constants
@@ -77,6 +93,12 @@
   * @def RTC Slave Addresses
   */
 #define RTC_PCF8583_SLAVE           0x50
+#define RTC_PCF8583_HUNDREDTHS      0x01
+#define RTC_PCF8583_SECONDS         0x02
+#define RTC_PCF8583_TIME_BYTES      5
+#define RTC_PCF8583_STOP            ( 1 << 7 )  // control, stop counting
+#define RTC_PCF8583_RAM_START       0x10
+#define RTC_PCF8583_RAM_END         0xFF
 
 #define RTC2_DS1307_SLAVE           0x68
 #define RTC2_RAM_SIZE               56
@@ -84,18 +106,87 @@
 #define RTC2_RAM_END                0x3F
 
 #define RTC3_BQ32000_SLAVE          0x68
+#define RTC3_OF                     ( 1 << 7 )  // minutes, oscillator fail
 
 #define RTC6_MCP7941X_SLAVE         0x6F
-#define RTC6_MCP7941X_SRAM_SLAVE    0xDE
-#define RTC6_MCP7941X_EEPROM_SLAVE  0xAE
+#define RTC6_MCP7941X_SRAM_SLAVE    0x6F
+#define RTC6_MCP7941X_EEPROM_SLAVE  0x57
 #define RTC6_RAM_SIZE               64
 #define RTC6_RAM_START              0x20
 #define RTC6_RAM_END                0x5f
-#define RTC6_EEPROM_SIZE            128 * 8
+#define RTC6_EEPROM_SIZE            128     // 1 Kbit
 #define RTC6_EEPROM_START           0
 #define RTC6_EEPROM_END             RTC6_EEPROM_SIZE
 #define RTC6_EEPROM_PAGE_SIZE       8
+#define RTC6_EEPROM_WRITE_MS        5       // page write cycle, max
 #define RTC6_EEPROM_STATUS          0xFF
+#define RTC6_EEPROM_BP_MASK         0x0C    // BP1:BP0 in STATUS
+#define RTC6_EEPROM_BP_SHIFT        2
+#define RTC6_EEPROM_ID_ADDR         0xF0
+#define RTC6_EEPROM_ID_SIZE         8
+#define RTC6_EEUNLOCK               0x09    // on the RTCC slave
+#define RTC6_OSCTRIM_ADDR           0x08
+#define RTC6_OSCTRIM_SIGN           ( 1 << 7 )  // 1 adds clocks
+#define RTC6_CRSTRIM                ( 1 << 2 )  // control, coarse trim
+#define RTC6_TRIM_STEP              10.1725     // 2 clocks a minute, in 0.1ppm
+#define RTC6_COARSE_STEP            78125.0     // 2 clocks 128 times a second
+
+#define RTC_DS3231_SLAVE            0x68
+#define RTC_DS3231_ALARM1_ADDR      0x07
+#define RTC_DS3231_ALARM2_ADDR      0x0B
+#define RTC_DS3231_CONTROL          0x0E
+#define RTC_DS3231_STATUS           0x0F
+#define RTC_DS3231_AGING            0x10
+#define RTC_DS3231_TEMP_MSB         0x11
+#define RTC_DS3231_RAM_SIZE         236     // DS3232 only
+#define RTC_DS3231_RAM_START        0x14
+#define RTC_DS3231_RAM_END          0xFF
+
+#define RTC_DS3231_EOSC             ( 1 << 7 )  // control, active low
+#define RTC_DS3231_RS_MASK          0x18
+#define RTC_DS3231_INTCN            ( 1 << 2 )
+#define RTC_DS3231_A2IE             ( 1 << 1 )
+#define RTC_DS3231_A1IE             ( 1 << 0 )
+#define RTC_DS3231_OSF              ( 1 << 7 )  // status
+#define RTC_DS3231_EN32KHZ          ( 1 << 3 )
+#define RTC_DS3231_A2F              ( 1 << 1 )
+#define RTC_DS3231_A1F              ( 1 << 0 )
+#define RTC_DS3231_AXMX             ( 1 << 7 )  // alarm match disable bit
+#define RTC_DS3231_DYDT             ( 1 << 6 )
+
+#define RTC_PCF8583_ALARM_FLAG      ( 1 << 1 )
+#define RTC6_ALM0WKDAY_ADDR         0x0D
+#define RTC6_ALM1WKDAY_ADDR         0x14
+#define RTC6_ALMXIF                 ( 1 << 3 )
+#define RTC6_RTCWKDAY_ADDR          0x03
+#define RTC6_OSCRUN                 ( 1 << 5 )
+#define RTC6_PWRFAIL                ( 1 << 4 )
+#define RTC6_VBATEN                 ( 1 << 3 )
+#define RTC_OSC_POLL_MS             10
+#define RTC6_PWRDN_ADDR             0x18
+#define RTC6_PWR_STAMP_BYTES        4
+#define RTC6_OUTAGE_RECORD_SIZE     8
+
+/**
+  * @def Calibration record, kept at the top of the battery backed RAM
+  */
+#define RTC_CALIB_MAGIC             0xCA
+#define RTC_CALIB_RECORD_SIZE       8
+#define RTC_PCF8583_CALIB_ADDR      ( RTC_PCF8583_RAM_END - RTC_CALIB_RECORD_SIZE + 1 )
+#define RTC2_CALIB_ADDR             ( RTC2_RAM_END - RTC_CALIB_RECORD_SIZE + 1 )
+#define RTC6_CALIB_ADDR             ( RTC6_RAM_END - RTC_CALIB_RECORD_SIZE + 1 )
+
+/**
+  * @def PCF8583 year record, base year and last seen year bits
+  */
+#define RTC_PCF8583_YEAR_MAGIC      0x1E
+#define RTC_PCF8583_YEAR_SIZE       3
+#define RTC_PCF8583_YEAR_ADDR       ( RTC_PCF8583_CALIB_ADDR - RTC_PCF8583_YEAR_SIZE )
+#define RTC_PCF8583_YEAR_UNKNOWN    0xFF
+#define RTC_CALIB_DRIFT_MAX         32767
+
+#define TIMER_FREE                  0xFFFF
+#define RULE_MAX_DAYS               ( 366 * 8 + 1 )
 
 #define JULIAN_DAY_1970 2440588 // julian day calculation for jan 1 1970
 #define TIME_SEC_IN_MIN             60                     // seconds per minute
@@ -108,18 +199,149 @@
 #define BCD2BIN(val) ( ( ( val ) & 15 ) + ( ( val ) >> 4 ) * 10 )
 #define BIN2BCD(val) ( ( ( ( val ) / 10 ) << 4 ) + ( val ) % 10 )
 
+// one byte through the nibble tables, high nibble first
+#define CRC8_BYTE( crc, b )                                               \
+    crc = ( uint8_t )( crc << 4 ) ^ crc8_table[( crc >> 4 ) ^ ( ( b ) >> 4 )]; \
+    crc = ( uint8_t )( crc << 4 ) ^ crc8_table[( crc >> 4 ) ^ ( ( b ) & 0x0F )]
+#define CRC16_BYTE( crc, b )                                              \
+    crc = ( crc << 4 ) ^ crc16_table[( crc >> 12 ) ^ ( ( b ) >> 4 )];      \
+    crc = ( crc << 4 ) ^ crc16_table[( crc >> 12 ) ^ ( ( b ) & 0x0F )]
+
+// nested public calls run under a hold and keep the caller's tag
+#ifdef RTC_HAL_TRACE
+#define TRACE_OP( op )  rtc_hal_trace_op( op )
+#define TRACE_HOLD()    rtc_hal_trace_hold( true )
+#define TRACE_RELEASE() rtc_hal_trace_hold( false )
+#else
+#define TRACE_OP( op )
+#define TRACE_HOLD()
+#define TRACE_RELEASE()
+#endif
+
 /******************************************************************************
 * Module Typedefs
 *******************************************************************************/
+/**
+ * @struct Software timer slot
+ */
+typedef struct
+{
+    uint32_t       deadline;
+    rtc_timer_cb_t cb;
+    void           *arg;
+    uint16_t       pos;       // index in the heap, TIMER_FREE when unused
+} timer_slot_t;
+
+/**
+ * @struct Collects streamed bytes into the caller's chunk buffer
+ */
+typedef struct
+{
+    uint8_t        *buffer;
+    uint16_t       size;
+    uint16_t       fill;
+    uint16_t       flushed;   // bytes already passed to cb
+    rtc_chunk_cb_t cb;
+    void           *arg;
+} cursor_sink_t;
+
+/**
+ * @struct Copies a streamed record out and runs its CRC as bytes arrive
+ */
+typedef struct
+{
+    uint8_t  *dst;
+    uint8_t  size;
+    uint8_t  count;
+#ifdef RTC_RECORD_CRC8
+    uint8_t  crc;
+#else
+    uint16_t crc;
+#endif
+    uint8_t  stored[RTC_RECORD_CRC_SIZE];
+} record_sink_t;
 
 /******************************************************************************
 * Module Variable Definitions
 *******************************************************************************/
-static rtc_time_t current_local_time;
+static const uint8_t cal_month_days[2][13] =
+{
+    { 0, 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 },
+    { 0, 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 }
+};
+
+// 0 based day of the year the month starts on
+static const uint16_t cal_days_before[2][13] =
+{
+    { 0, 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334 },
+    { 0, 0, 31, 60, 91, 121, 152, 182, 213, 244, 274, 305, 335 }
+};
+
+// fastest bus clock in kHz, by rtc_type_t, none of the chips stretch SCL
+static const uint16_t bus_khz[] =
+{
+    100,    // PCF8583
+    100,    // DS1307
+    400,    // BQ32000
+    400,    // MCP7941X, the EEPROM slave as well, only at Vcc >= 2.5 V
+    400     // DS3231
+};
+
+static const uint8_t crc8_table[16] =
+{
+    0x00, 0x07, 0x0E, 0x09, 0x1C, 0x1B, 0x12, 0x15,
+    0x38, 0x3F, 0x36, 0x31, 0x24, 0x23, 0x2A, 0x2D
+};
+
+static const uint16_t crc16_table[16] =
+{
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+static rtc_time_t current_gmt_time;  // last time read from or written to the chip
+static uint16_t   bus_errors;     // failed transfers, only ever counts up
+static uint16_t   bus_errors_seen;
+static bool       gmt_time_cached;
 static rtc_type_t current_type;
 static int8_t     current_time_zone;
 static bool       dst_enabled;
 
+static bool       calib_loaded;
+static uint8_t    calib_samples;
+static uint32_t   calib_ref_first;
+static int32_t    calib_offset_first;
+static uint32_t   calib_ref_last;
+static int32_t    calib_offset_last;
+static int16_t    calib_drift;    // software correction, 0.1ppm
+static uint32_t   calib_epoch;    // start of the software correction window
+
+static bool       osc_pending;    // oscillator start not yet confirmed
+static uint16_t   osc_waited;     // ms spent polling for it so far
+
+static bool       pcf_year_loaded;
+static uint8_t    pcf_year_base;  // years since 2000, multiple of 4
+static uint8_t    pcf_year_bits;  // last year counter seen on the chip
+
+static bool       eeprom_status_loaded;
+static uint8_t    eeprom_status;  // copy of the EEPROM STATUS register
+static bool       unique_id_loaded;
+static uint8_t    unique_id[RTC6_EEPROM_ID_SIZE];
+
+static uint8_t    outage_log_addr;
+static uint8_t    outage_log_entries;   // 0 when logging is off
+static uint8_t    outage_log_next;      // slot the next record goes to
+
+static timer_slot_t timer_slots[RTC_TIMER_MAX];
+static uint16_t   timer_heap[RTC_TIMER_MAX];   // min-heap of slot indexes
+static uint16_t   timer_free[RTC_TIMER_MAX];   // stack of unused slots
+static uint16_t   timer_count;
+static uint16_t   timer_free_count;
+static bool       timer_ready;
+static bool       timer_in_service;
+static uint32_t   timer_armed;    // deadline in the hardware alarm, 0 if none
+static uint32_t   timer_shadow;   // software clock for chips without alarms
+
 
 /******************************************************************************
 * Function Prototypes
@@ -127,6 +349,41 @@ static bool       dst_enabled;
 static void get_dst( uint8_t year, rtc_time_t *start, rtc_time_t *end );
 static long time_date_to_epoch( rtc_time_t *ts );
 static void time_epoch_to_date( long e, rtc_time_t *ts );
+static void ds3231_set_alarm( rtc_alarm_t alarm, rtc_alarm_trigger_t trigger,
+                              rtc_time_t time );
+static int bus_read( uint8_t reg, void *data_out, size_t num_bytes );
+static int bus_write( uint8_t reg, void *data_in, size_t num_bytes );
+static int bus_read_batch( rtc_hal_read_t *reads, size_t count );
+static void bus_slave( uint8_t slave );
+static bool osc_check( void );
+static void osc_wait( void );
+static void pcf8583_decode( uint8_t *buffer, rtc_time_t *time );
+static uint8_t pcf8583_year( uint8_t bits );
+static void pcf8583_year_save( void );
+static uint8_t alarm_service( uint8_t mask );
+static void mcp7941x_decode_stamp( uint8_t *buffer, rtc_time_t *stamp );
+static uint32_t outage_stamp_key( rtc_time_t *stamp );
+static void outage_record_decode( uint8_t *record, uint32_t *down, uint32_t *up );
+static void timer_setup( void );
+static void timer_place( uint16_t pos, uint16_t slot );
+static void timer_sift_up( uint16_t pos );
+static void timer_sift_down( uint16_t pos );
+static void timer_remove( uint16_t pos );
+static uint16_t timer_run( uint32_t now );
+static uint16_t timer_arm( uint32_t now );
+static uint32_t rule_range( uint8_t first, uint8_t last, uint8_t step );
+static int8_t rule_next_bit( uint32_t mask, uint8_t from );
+static int8_t rule_next_minute( const rtc_rule_t *rule, uint8_t from );
+static int32_t rule_in_day( const rtc_rule_t *rule, uint32_t sod );
+static int stamp_pack( const rtc_stamp_t *stamp, uint8_t *buffer, uint8_t size );
+static int stamp_unpack( const uint8_t *buffer, rtc_stamp_t *stamp, uint8_t size );
+static int nv_read( uint8_t reg, void *data_out, size_t num_bytes );
+static int nv_write( uint8_t reg, void *data_in, size_t num_bytes );
+static int calib_record_addr( uint8_t *addr );
+static void calib_load( void );
+static void calib_save( uint8_t trim );
+static void cursor_sink( uint8_t data, void *arg );
+static void record_sink( uint8_t data, void *arg );
 /******************************************************************************
 * Function Definitions
 *******************************************************************************/
@@ -283,48 +540,210 @@ static long time_date_to_epoch( rtc_time_t *ts )
 }
 
 
+/*
+ * Every transfer goes through these, a caller snapshots bus_errors and
+ * compares after its transfers instead of checking each one
+ */
+static int bus_read( uint8_t reg, void *data_out, size_t num_bytes )
+{
+    if( rtc_hal_read( reg, data_out, num_bytes ) )
+    {
+        bus_errors++;
+        return -1;
+    }
+
+    return 0;
+}
+
+static int bus_write( uint8_t reg, void *data_in, size_t num_bytes )
+{
+    if( rtc_hal_write( reg, data_in, num_bytes ) )
+    {
+        bus_errors++;
+        return -1;
+    }
+
+    return 0;
+}
+
+static int bus_read_batch( rtc_hal_read_t *reads, size_t count )
+{
+    if( rtc_hal_read_batch( reads, count ) )
+    {
+        bus_errors++;
+        return -1;
+    }
+
+    return 0;
+}
+
 /****************************************
  ********* RTC Settings *****************
  ***************************************/
 
-int rtc_init( rtc_type_t type, int8_t time_zone )
+/*
+ * The application may have run the bus at another speed for its own slaves
+ */
+static void bus_slave( uint8_t slave )
 {
-    uint8_t status;
+    rtc_hal_set_slave( slave );
+    rtc_hal_set_speed( bus_khz[current_type] );
+}
+
+/*
+ * Starts the oscillator only when it is stopped, each chip keeps its run
+ * control elsewhere and with a different polarity
+ */
+static int boot( rtc_type_t type, int8_t time_zone, rtc_boot_status_t *status,
+                 bool wait )
+{
+    uint8_t block[RTC_TIMEDATE_BYTES + 1];
+    uint16_t errors = bus_errors;
+
+    TRACE_OP( RTC_OP_INIT );
 
-    if( type > RTC6_MCP7941X || time_zone > 14 || time_zone < -12 )
+    if( type > RTC_DS3231 || time_zone > 14 || time_zone < -12 )
         return -1;
     current_type = type;
     current_time_zone = time_zone;
+    gmt_time_cached = false;
+    calib_loaded = false;
+    calib_samples = 0;
+    outage_log_entries = 0;
+    pcf_year_loaded = false;
+    eeprom_status_loaded = false;
+    unique_id_loaded = false;
+    osc_pending = false;
+    osc_waited = 0;
+
+    memset( status, 0, sizeof( rtc_boot_status_t ) );
+    status->battery_enabled = true;
+    rtc_hal_set_speed( bus_khz[type] );
 
     switch( current_type )
     {
         case RTC_PCF8583:
             rtc_hal_init ( RTC_PCF8583_SLAVE );
+            bus_read( 0x00, block, 1 );
+            if( block[0] & RTC_PCF8583_STOP )
+            {
+                block[0] &= ~RTC_PCF8583_STOP;
+                bus_write( 0x00, block, 1 );
+                status->osc_started = true;
+            }
             break;
         case RTC2_DS1307:
             rtc_hal_init ( RTC2_DS1307_SLAVE );
+            bus_read( RTC_SECONDS_ADDR, block, 1 );
+            if( block[0] & RTC_START_OSC_MASK )     // clock halt
+            {
+                block[0] &= ~RTC_START_OSC_MASK;
+                bus_write( RTC_SECONDS_ADDR, block, 1 );
+                status->osc_started = true;
+            }
             break;
         case RTC3_BQ32000:
             rtc_hal_init( RTC3_BQ32000_SLAVE );
+            bus_read( RTC_SECONDS_ADDR, block, 2 );
+            if( block[0] & RTC_START_OSC_MASK )     // stop
+            {
+                block[0] &= ~RTC_START_OSC_MASK;
+                bus_write( RTC_SECONDS_ADDR, block, 1 );
+                status->osc_started = true;
+            }
+            status->osc_failed = ( block[1] & RTC3_OF ) ? true : false;
             break;
         case RTC6_MCP7941X:
             rtc_hal_init( RTC6_MCP7941X_SLAVE );
+            // time registers and CONTROL, 0x00 to 0x07
+            bus_read( RTC_SECONDS_ADDR, block, sizeof( block ) );
+            if( !( block[RTC_SECONDS_BYTE] & RTC_START_OSC_MASK ) )
+            {
+                block[RTC_SECONDS_BYTE] |= RTC_START_OSC_MASK;
+                bus_write( RTC_SECONDS_ADDR, block, 1 );
+                status->osc_started = true;
+            }
+            status->power_failed = ( block[RTC_DAY_BYTE] & RTC6_PWRFAIL ) ? true : false;
+            status->battery_enabled = ( block[RTC_DAY_BYTE] & RTC6_VBATEN ) ? true : false;
+            osc_pending = ( block[RTC_DAY_BYTE] & RTC6_OSCRUN ) ? false : true;
+            break;
+        case RTC_DS3231:
+            rtc_hal_init( RTC_DS3231_SLAVE );
+            // Oscillator enable lives in the control register, EOSC is active low
+            bus_read( RTC_DS3231_CONTROL, block, 2 );
+            if( block[0] & RTC_DS3231_EOSC )
+            {
+                block[0] &= ~RTC_DS3231_EOSC;
+                bus_write( RTC_DS3231_CONTROL, block, 1 );
+                status->osc_started = true;
+            }
+            status->osc_failed = ( block[1] & RTC_DS3231_OSF ) ? true : false;
             break;
         default:
             return -1;
     }
 
-    rtc_hal_read( RTC_SECONDS_ADDR, ( void * )&status, 1 );
-    status |= RTC_START_OSC_MASK;
-    rtc_hal_write( RTC_SECONDS_ADDR, ( void * )&status, 1 );
+    if( wait )
+        osc_wait();
+
+    status->osc_running = !osc_pending;
+    status->time_valid = status->osc_running && !status->osc_started &&
+                         !status->osc_failed && bus_errors == errors;
+
+    return ( bus_errors != errors || ( wait && osc_pending ) ) ? -1 : 0;
+}
+
+/*
+ * MCP7941X sets OSCRUN once the crystal is stable, other chips have
+ * nothing to wait for
+ */
+static bool osc_check()
+{
+    uint8_t wkday;
+
+    if( osc_pending )
+    {
+        if( !bus_read( RTC6_RTCWKDAY_ADDR, &wkday, 1 ) &&
+            ( wkday & RTC6_OSCRUN ) )
+            osc_pending = false;
+    }
+
+    return !osc_pending;
+}
 
-    if( ( !status ) & 0x80 )
+/*
+ * Blocks for whatever is left of RTC_OSC_TIMEOUT_MS, shared with earlier
+ * calls so a slow crystal is only waited for once
+ */
+static void osc_wait()
+{
+    while( !osc_check() && osc_waited < RTC_OSC_TIMEOUT_MS )
     {
-        status |= RTC_START_OSC_MASK;
-        rtc_hal_write( RTC_SECONDS_ADDR, ( void * )&status, 1 );
+        rtc_hal_delay( RTC_OSC_POLL_MS );
+        osc_waited += RTC_OSC_POLL_MS;
     }
+}
 
-    return 0;
+int rtc_init( rtc_type_t type, int8_t time_zone )
+{
+    rtc_boot_status_t status;
+
+    return boot( type, time_zone, &status, false );
+}
+
+bool rtc_is_ready()
+{
+    TRACE_OP( RTC_OP_INIT );
+
+    return osc_check();
+}
+
+int rtc_init_boot( rtc_type_t type, int8_t time_zone,
+                   rtc_boot_status_t *status )
+{
+    rtc_boot_status_t temp;
+
+    return boot( type, time_zone, status ? status : &temp, true );
 }
 
 void rtc_enable_dst()
@@ -339,6 +758,8 @@ void rtc_disable_dst()
 
 void rtc_enable_swo( rtc_swo_t swo )
 {
+    TRACE_OP( RTC_OP_CONFIG );
+
     switch( current_type )
     {
         case RTC_PCF8583:
@@ -347,7 +768,7 @@ void rtc_enable_swo( rtc_swo_t swo )
         case RTC2_DS1307:
         {
             uint8_t temp;
-            rtc_hal_read( 0x07, &temp, 1 );
+            bus_read( 0x07, &temp, 1 );
             temp |= ( 1 << 4 );
             switch ( swo )
             {
@@ -367,13 +788,13 @@ void rtc_enable_swo( rtc_swo_t swo )
                 default:
                     break;
             }
-            rtc_hal_write( 0x07, &temp, 1 );
+            bus_write( 0x07, &temp, 1 );
             break;
         }
         case RTC6_MCP7941X:
         {
             uint8_t temp;
-            rtc_hal_read( 0x07, &temp, 1 );
+            bus_read( 0x07, &temp, 1 );
             temp |= ( 1 << 6 );
 
             switch( swo )
@@ -396,7 +817,37 @@ void rtc_enable_swo( rtc_swo_t swo )
                 default:
                     break;
             }
-            rtc_hal_write( 0x07, &temp, 1 );
+            bus_write( 0x07, &temp, 1 );
+            break;
+        }
+        case RTC_DS3231:
+        {
+            uint8_t temp;
+
+            if( swo == RTC_32_768KHZ )
+            {
+                bus_read( RTC_DS3231_STATUS, &temp, 1 );
+                temp |= RTC_DS3231_EN32KHZ;
+                bus_write( RTC_DS3231_STATUS, &temp, 1 );
+                break;
+            }
+
+            // SQW shares the pin with the alarm interrupt, INTCN selects SQW
+            bus_read( RTC_DS3231_CONTROL, &temp, 1 );
+            temp &= ~( RTC_DS3231_INTCN | RTC_DS3231_RS_MASK );
+
+            switch( swo )
+            {
+                case RTC_4_096KHZ:
+                    temp |= ( 1 << 4 );
+                    break;
+                case RTC_8_192KHZ:
+                    temp |= RTC_DS3231_RS_MASK;
+                    break;
+                default:
+                    break;
+            }
+            bus_write( RTC_DS3231_CONTROL, &temp, 1 );
             break;
         }
     }
@@ -405,20 +856,31 @@ void rtc_enable_swo( rtc_swo_t swo )
 void rtc_disable_swo()
 {
     uint8_t temp;
+
+    TRACE_OP( RTC_OP_CONFIG );
+
     switch( current_type )
     {
         case RTC_PCF8583:
             // SWO is always on, 1 Hz, 50% duty cycle
             break;
         case RTC2_DS1307:
-            rtc_hal_read( 0x07, &temp, 1 );
+            bus_read( 0x07, &temp, 1 );
             temp &= ~( 1 << 7 );
-            rtc_hal_write( 0x07, &temp, 1 );
+            bus_write( 0x07, &temp, 1 );
             break;
         case RTC6_MCP7941X:
-            rtc_hal_read( 0x07, &temp, 1 );
+            bus_read( 0x07, &temp, 1 );
             temp &= ~( 1 << 6 );
-            rtc_hal_write( 0x07, &temp, 1 );
+            bus_write( 0x07, &temp, 1 );
+            break;
+        case RTC_DS3231:
+            bus_read( RTC_DS3231_CONTROL, &temp, 1 );
+            temp |= RTC_DS3231_INTCN;
+            bus_write( RTC_DS3231_CONTROL, &temp, 1 );
+            bus_read( RTC_DS3231_STATUS, &temp, 1 );
+            temp &= ~RTC_DS3231_EN32KHZ;
+            bus_write( RTC_DS3231_STATUS, &temp, 1 );
             break;
     }
 }
@@ -427,12 +889,14 @@ void rtc_battery_enable()
 {
     uint8_t temp = 0;
 
+    TRACE_OP( RTC_OP_CONFIG );
+
     switch( current_type )
     {
         case RTC6_MCP7941X:
-            rtc_hal_read( 0x03, &temp, 1 );
+            bus_read( 0x03, &temp, 1 );
             temp |= ( 1 << 3 );
-            rtc_hal_write( 0x03, &temp, 1 );
+            bus_write( 0x03, &temp, 1 );
             break;
     }
 }
@@ -447,25 +911,29 @@ rtc_time_t *rtc_get_gmt_time()
 {
     static rtc_time_t gmt_time;
     uint8_t buffer[RTC_TIMEDATE_BYTES];
+    uint16_t errors;
+
+    TRACE_OP( RTC_OP_GET_TIME );
+
+    if( osc_pending )
+        osc_wait();
+
+    errors = bus_errors;
 
     memset( buffer, 0, sizeof( buffer ) );
 
     switch ( current_type )
     {
         case RTC_PCF8583:
-#define PCF_SECONDS 0x02
-            rtc_hal_read( PCF_SECONDS, buffer, 5 );
-            gmt_time.seconds = BCD2BIN( buffer[RTC_SECONDS_BYTE] );
-            gmt_time.minutes = BCD2BIN( buffer[RTC_MINUTES_BYTE] );
-            gmt_time.hours = BCD2BIN( RTC_HOURS_MASK( buffer[RTC_HOUR_BYTE] ) );
-            gmt_time.weekday = ( buffer[RTC_DATE_BYTE] >> 5 ) + 1;
-            gmt_time.monthday =  BCD2BIN( RTC_DATE_MASK( buffer[RTC_DAY_BYTE] ) );
-            gmt_time.month = BCD2BIN( RTC_MONTH_MASK( buffer[RTC_DATE_BYTE] ) );
-            gmt_time.year = 0;
+            if( bus_read( RTC_PCF8583_SECONDS, buffer, RTC_PCF8583_TIME_BYTES ) )
+                return NULL;
+            pcf8583_decode( buffer, &gmt_time );
             break;
         case RTC3_BQ32000:
         case RTC2_DS1307:
-            rtc_hal_read( RTC_SECONDS_ADDR, buffer, RTC_TIMEDATE_BYTES );
+        case RTC_DS3231:
+            if( bus_read( RTC_SECONDS_ADDR, buffer, RTC_TIMEDATE_BYTES ) )
+                return NULL;
             gmt_time.seconds = BCD2BIN( RTC_SECONDS_MASK( buffer[RTC_SECONDS_BYTE] ) );
             gmt_time.minutes = BCD2BIN( RTC_MINUTES_MASK( buffer[RTC_MINUTES_BYTE] ) );
             gmt_time.hours = BCD2BIN( RTC_HOURS_MASK( buffer[RTC_HOUR_BYTE] ) );
@@ -475,7 +943,8 @@ rtc_time_t *rtc_get_gmt_time()
             gmt_time.year = BCD2BIN( RTC_YEAR_MASK( buffer[RTC_YEAR_BYTE] ) );
             break;
         case RTC6_MCP7941X:
-            rtc_hal_read( RTC_SECONDS_ADDR, buffer, RTC_TIMEDATE_BYTES );
+            if( bus_read( RTC_SECONDS_ADDR, buffer, RTC_TIMEDATE_BYTES ) )
+                return NULL;
             gmt_time.seconds = BCD2BIN( RTC_SECONDS_MASK( buffer[RTC_SECONDS_BYTE] ) );
             gmt_time.minutes = BCD2BIN( RTC_MINUTES_MASK( buffer[RTC_MINUTES_BYTE] ) );
             gmt_time.hours = BCD2BIN( RTC_HOURS_MASK( buffer[RTC_HOUR_BYTE] ) );
@@ -487,10 +956,80 @@ rtc_time_t *rtc_get_gmt_time()
 
     }
 
+    // PCF8583 year record, no half read time leaves here
+    if( bus_errors != errors )
+        return NULL;
+
+    current_gmt_time = gmt_time;
+    gmt_time_cached = true;
+
     return &gmt_time;
 }
 
 
+/*
+ * PCF8583 packs year with the date and weekday with the month,
+ * buffer starts at the seconds register
+ */
+static void pcf8583_decode( uint8_t *buffer, rtc_time_t *time )
+{
+    time->seconds = BCD2BIN( buffer[RTC_SECONDS_BYTE] );
+    time->minutes = BCD2BIN( buffer[RTC_MINUTES_BYTE] );
+    time->hours = BCD2BIN( RTC_HOURS_MASK( buffer[RTC_HOUR_BYTE] ) );
+    time->weekday = ( buffer[RTC_DATE_BYTE] >> 5 ) + 1;
+    time->monthday =  BCD2BIN( RTC_DATE_MASK( buffer[RTC_DAY_BYTE] ) );
+    time->month = BCD2BIN( RTC_MONTH_MASK( buffer[RTC_DATE_BYTE] ) );
+    time->year = pcf8583_year( buffer[RTC_DAY_BYTE] >> 6 );
+}
+
+/*
+ * The PCF8583 only counts years modulo 4, the base year lives in its RAM.
+ * The record is read once and only written back when the counter moves,
+ * a wrap from 3 to 0 advances the base. Outages longer than 4 years on
+ * battery can not be detected.
+ */
+static uint8_t pcf8583_year( uint8_t bits )
+{
+    if( !pcf_year_loaded )
+    {
+        uint8_t record[RTC_PCF8583_YEAR_SIZE];
+
+        if( nv_read( RTC_PCF8583_YEAR_ADDR, record, RTC_PCF8583_YEAR_SIZE ) )
+            return bits;
+        pcf_year_base = 0;
+        pcf_year_bits = RTC_PCF8583_YEAR_UNKNOWN;
+
+        if( record[0] == RTC_PCF8583_YEAR_MAGIC && record[1] <= 96 )
+        {
+            pcf_year_base = record[1];
+            pcf_year_bits = record[2];
+        }
+        pcf_year_loaded = true;
+    }
+
+    if( bits != pcf_year_bits )
+    {
+        if( pcf_year_bits != RTC_PCF8583_YEAR_UNKNOWN && bits < pcf_year_bits )
+            pcf_year_base += 4;
+
+        pcf_year_bits = bits;
+        pcf8583_year_save();
+    }
+
+    return pcf_year_base + bits;
+}
+
+static void pcf8583_year_save()
+{
+    uint8_t record[RTC_PCF8583_YEAR_SIZE];
+
+    record[0] = RTC_PCF8583_YEAR_MAGIC;
+    record[1] = pcf_year_base;
+    record[2] = pcf_year_bits;
+    nv_write( RTC_PCF8583_YEAR_ADDR, record, RTC_PCF8583_YEAR_SIZE );
+}
+
+
 
 rtc_time_t *rtc_get_local_time()
 {
@@ -498,6 +1037,9 @@ rtc_time_t *rtc_get_local_time()
 
     uint32_t temp_time_unix = rtc_get_gmt_unix_time();
 
+    if( !temp_time_unix )
+        return NULL;
+
     temp_time_unix += ( current_time_zone * 60 *
                         60 ); // for now withouts miliseconds
     // TODO: Convert unix time to date, return address of local_time. DONE: check below
@@ -558,7 +1100,10 @@ int rtc_set_gmt_time( rtc_time_t time )
 {
     uint8_t buffer[RTC_TIMEDATE_BYTES];
     uint8_t temp;
-    
+    uint16_t errors = bus_errors;
+
+    TRACE_OP( RTC_OP_SET_TIME );
+
     if( time.seconds > 59 ||
             time.minutes > 59 ||
             time.hours > 24 ||
@@ -573,33 +1118,40 @@ int rtc_set_gmt_time( rtc_time_t time )
         case RTC_PCF8583:
         {
             temp = 0x80;
-            rtc_hal_write( 0, &temp, 1 );
+            bus_write( 0, &temp, 1 );
             temp = BIN2BCD ( time.seconds );
-            rtc_hal_write( 0x02, &temp , 1 );
-            rtc_hal_read( 0x02, &temp , 1 );
+            bus_write( 0x02, &temp , 1 );
+            bus_read( 0x02, &temp , 1 );
             temp = BIN2BCD ( time.minutes );
-            rtc_hal_write( 0x03, &temp , 1 );
-            rtc_hal_read( 0x03, &temp , 1 );
+            bus_write( 0x03, &temp , 1 );
+            bus_read( 0x03, &temp , 1 );
             temp = 0;
             temp = BIN2BCD ( time.hours );
-            rtc_hal_write( 0x04, &temp , 1 );
-            rtc_hal_read( 0x04, &temp , 1 );
+            bus_write( 0x04, &temp , 1 );
+            bus_read( 0x04, &temp , 1 );
             temp = 0;
             temp = BIN2BCD ( time.monthday );
-            rtc_hal_write( 0x05, &temp , 1 );
-            rtc_hal_read( 0x05, &temp , 1 );
+            temp |= ( time.year % 4 ) << 6;
+            bus_write( 0x05, &temp , 1 );
+            bus_read( 0x05, &temp , 1 );
             temp = 0;
             temp = BIN2BCD( time.month );
             temp |= ( time.weekday - 1 ) << 5;
-            rtc_hal_write( 0x06, &temp , 1 );
-            rtc_hal_read( 0x06, &temp , 1 );
+            bus_write( 0x06, &temp , 1 );
+            bus_read( 0x06, &temp , 1 );
             temp = 0;
-            rtc_hal_write( 0, &temp, 1 );
+            bus_write( 0, &temp, 1 );
+
+            // base is kept aligned to leap years, like the chip counter
+            pcf_year_base = time.year - ( time.year % 4 );
+            pcf_year_bits = time.year % 4;
+            pcf_year_loaded = true;
+            pcf8583_year_save();
             break;
         }
 
         case RTC3_BQ32000:
-            rtc_hal_read( RTC_SECONDS_ADDR, &buffer, RTC_TIMEDATE_BYTES );
+            bus_read( RTC_SECONDS_ADDR, &buffer, RTC_TIMEDATE_BYTES );
             // Set seconds
             buffer[RTC_SECONDS_BYTE] = RTC_SECONDS_CLEAR( buffer[RTC_SECONDS_BYTE] );
             buffer[RTC_SECONDS_BYTE] |= BIN2BCD( time.seconds );
@@ -622,13 +1174,13 @@ int rtc_set_gmt_time( rtc_time_t time )
             buffer[RTC_YEAR_BYTE] = RTC_YEAR_CLEAR( buffer[RTC_YEAR_BYTE] );
             buffer[RTC_YEAR_BYTE] |= BIN2BCD( time.year );
 
-            rtc_hal_write( RTC_SECONDS_ADDR, buffer, RTC_TIMEDATE_BYTES );
-            rtc_hal_read( RTC_SECONDS_ADDR, &buffer, RTC_TIMEDATE_BYTES );
+            bus_write( RTC_SECONDS_ADDR, buffer, RTC_TIMEDATE_BYTES );
+            bus_read( RTC_SECONDS_ADDR, &buffer, RTC_TIMEDATE_BYTES );
             break;
 
         default:
 
-            rtc_hal_read( RTC_SECONDS_ADDR, &buffer, RTC_TIMEDATE_BYTES );
+            bus_read( RTC_SECONDS_ADDR, &buffer, RTC_TIMEDATE_BYTES );
             // Set seconds
             buffer[RTC_SECONDS_BYTE] = RTC_SECONDS_CLEAR( buffer[RTC_SECONDS_BYTE] );
             buffer[RTC_SECONDS_BYTE] |= BIN2BCD( time.seconds );
@@ -651,12 +1203,29 @@ int rtc_set_gmt_time( rtc_time_t time )
             buffer[RTC_YEAR_BYTE] = RTC_YEAR_CLEAR( buffer[RTC_YEAR_BYTE] );
             buffer[RTC_YEAR_BYTE] |= BIN2BCD( time.year );
 
-            rtc_hal_write( RTC_SECONDS_ADDR, buffer, RTC_TIMEDATE_BYTES );
-            rtc_hal_read( RTC_SECONDS_ADDR, buffer, RTC_TIMEDATE_BYTES );
+            bus_write( RTC_SECONDS_ADDR, buffer, RTC_TIMEDATE_BYTES );
+            bus_read( RTC_SECONDS_ADDR, buffer, RTC_TIMEDATE_BYTES );
             break;
 
     }
 
+    // the time is good again, drop the oscillator stop flag
+    if( current_type == RTC_DS3231 )
+    {
+        bus_read( RTC_DS3231_STATUS, &temp, 1 );
+        temp &= ~RTC_DS3231_OSF;
+        bus_write( RTC_DS3231_STATUS, &temp, 1 );
+    }
+
+    if( bus_errors != errors )
+    {
+        gmt_time_cached = false;
+        return -1;
+    }
+
+    current_gmt_time = time;
+    gmt_time_cached = true;
+
     return 0;
 }
 
@@ -667,6 +1236,9 @@ uint32_t rtc_get_gmt_unix_time()
     uint32_t temp;
     temp_time = rtc_get_gmt_time();
 
+    if( temp_time == NULL )
+        return 0;
+
     temp =  time_date_to_epoch( temp_time );
 
     return temp;
@@ -678,58 +1250,99 @@ uint32_t rtc_get_local_unix_time()
     uint32_t temp;
     rtc_time_t *temp_time = rtc_get_local_time();
 
+    if( temp_time == NULL )
+        return 0;
+
     temp =  time_date_to_epoch( temp_time );
     return temp;
 }
 
-bool rtc_is_leap_year()
+uint16_t rtc_get_bus_khz( rtc_type_t type )
 {
-    switch( current_type )
-    {
-        case RTC_PCF8583:
-            // NOT SUPPORTED
-            return false;
-            break;
+    if( type > RTC_DS3231 )
+        return 0;
 
-        case RTC2_DS1307:
-            if ( current_local_time.year % 4 != 0 )
-                return false;
-            else if ( current_local_time.year % 100 != 0 )
-                return true;
-            else if ( current_local_time.year % 400 == 0 )
-                return true;
-            else return false;
-            break;
+    return bus_khz[type];
+}
 
-        case RTC3_BQ32000:
-            if ( current_local_time.year % 4 != 0 )
-                return false;
-            else if ( current_local_time.year % 100 != 0 )
-                return true;
-            else if ( current_local_time.year % 400 == 0 )
-                return true;
-            else return false;
-            break;
+int rtc_get_error()
+{
+    uint16_t errors = bus_errors;
 
-        case RTC6_MCP7941X:
-        {
-            uint8_t temp;
-            rtc_hal_read( 0x05, &temp, 1 );
-            temp &= 0b00100000;
-            if ( temp  == 0 )
-                return false;
-            else return true;
-            break;
-        }
+    if( errors == bus_errors_seen )
+        return 0;
+
+    bus_errors_seen = errors;
+    return -1;
+}
+
+int rtc_get_stamp( rtc_stamp_t *stamp )
+{
+    uint8_t buffer[RTC_PCF8583_TIME_BYTES + 1];
+    rtc_time_t time;
+    uint16_t errors = bus_errors;
+
+    TRACE_OP( RTC_OP_GET_TIME );
+
+    if( stamp == NULL )
+        return -1;
+
+    if( current_type == RTC_PCF8583 )
+    {
+        if( bus_read( RTC_PCF8583_HUNDREDTHS, buffer, sizeof( buffer ) ) )
+            return -1;
+        pcf8583_decode( &buffer[1], &time );
+        if( bus_errors != errors )
+            return -1;
+        current_gmt_time = time;
+        gmt_time_cached = true;
+        stamp->hundredths = BCD2BIN( buffer[0] );
+        stamp->epoch = time_date_to_epoch( &time );
+    } else {
+        stamp->hundredths = 0;
+        stamp->epoch = rtc_get_gmt_unix_time();
+        if( !stamp->epoch )
+            return -1;
     }
 
-    return false;
+    return 0;
+}
+
+int32_t rtc_stamp_diff( rtc_stamp_t *start, rtc_stamp_t *end )
+{
+    int32_t diff = ( int32_t )( end->epoch - start->epoch ) * 100;
+
+    diff += ( int32_t )end->hundredths - start->hundredths;
+    return diff;
+}
+
+uint32_t rtc_get_cached_unix_time()
+{
+    rtc_time_t temp_time;
+
+    if( !gmt_time_cached && rtc_get_gmt_time() == NULL )
+        return 0;
+
+    // time_date_to_epoch() rewrites the weekday, work on a copy
+    temp_time = current_gmt_time;
+    return time_date_to_epoch( &temp_time );
+}
+
+bool rtc_is_leap_year()
+{
+    if( !gmt_time_cached )
+        rtc_get_gmt_time();
+
+    return rtc_cal_is_leap( 2000 + current_gmt_time.year );
 }
 
 
 bool rtc_is_power_failure()
 {
     uint8_t temp;
+
+    TRACE_OP( RTC_OP_POWER );
+
     switch( current_type )
     {
         case RTC_PCF8583:
@@ -742,18 +1355,23 @@ bool rtc_is_power_failure()
             break;
         case RTC3_BQ32000:
 
-            rtc_hal_read( 0x01, &temp, 1 );
+            bus_read( 0x01, &temp, 1 );
             temp &= ( 1 << 7 );
             if ( temp == 0 ) return false;
             else return true;
             break;
 
         case RTC6_MCP7941X:
-            rtc_hal_read( 0x03, &temp, 1 );
+            bus_read( 0x03, &temp, 1 );
             temp &= ( 1 << 4 );
             if ( temp == 0 ) return false;
             else return true;
             break;
+
+        case RTC_DS3231:
+            // Oscillator stop flag, set whenever the oscillator halted
+            bus_read( RTC_DS3231_STATUS, &temp, 1 );
+            return ( temp & RTC_DS3231_OSF ) ? true : false;
     }
 
     return false;
@@ -764,6 +1382,8 @@ rtc_time_t *rtc_get_last_power_failure()
 {
     static rtc_time_t stamp = {0};
 
+    TRACE_OP( RTC_OP_POWER );
+
     switch( current_type )
     {
         case RTC_PCF8583:
@@ -775,18 +1395,15 @@ rtc_time_t *rtc_get_last_power_failure()
             return &stamp;
             break;
         case RTC3_BQ32000:
+        case RTC_DS3231:
             return &stamp;
             break;
         case RTC6_MCP7941X:
         {
-            uint8_t buffer[4];
+            uint8_t buffer[RTC6_PWR_STAMP_BYTES];
 
-            rtc_hal_read( 0x18, &buffer, 4 );
-            stamp.minutes  = BCD2BIN( RTC_MINUTES_MASK( buffer[0] ) );
-            stamp.hours    = BCD2BIN( RTC_HOURS_MASK( buffer[1] ) );
-            stamp.monthday = BCD2BIN( RTC_DATE_MASK( buffer[2] ) );
-            stamp.weekday  = BCD2BIN ( ( buffer[3] & 0b11100000 ) );
-            stamp.month    = BCD2BIN( ( buffer[3] & 0b00011111 ) );
+            bus_read( RTC6_PWRDN_ADDR, &buffer, RTC6_PWR_STAMP_BYTES );
+            mcp7941x_decode_stamp( buffer, &stamp );
 
             return &stamp;
             break;
@@ -796,493 +1413,2709 @@ rtc_time_t *rtc_get_last_power_failure()
     return 0;
 }
 
-/****************************************
- ********* Alarms ***********************
- ***************************************/
+/*
+ * Power fail stamps hold minutes, hours, date and weekday / month,
+ * the weekday sits in the top 3 bits of the month register
+ */
+static void mcp7941x_decode_stamp( uint8_t *buffer, rtc_time_t *stamp )
+{
+    stamp->seconds  = 0;
+    stamp->minutes  = BCD2BIN( RTC_MINUTES_MASK( buffer[0] ) );
+    stamp->hours    = BCD2BIN( RTC_HOURS_MASK( buffer[1] ) );
+    stamp->monthday = BCD2BIN( RTC_DATE_MASK( buffer[2] ) );
+    stamp->weekday  = buffer[3] >> 5;
+    stamp->month    = BCD2BIN( RTC_MONTH_MASK( buffer[3] ) );
+}
 
-void rtc_set_alarm( rtc_alarm_t alarm, rtc_alarm_trigger_t trigger,
-                    rtc_time_t time )
+/*
+ * Orders stamps within a year, used to infer the year they belong to
+ */
+static uint32_t outage_stamp_key( rtc_time_t *stamp )
 {
-    uint8_t buffer[6];
-    uint8_t temp;
+    return ( ( uint32_t )stamp->month << 24 ) | ( ( uint32_t )stamp->monthday << 16 ) |
+           ( ( uint16_t )stamp->hours << 8 ) | stamp->minutes;
+}
 
-    if ( current_type == RTC_PCF8583 )
-    {
-        rtc_hal_read( 0, &temp, 1 );
-        temp |= ( 1 << 2 );
-        rtc_hal_write( 0, &temp, 1 );
+static void outage_record_decode( uint8_t *record, uint32_t *down, uint32_t *up )
+{
+    *down = ( uint32_t )record[0] | ( ( uint32_t )record[1] << 8 ) |
+            ( ( uint32_t )record[2] << 16 ) | ( ( uint32_t )record[3] << 24 );
+    *up   = ( uint32_t )record[4] | ( ( uint32_t )record[5] << 8 ) |
+            ( ( uint32_t )record[6] << 16 ) | ( ( uint32_t )record[7] << 24 );
+}
 
-        buffer[0] = time.seconds;
-        buffer[1] = time.minutes;
-        buffer[2] = time.hours;
-        buffer[3] = time.monthday; // date
-        buffer[4] = time.month;
+int rtc_get_outage( rtc_outage_t *outage )
+{
+    uint8_t buffer[RTC_TIMEDATE_BYTES];
+    uint8_t stamps[RTC6_PWR_STAMP_BYTES * 2];
+    rtc_hal_read_t reads[2];
+    rtc_time_t now;
+    rtc_time_t temp_time;
+    uint32_t down_epoch;
+    uint32_t up_epoch;
 
-        rtc_hal_write( 0x10, buffer, 5 );
+    TRACE_OP( RTC_OP_POWER );
 
+    if( current_type != RTC6_MCP7941X || outage == NULL )
+        return -1;
 
-        rtc_hal_read( 8, &temp, 1 );
-        temp &= ~( 1 << 4 );
-        temp &= ~( 1 << 5 );
-        temp |= ( 1 << 7 );
+    if( bus_read( RTC_SECONDS_ADDR, buffer, RTC_TIMEDATE_BYTES ) )
+        return -1;
+    if( !( buffer[RTC_DAY_BYTE] & RTC6_PWRFAIL ) )
+        return 0;
+
+    // clearing PWRFAIL also clears the stamps, keep the window short
+    reads[0].address = RTC6_PWRDN_ADDR;
+    reads[0].data_out = stamps;
+    reads[0].num_bytes = sizeof( stamps );
+    reads[1].address = RTC6_RTCWKDAY_ADDR;
+    reads[1].data_out = &buffer[RTC_DAY_BYTE];
+    reads[1].num_bytes = 1;
+    if( bus_read_batch( reads, 2 ) )
+        return -1;
 
-        switch ( trigger )
+    now.month = BCD2BIN( RTC_MONTH_MASK( buffer[RTC_MONTH_BYTE] ) );
+    now.monthday = BCD2BIN( RTC_DATE_MASK( buffer[RTC_DATE_BYTE] ) );
+    now.hours = BCD2BIN( RTC_HOURS_MASK( buffer[RTC_HOUR_BYTE] ) );
+    now.minutes = BCD2BIN( RTC_MINUTES_MASK( buffer[RTC_MINUTES_BYTE] ) );
+    now.year = BCD2BIN( RTC_YEAR_MASK( buffer[RTC_YEAR_BYTE] ) );
+
+    mcp7941x_decode_stamp( stamps, &outage->power_down );
+    mcp7941x_decode_stamp( &stamps[RTC6_PWR_STAMP_BYTES], &outage->power_up );
+
+    // stamps carry no year, they are the latest ones before now
+    outage->power_up.year = now.year;
+    if( outage_stamp_key( &outage->power_up ) > outage_stamp_key( &now ) &&
+        now.year )
+        outage->power_up.year--;
+
+    outage->power_down.year = outage->power_up.year;
+    if( outage_stamp_key( &outage->power_down ) > outage_stamp_key( &outage->power_up ) &&
+        outage->power_up.year )
+        outage->power_down.year--;
+
+    // time_date_to_epoch() rewrites the weekday, work on copies
+    temp_time = outage->power_down;
+    down_epoch = time_date_to_epoch( &temp_time );
+    temp_time = outage->power_up;
+    up_epoch = time_date_to_epoch( &temp_time );
+    outage->duration = ( up_epoch > down_epoch ) ? up_epoch - down_epoch : 0;
+
+    // logged before PWRFAIL is cleared, a failed write is retried next call
+    if( outage_log_entries )
+    {
+        uint8_t record[RTC6_OUTAGE_RECORD_SIZE];
+        uint8_t i;
+        bool logged;
+
+        for( i = 0; i < 4; i++ )
         {
-            case RTC_ALARM_DAY:
-                temp |= ( 1 << 4 );
-                break;
-            case RTC_ALARM_WEEKDAY:
-                temp |= ( 1 << 5 );
-                break;
-            case RTC_ALARM_DATE:
-                temp |= ( 1 << 4 );
-                temp |= ( 1 << 5 );
-                break;
+            record[i] = ( down_epoch >> ( i * 8 ) ) & 0xFF;
+            record[i + 4] = ( up_epoch >> ( i * 8 ) ) & 0xFF;
         }
-        rtc_hal_write( 8, &temp, 1 );
+
+        TRACE_HOLD();
+        logged = rtc_write_eeprom( outage_log_addr + outage_log_next * RTC6_OUTAGE_RECORD_SIZE,
+                                   record, RTC6_OUTAGE_RECORD_SIZE );
+        TRACE_RELEASE();
+        if( !logged )
+            return -1;
+
+        if( ++outage_log_next >= outage_log_entries )
+            outage_log_next = 0;
     }
 
-    else if ( current_type == RTC6_MCP7941X )
+    // the log write may span a day rollover, clear on a fresh weekday
+    if( outage_log_entries &&
+        bus_read( RTC6_RTCWKDAY_ADDR, &buffer[RTC_DAY_BYTE], 1 ) )
+        return -1;
+    buffer[RTC_DAY_BYTE] &= ~RTC6_PWRFAIL;
+    if( bus_write( RTC6_RTCWKDAY_ADDR, &buffer[RTC_DAY_BYTE], 1 ) )
+        return -1;
+
+    return 1;
+}
+
+int rtc_outage_log_init( uint8_t addr, uint8_t entries )
+{
+    uint8_t record[RTC6_OUTAGE_RECORD_SIZE];
+    uint32_t down;
+    uint32_t up;
+    uint32_t newest = 0;
+    uint8_t i;
+    uint16_t errors = bus_errors;
+
+    TRACE_OP( RTC_OP_POWER );
+
+    if( current_type != RTC6_MCP7941X || entries == 0 ||
+        addr % RTC6_EEPROM_PAGE_SIZE ||
+        addr + ( uint16_t )entries * RTC6_OUTAGE_RECORD_SIZE > RTC6_EEPROM_END )
+        return -1;
+
+    outage_log_addr = addr;
+    outage_log_next = 0;
+
+    // erased records read back as all ones
+    for( i = 0; i < entries; i++ )
     {
-        switch ( alarm )
+        TRACE_HOLD();
+        rtc_read_eeprom( addr + i * RTC6_OUTAGE_RECORD_SIZE, record,
+                         RTC6_OUTAGE_RECORD_SIZE );
+        TRACE_RELEASE();
+        outage_record_decode( record, &down, &up );
+
+        if( up != 0xFFFFFFFFUL && up >= newest )
         {
-            case RTC_ALARM_0:
+            newest = up;
+            outage_log_next = ( i + 1 ) % entries;
+        }
+    }
 
-                rtc_hal_read( 0x0A, buffer, 6 );
-                // Set time values for the alarm
-                buffer[RTC_SECONDS_BYTE] = RTC_SECONDS_CLEAR( buffer[RTC_SECONDS_BYTE] );
-                buffer[RTC_SECONDS_BYTE] |= BIN2BCD( time.seconds );
+    if( bus_errors != errors )
+        return -1;
 
-                buffer[RTC_MINUTES_BYTE] = RTC_MINUTES_CLEAR( buffer[RTC_MINUTES_BYTE] );
-                buffer[RTC_MINUTES_BYTE] |= BIN2BCD( time.minutes );
+    outage_log_entries = entries;
+    return 0;
+}
 
-                buffer[RTC_HOUR_BYTE] = RTC_HOURS_CLEAR( buffer[RTC_HOUR_BYTE] );
-                buffer[RTC_HOUR_BYTE] |= BIN2BCD( time.hours );
+int rtc_outage_log_read( uint8_t index, uint32_t *down, uint32_t *up )
+{
+    uint8_t record[RTC6_OUTAGE_RECORD_SIZE];
+    uint8_t slot;
+    uint16_t errors = bus_errors;
 
-                buffer[RTC_DAY_BYTE] = RTC_DAY_CLEAR( buffer[RTC_DAY_BYTE] );
-                buffer[RTC_DAY_BYTE] |= BIN2BCD( time.weekday );
+    TRACE_OP( RTC_OP_POWER );
 
-                buffer[RTC_DATE_BYTE] = RTC_DATE_CLEAR( buffer[RTC_DATE_BYTE] );
-                buffer[RTC_DATE_BYTE] |= BIN2BCD( time.monthday );
+    if( outage_log_entries == 0 || index >= outage_log_entries )
+        return -1;
 
-                buffer[RTC_MONTH_BYTE] = RTC_MONTH_CLEAR( buffer[RTC_MONTH_BYTE] );
-                buffer[RTC_MONTH_BYTE] |= BIN2BCD( time.month );
+    slot = ( outage_log_next + outage_log_entries - 1 - index ) % outage_log_entries;
+    TRACE_HOLD();
+    rtc_read_eeprom( outage_log_addr + slot * RTC6_OUTAGE_RECORD_SIZE, record,
+                     RTC6_OUTAGE_RECORD_SIZE );
+    TRACE_RELEASE();
+    outage_record_decode( record, down, up );
 
-                rtc_hal_write( 0x0A, buffer, 6 );
+    return ( bus_errors != errors || *up == 0xFFFFFFFFUL ) ? -1 : 0;
+}
 
-                // set the trigger
-                rtc_hal_read( 0x0D, &temp, 1 );
-                switch ( trigger )
-                {
-                    case RTC_ALARM_SECONDS:
-                        temp &= ~( 0b01111000 );
-                        break;
-                    case RTC_ALARM_MINUTES:
-                        temp &= ~( 0b01111000 );
-                        temp |= ( 1 << 4 );
-                        break;
-                    case RTC_ALARM_HOURS:
-                        temp &= ~( 0b01111000 );
-                        temp |= ( 1 << 5 );
-                        break;
-                    case RTC_ALARM_DAY:
-                        temp &= ~( 0b01111000 );
-                        temp |= ( 1 << 4 );
-                        temp |= ( 1 << 5 );
-                        break;
-                    case RTC_ALARM_DATE:
-                        temp &= ~( 0b01111000 );
-                        temp |= ( 1 << 6 );
-                        break;
-                    case RTC_ALARM_SEC_MIN_HOUR_DAY_DATE_MONTH:
-                        temp &= ~( 0b01111000 );
-                        temp |=  ( 0b01110000 );
-                    default:
-                        break;
-                }
-                temp |= ( 1 << 7 ); // set the polarity to one
-                rtc_hal_write( 0x0D, &temp, 1 );
-                rtc_hal_read( 0x03, &temp, 1 ); // enable battery
-                temp |= ( 1 << 3 );
-                rtc_hal_write( 0x03, &temp, 1 );
+/****************************************
+ ********* Temperature / Trim ***********
+ ***************************************/
+int16_t rtc_get_temperature()
+{
+    uint8_t buffer[2];
+    int16_t temp = 0;
 
-                rtc_hal_read( 0x07, &temp, 1 );
-                //              temp |= (1<<7);
-                temp &= ~( 1 << 6 ); // disable SQWO
-                temp |= ( 1 << 4 ); // activate alarm 0
-                rtc_hal_write( 0x07, &temp, 1 );
-                break;
+    TRACE_OP( RTC_OP_TRIM );
 
-            case RTC_ALARM_1:
+    if( current_type == RTC_DS3231 )
+    {
+        // 10 bit two's complement, MSB holds the integer part
+        bus_read( RTC_DS3231_TEMP_MSB, buffer, 2 );
+        temp = ( int16_t )( ( int8_t )buffer[0] ) * 4;
+        temp += buffer[1] >> 6;
+    }
 
-                rtc_hal_read( 0x11, buffer, 6 );
-                // Set time values for the alarm
-                buffer[RTC_SECONDS_BYTE] = RTC_SECONDS_CLEAR( buffer[RTC_SECONDS_BYTE] );
-                buffer[RTC_SECONDS_BYTE] |= BIN2BCD( time.seconds );
+    return temp;
+}
 
-                buffer[RTC_MINUTES_BYTE] = RTC_MINUTES_CLEAR( buffer[RTC_MINUTES_BYTE] );
-                buffer[RTC_MINUTES_BYTE] |= BIN2BCD( time.minutes );
+int rtc_set_aging_offset( int8_t offset )
+{
+    TRACE_OP( RTC_OP_TRIM );
 
-                buffer[RTC_HOUR_BYTE] = RTC_HOURS_CLEAR( buffer[RTC_HOUR_BYTE] );
-                buffer[RTC_HOUR_BYTE] |= BIN2BCD( time.hours );
+    if( current_type != RTC_DS3231 )
+        return -1;
 
-                buffer[RTC_DAY_BYTE] = RTC_DAY_CLEAR( buffer[RTC_DAY_BYTE] );
-                buffer[RTC_DAY_BYTE] |= BIN2BCD( time.weekday );
+    return bus_write( RTC_DS3231_AGING, &offset, 1 );
+}
 
-                buffer[RTC_DATE_BYTE] = RTC_DATE_CLEAR( buffer[RTC_DATE_BYTE] );
-                buffer[RTC_DATE_BYTE] |= BIN2BCD( time.monthday );
+int8_t rtc_get_aging_offset()
+{
+    int8_t offset = 0;
 
-                buffer[RTC_MONTH_BYTE] = RTC_MONTH_CLEAR( buffer[RTC_MONTH_BYTE] );
-                buffer[RTC_MONTH_BYTE] |= BIN2BCD( time.month );
+    TRACE_OP( RTC_OP_TRIM );
 
-                rtc_hal_write( 0x11, buffer, 6 );
+    if( current_type == RTC_DS3231 )
+        bus_read( RTC_DS3231_AGING, &offset, 1 );
 
-                rtc_hal_read( 0x14, &temp, 1 );
-                switch ( trigger )
-                {
-                    case RTC_ALARM_SECONDS:
-                        temp &= ~( 0b01111000 );
-                        break;
-                    case RTC_ALARM_MINUTES:
-                        temp &= ~( 0b01111000 );
-                        temp |= ( 1 << 4 );
-                        break;
-                    case RTC_ALARM_HOURS:
-                        temp &= ~( 0b01111000 );
-                        temp |= ( 1 << 5 );
-                        break;
-                    case RTC_ALARM_DAY:
-                        temp &= ~( 0b01111000 );
-                        temp |= ( 1 << 4 );
-                        temp |= ( 1 << 5 );
-                        break;
-                    case RTC_ALARM_DATE:
-                        temp &= ~( 0b01111000 );
-                        temp |= ( 1 << 6 );
-                        break;
-                    case RTC_ALARM_SEC_MIN_HOUR_DAY_DATE_MONTH:
-                        temp &= ~( 0b01111000 );
-                        temp |=  ( 0b01110000 );
-                    default:
-                        break;
-                }
-                temp |= ( 1 << 7 ); // set the polarity to one
-                rtc_hal_write( 0x14, &temp, 1 );
+    return offset;
+}
 
-                rtc_hal_read( 0x03, &temp, 1 ); // enable battery
-                temp |= ( 1 << 3 );
-                rtc_hal_write( 0x03, &temp, 1 );
+/****************************************
+ ********* Calendar *********************
+ ***************************************/
+/*
+ * Splits an epoch into year and 0 based day of the year
+ * ( days from civil, H. Hinnant ), unsigned over the whole uint32_t range
+ */
+static uint16_t cal_split( uint32_t epoch, uint16_t *yday )
+{
+    uint32_t z = epoch / TIME_SEC_IN_24_HOURS + 719468UL;
+    uint32_t era = z / 146097UL;
+    uint32_t doe = z - era * 146097UL;
+    uint32_t yoe = ( doe - doe / 1460 + doe / 36524 - doe / 146096 ) / 365;
+    uint32_t doy = doe - ( 365 * yoe + yoe / 4 - yoe / 100 );
+    uint16_t year = ( uint16_t )( yoe + era * 400 );
+
+    // doy counts from March 1st
+    if( doy >= 306 )
+    {
+        year++;
+        *yday = doy - 306;
+    } else {
+        *yday = doy + 59 + rtc_cal_is_leap( year );
+    }
+
+    return year;
+}
+
+/*
+ * Day of the week, 0 is Monday ( 1 Jan 1970 was a Thursday )
+ */
+static uint8_t cal_weekday( uint32_t epoch )
+{
+    return ( epoch / TIME_SEC_IN_24_HOURS + 3 ) % 7;
+}
+
+static uint8_t cal_weeks_in_year( uint16_t year )
+{
+    uint16_t prev = year - 1;
+
+    if( ( year + year / 4 - year / 100 + year / 400 ) % 7 == 4 ||
+        ( prev + prev / 4 - prev / 100 + prev / 400 ) % 7 == 3 )
+        return 53;
+
+    return 52;
+}
+
+/*
+ * Straight-line day count to date, the month comes from the March based
+ * day of the year so the loop body has no tables or data dependent branches
+ */
+static void cal_from_epoch( uint32_t epoch, rtc_time_t *ts )
+{
+    uint32_t days = epoch / TIME_SEC_IN_24_HOURS;
+    uint32_t secs = epoch - days * TIME_SEC_IN_24_HOURS;
+    uint32_t z = days + 719468UL;
+    uint32_t era = z / 146097UL;
+    uint32_t doe = z - era * 146097UL;
+    uint32_t yoe = ( doe - doe / 1460 + doe / 36524 - doe / 146096 ) / 365;
+    uint32_t doy = doe - ( 365 * yoe + yoe / 4 - yoe / 100 );
+    uint32_t mp = ( 5 * doy + 2 ) / 153;
+    uint32_t month = ( mp < 10 ) ? mp + 3 : mp - 9;
+
+    ts->year = yoe + era * 400 + ( month <= 2 ) - 2000;
+    ts->month = month;
+    ts->monthday = doy - ( 153 * mp + 2 ) / 5 + 1;
+    ts->weekday = ( days + 3 ) % 7 + 1;
+    ts->hours = secs / TIME_SEC_IN_HOUR;
+    secs -= ( uint32_t )ts->hours * TIME_SEC_IN_HOUR;
+    ts->minutes = secs / TIME_SEC_IN_MIN;
+    ts->seconds = secs - ( uint32_t )ts->minutes * TIME_SEC_IN_MIN;
+}
+
+static uint32_t cal_to_epoch( const rtc_time_t *ts )
+{
+    uint32_t year = 2000 + ts->year - ( ts->month <= 2 );
+    uint32_t era = year / 400;
+    uint32_t yoe = year - era * 400;
+    uint32_t mp = ( ts->month > 2 ) ? ts->month - 3 : ts->month + 9;
+    uint32_t doy = ( 153 * mp + 2 ) / 5 + ts->monthday - 1;
+    uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    uint32_t days = era * 146097UL + doe - 719468UL;
+
+    return days * TIME_SEC_IN_24_HOURS + ( uint32_t )ts->hours * TIME_SEC_IN_HOUR +
+           ( uint32_t )ts->minutes * TIME_SEC_IN_MIN + ts->seconds;
+}
+
+bool rtc_cal_is_leap( uint16_t year )
+{
+    return ( ( year % 4 == 0 && year % 100 != 0 ) || year % 400 == 0 );
+}
+
+uint8_t rtc_cal_days_in_month( uint16_t year, uint8_t month )
+{
+    if( month < JANUARY || month > DECEMBER )
+        return 0;
+
+    return cal_month_days[rtc_cal_is_leap( year )][month];
+}
+
+uint16_t rtc_cal_day_of_year( uint32_t epoch )
+{
+    uint16_t yday;
+
+    cal_split( epoch, &yday );
+    return yday + 1;
+}
+
+uint8_t rtc_cal_iso_week( uint32_t epoch )
+{
+    uint16_t yday;
+    uint16_t year = cal_split( epoch, &yday );
+    int16_t week = ( ( int16_t )yday - cal_weekday( epoch ) + 10 ) / 7;
+
+    if( week < 1 )
+        return cal_weeks_in_year( year - 1 );
+    else if( week > cal_weeks_in_year( year ) )
+        return 1;
+
+    return week;
+}
+
+uint8_t rtc_cal_week_of_month( uint32_t epoch )
+{
+    uint16_t yday;
+    uint16_t year = cal_split( epoch, &yday );
+    const uint16_t *before = cal_days_before[rtc_cal_is_leap( year )];
+    uint8_t month = DECEMBER;
+    uint8_t mday;
+    uint8_t first;
+
+    while( before[month] > yday )
+        month--;
+
+    mday = yday - before[month];
+    first = ( cal_weekday( epoch ) + 7 - mday % 7 ) % 7;
+
+    return ( mday + first ) / 7 + 1;
+}
+
+void rtc_cal_to_times( const uint32_t *epochs, rtc_time_t *times, size_t count )
+{
+    size_t i;
+
+    for( i = 0; i < count; i++ )
+        cal_from_epoch( epochs[i], &times[i] );
+}
+
+void rtc_cal_to_epochs( const rtc_time_t *times, uint32_t *epochs, size_t count )
+{
+    size_t i;
+
+    for( i = 0; i < count; i++ )
+        epochs[i] = cal_to_epoch( &times[i] );
+}
+
+#if defined( CAL_AVX2 ) || defined( CAL_SSE2 ) || defined( CAL_NEON )
+/*
+ * Lane primitives of the selected instruction set, the kernels below are
+ * written once against them. Every lane holds a uint32_t, products wrap
+ * like the scalar code.
+ */
+#if defined( CAL_AVX2 )
+#define CAL_LANES 8
+typedef __m256i cal_vec_t;
+
+static inline cal_vec_t v_set( uint32_t x ) { return _mm256_set1_epi32( ( int )x ); }
+static inline cal_vec_t v_add( cal_vec_t a, cal_vec_t b ) { return _mm256_add_epi32( a, b ); }
+static inline cal_vec_t v_sub( cal_vec_t a, cal_vec_t b ) { return _mm256_sub_epi32( a, b ); }
+static inline cal_vec_t v_and( cal_vec_t a, cal_vec_t b ) { return _mm256_and_si256( a, b ); }
+static inline cal_vec_t v_srl( cal_vec_t a, int n ) { return _mm256_srli_epi32( a, n ); }
+static inline cal_vec_t v_mullo( cal_vec_t a, cal_vec_t b ) { return _mm256_mullo_epi32( a, b ); }
+static inline cal_vec_t v_gt( cal_vec_t a, cal_vec_t b ) { return _mm256_cmpgt_epi32( a, b ); }
+
+static inline cal_vec_t v_mulhi( cal_vec_t a, cal_vec_t b )
+{
+    cal_vec_t even = _mm256_mul_epu32( a, b );
+    cal_vec_t odd = _mm256_mul_epu32( _mm256_srli_epi64( a, 32 ),
+                                      _mm256_srli_epi64( b, 32 ) );
+
+    return _mm256_blend_epi32( _mm256_srli_epi64( even, 32 ), odd, 0xAA );
+}
+
+static inline cal_vec_t v_load( const uint32_t *p )
+{
+    return _mm256_loadu_si256( ( const __m256i * )p );
+}
+
+static inline void v_store( uint32_t *p, cal_vec_t a )
+{
+    _mm256_storeu_si256( ( __m256i * )p, a );
+}
+
+static inline cal_vec_t v_load8( const uint8_t *p )
+{
+    return _mm256_cvtepu8_epi32( _mm_loadl_epi64( ( const __m128i * )p ) );
+}
+
+static inline void v_store8( uint8_t *p, cal_vec_t a )
+{
+    __m128i low;
+
+    a = v_and( a, v_set( 0xFF ) );
+    low = _mm_packs_epi32( _mm256_castsi256_si128( a ),
+                           _mm256_extracti128_si256( a, 1 ) );
+    _mm_storel_epi64( ( __m128i * )p, _mm_packus_epi16( low, low ) );
+}
+
+#elif defined( CAL_SSE2 )
+#define CAL_LANES 4
+typedef __m128i cal_vec_t;
+
+static inline cal_vec_t v_set( uint32_t x ) { return _mm_set1_epi32( ( int )x ); }
+static inline cal_vec_t v_add( cal_vec_t a, cal_vec_t b ) { return _mm_add_epi32( a, b ); }
+static inline cal_vec_t v_sub( cal_vec_t a, cal_vec_t b ) { return _mm_sub_epi32( a, b ); }
+static inline cal_vec_t v_and( cal_vec_t a, cal_vec_t b ) { return _mm_and_si128( a, b ); }
+static inline cal_vec_t v_srl( cal_vec_t a, int n ) { return _mm_srli_epi32( a, n ); }
+static inline cal_vec_t v_gt( cal_vec_t a, cal_vec_t b ) { return _mm_cmpgt_epi32( a, b ); }
+
+static inline cal_vec_t v_mullo( cal_vec_t a, cal_vec_t b )
+{
+    // SSE2 only multiplies lanes 0 and 2, the odd lanes are shifted down
+    cal_vec_t even = _mm_mul_epu32( a, b );
+    cal_vec_t odd = _mm_mul_epu32( _mm_srli_epi64( a, 32 ), _mm_srli_epi64( b, 32 ) );
+
+    return _mm_unpacklo_epi32( _mm_shuffle_epi32( even, _MM_SHUFFLE( 0, 0, 2, 0 ) ),
+                               _mm_shuffle_epi32( odd, _MM_SHUFFLE( 0, 0, 2, 0 ) ) );
+}
+
+static inline cal_vec_t v_mulhi( cal_vec_t a, cal_vec_t b )
+{
+    cal_vec_t even = _mm_mul_epu32( a, b );
+    cal_vec_t odd = _mm_mul_epu32( _mm_srli_epi64( a, 32 ), _mm_srli_epi64( b, 32 ) );
+
+    return _mm_or_si128( _mm_srli_epi64( even, 32 ),
+                         _mm_and_si128( odd, _mm_set_epi32( -1, 0, -1, 0 ) ) );
+}
+
+static inline cal_vec_t v_load( const uint32_t *p )
+{
+    return _mm_loadu_si128( ( const __m128i * )p );
+}
+
+static inline void v_store( uint32_t *p, cal_vec_t a )
+{
+    _mm_storeu_si128( ( __m128i * )p, a );
+}
+
+static inline cal_vec_t v_load8( const uint8_t *p )
+{
+    int32_t bytes;
+
+    memcpy( &bytes, p, 4 );
+    return _mm_unpacklo_epi16( _mm_unpacklo_epi8( _mm_cvtsi32_si128( bytes ),
+                                                  _mm_setzero_si128() ),
+                               _mm_setzero_si128() );
+}
+
+static inline void v_store8( uint8_t *p, cal_vec_t a )
+{
+    int32_t bytes;
+
+    a = v_and( a, v_set( 0xFF ) );
+    a = _mm_packs_epi32( a, a );
+    bytes = _mm_cvtsi128_si32( _mm_packus_epi16( a, a ) );
+    memcpy( p, &bytes, 4 );
+}
+
+#elif defined( CAL_NEON )
+#define CAL_LANES 4
+typedef uint32x4_t cal_vec_t;
+
+static inline cal_vec_t v_set( uint32_t x ) { return vdupq_n_u32( x ); }
+static inline cal_vec_t v_add( cal_vec_t a, cal_vec_t b ) { return vaddq_u32( a, b ); }
+static inline cal_vec_t v_sub( cal_vec_t a, cal_vec_t b ) { return vsubq_u32( a, b ); }
+static inline cal_vec_t v_and( cal_vec_t a, cal_vec_t b ) { return vandq_u32( a, b ); }
+static inline cal_vec_t v_srl( cal_vec_t a, int n ) { return vshlq_u32( a, vdupq_n_s32( -n ) ); }
+static inline cal_vec_t v_mullo( cal_vec_t a, cal_vec_t b ) { return vmulq_u32( a, b ); }
+static inline cal_vec_t v_gt( cal_vec_t a, cal_vec_t b ) { return vcgtq_u32( a, b ); }
+
+static inline cal_vec_t v_mulhi( cal_vec_t a, cal_vec_t b )
+{
+    uint64x2_t low = vmull_u32( vget_low_u32( a ), vget_low_u32( b ) );
+    uint64x2_t high = vmull_u32( vget_high_u32( a ), vget_high_u32( b ) );
+
+    return vcombine_u32( vshrn_n_u64( low, 32 ), vshrn_n_u64( high, 32 ) );
+}
+
+static inline cal_vec_t v_load( const uint32_t *p ) { return vld1q_u32( p ); }
+static inline void v_store( uint32_t *p, cal_vec_t a ) { vst1q_u32( p, a ); }
+
+static inline cal_vec_t v_load8( const uint8_t *p )
+{
+    uint32_t bytes;
+
+    memcpy( &bytes, p, 4 );
+    return vmovl_u16( vget_low_u16( vmovl_u8( vreinterpret_u8_u32( vdup_n_u32( bytes ) ) ) ) );
+}
+
+static inline void v_store8( uint8_t *p, cal_vec_t a )
+{
+    uint16x4_t half = vmovn_u32( a );
+    uint32_t bytes = vget_lane_u32( vreinterpret_u32_u8(
+                         vmovn_u16( vcombine_u16( half, half ) ) ), 0 );
+
+    memcpy( p, &bytes, 4 );
+}
+#endif
+
+/*
+ * x / d as a multiply high and a shift. With l = floor( log2( d ) ) and
+ * M = ceil( 2^( 32 + l ) / d ) the rounding error of M stays below d, so
+ * the quotient is exact for every x below 2^31.
+ */
+#define CAL_MAGIC( d, l )   ( uint32_t )( ( ( 1ULL << ( 32 + ( l ) ) ) + ( d ) - 1 ) / ( d ) )
+#define V_DIV( x, d, l )    v_srl( v_mulhi( ( x ), v_set( CAL_MAGIC( d, l ) ) ), ( l ) )
+
+/*
+ * cal_from_epoch() on CAL_LANES epochs
+ */
+static inline void cal_from_epoch_vec( const uint32_t *epochs,
+                                       const rtc_time_soa_t *times, size_t i )
+{
+    cal_vec_t epoch = v_load( &epochs[i] );
+    cal_vec_t days = V_DIV( v_srl( epoch, 7 ), 675, 9 );    // 86400 = 128 * 675
+    cal_vec_t secs = v_sub( epoch, v_mullo( days, v_set( TIME_SEC_IN_24_HOURS ) ) );
+    cal_vec_t z = v_add( days, v_set( 719468UL ) );
+    cal_vec_t era = V_DIV( z, 146097UL, 17 );
+    cal_vec_t doe = v_sub( z, v_mullo( era, v_set( 146097UL ) ) );
+    cal_vec_t yoe = V_DIV( v_sub( v_add( v_sub( doe, V_DIV( doe, 1460, 10 ) ),
+                                         V_DIV( doe, 36524, 15 ) ),
+                                  V_DIV( doe, 146096UL, 17 ) ), 365, 8 );
+    cal_vec_t doy = v_sub( doe, v_sub( v_add( v_mullo( yoe, v_set( 365 ) ),
+                                              v_srl( yoe, 2 ) ),
+                                       V_DIV( yoe, 100, 6 ) ) );
+    cal_vec_t mp = V_DIV( v_add( v_mullo( doy, v_set( 5 ) ), v_set( 2 ) ), 153, 7 );
+    cal_vec_t jan_feb = v_gt( mp, v_set( 9 ) );            // all ones, March based
+    cal_vec_t week = v_add( days, v_set( 3 ) );
+    cal_vec_t hours = V_DIV( secs, TIME_SEC_IN_HOUR, 11 );
+    cal_vec_t minutes;
+
+    v_store8( &times->year[i],
+              v_sub( v_sub( v_add( yoe, v_mullo( era, v_set( 400 ) ) ), jan_feb ),
+                     v_set( 2000 ) ) );
+    v_store8( &times->month[i],
+              v_sub( v_add( mp, v_set( 3 ) ), v_and( jan_feb, v_set( 12 ) ) ) );
+    v_store8( &times->monthday[i],
+              v_add( v_sub( doy, V_DIV( v_add( v_mullo( mp, v_set( 153 ) ), v_set( 2 ) ),
+                                        5, 2 ) ), v_set( 1 ) ) );
+    v_store8( &times->weekday[i],
+              v_add( v_sub( week, v_mullo( V_DIV( week, 7, 2 ), v_set( 7 ) ) ),
+                     v_set( 1 ) ) );
+    v_store8( &times->hours[i], hours );
+    secs = v_sub( secs, v_mullo( hours, v_set( TIME_SEC_IN_HOUR ) ) );
+    minutes = V_DIV( secs, TIME_SEC_IN_MIN, 5 );
+    v_store8( &times->minutes[i], minutes );
+    v_store8( &times->seconds[i],
+              v_sub( secs, v_mullo( minutes, v_set( TIME_SEC_IN_MIN ) ) ) );
+}
+
+/*
+ * cal_to_epoch() on CAL_LANES dates
+ */
+static inline void cal_to_epoch_vec( const rtc_time_soa_t *times,
+                                     uint32_t *epochs, size_t i )
+{
+    cal_vec_t month = v_load8( &times->month[i] );
+    cal_vec_t jan_feb = v_gt( v_set( 3 ), month );          // all ones
+    cal_vec_t year = v_add( v_add( v_load8( &times->year[i] ), v_set( 2000 ) ),
+                            jan_feb );
+    cal_vec_t era = V_DIV( year, 400, 8 );
+    cal_vec_t yoe = v_sub( year, v_mullo( era, v_set( 400 ) ) );
+    cal_vec_t mp = v_add( v_sub( month, v_set( 3 ) ), v_and( jan_feb, v_set( 12 ) ) );
+    cal_vec_t doy = v_sub( v_add( V_DIV( v_add( v_mullo( mp, v_set( 153 ) ), v_set( 2 ) ),
+                                         5, 2 ),
+                                  v_load8( &times->monthday[i] ) ), v_set( 1 ) );
+    cal_vec_t doe = v_add( v_sub( v_add( v_mullo( yoe, v_set( 365 ) ), v_srl( yoe, 2 ) ),
+                                  V_DIV( yoe, 100, 6 ) ), doy );
+    cal_vec_t days = v_sub( v_add( v_mullo( era, v_set( 146097UL ) ), doe ),
+                            v_set( 719468UL ) );
+
+    v_store( &epochs[i],
+             v_add( v_add( v_mullo( days, v_set( TIME_SEC_IN_24_HOURS ) ),
+                           v_mullo( v_load8( &times->hours[i] ),
+                                    v_set( TIME_SEC_IN_HOUR ) ) ),
+                    v_add( v_mullo( v_load8( &times->minutes[i] ),
+                                    v_set( TIME_SEC_IN_MIN ) ),
+                           v_load8( &times->seconds[i] ) ) ) );
+}
+#endif
+
+void rtc_cal_to_times_soa( const uint32_t *epochs, const rtc_time_soa_t *times,
+                           size_t count )
+{
+    rtc_time_t ts;
+    size_t i = 0;
+
+#ifdef CAL_LANES
+    for( ; i + CAL_LANES <= count; i += CAL_LANES )
+        cal_from_epoch_vec( epochs, times, i );
+#endif
+
+    for( ; i < count; i++ )
+    {
+        cal_from_epoch( epochs[i], &ts );
+        times->seconds[i] = ts.seconds;
+        times->minutes[i] = ts.minutes;
+        times->hours[i] = ts.hours;
+        times->weekday[i] = ts.weekday;
+        times->monthday[i] = ts.monthday;
+        times->month[i] = ts.month;
+        times->year[i] = ts.year;
+    }
+}
+
+void rtc_cal_to_epochs_soa( const rtc_time_soa_t *times, uint32_t *epochs,
+                            size_t count )
+{
+    rtc_time_t ts;
+    size_t i = 0;
+
+#ifdef CAL_LANES
+    for( ; i + CAL_LANES <= count; i += CAL_LANES )
+        cal_to_epoch_vec( times, epochs, i );
+#endif
+
+    for( ; i < count; i++ )
+    {
+        ts.seconds = times->seconds[i];
+        ts.minutes = times->minutes[i];
+        ts.hours = times->hours[i];
+        ts.monthday = times->monthday[i];
+        ts.month = times->month[i];
+        ts.year = times->year[i];
+        epochs[i] = cal_to_epoch( &ts );
+    }
+}
+
+/****************************************
+ ********* Calibration ******************
+ ***************************************/
+/*
+ * Battery backed RAM access, the MCP7941X keeps it behind its own slave
+ */
+static int nv_read( uint8_t reg, void *data_out, size_t num_bytes )
+{
+    int result;
+
+    if( current_type == RTC6_MCP7941X )
+        bus_slave( RTC6_MCP7941X_SRAM_SLAVE );
+
+    result = bus_read( reg, data_out, num_bytes );
+
+    if( current_type == RTC6_MCP7941X )
+        bus_slave( RTC6_MCP7941X_SLAVE );
+
+    return result;
+}
+
+static int nv_write( uint8_t reg, void *data_in, size_t num_bytes )
+{
+    int result;
+
+    if( current_type == RTC6_MCP7941X )
+        bus_slave( RTC6_MCP7941X_SRAM_SLAVE );
+
+    result = bus_write( reg, data_in, num_bytes );
+
+    if( current_type == RTC6_MCP7941X )
+        bus_slave( RTC6_MCP7941X_SLAVE );
+
+    return result;
+}
+
+static int calib_record_addr( uint8_t *addr )
+{
+    switch( current_type )
+    {
+        case RTC_PCF8583:
+            *addr = RTC_PCF8583_CALIB_ADDR;
+            return 0;
+        case RTC2_DS1307:
+            *addr = RTC2_CALIB_ADDR;
+            return 0;
+        case RTC6_MCP7941X:
+            *addr = RTC6_CALIB_ADDR;
+            return 0;
+        default:
+            // DS3231 keeps the aging offset itself, BQ32000 has no RAM
+            return -1;
+    }
+}
+
+/*
+ * Record layout: magic, trim register, drift ( LE16 ), correction epoch ( LE32 )
+ */
+static void calib_load()
+{
+    uint8_t record[RTC_CALIB_RECORD_SIZE];
+    uint8_t addr;
+
+    calib_loaded = true;
+
+    if( calib_record_addr( &addr ) )
+        return;
+
+    nv_read( addr, record, RTC_CALIB_RECORD_SIZE );
+
+    if( record[0] != RTC_CALIB_MAGIC )
+        return;
+
+    calib_drift = ( int16_t )( record[2] | ( ( uint16_t )record[3] << 8 ) );
+    calib_epoch = ( uint32_t )record[4] | ( ( uint32_t )record[5] << 8 ) |
+                  ( ( uint32_t )record[6] << 16 ) | ( ( uint32_t )record[7] << 24 );
+}
+
+static void calib_save( uint8_t trim )
+{
+    uint8_t record[RTC_CALIB_RECORD_SIZE];
+    uint8_t addr;
+
+    if( calib_record_addr( &addr ) )
+        return;
+
+    record[0] = RTC_CALIB_MAGIC;
+    record[1] = trim;
+    record[2] = ( uint16_t )calib_drift & 0xFF;
+    record[3] = ( uint16_t )calib_drift >> 8;
+    record[4] = calib_epoch & 0xFF;
+    record[5] = ( calib_epoch >> 8 ) & 0xFF;
+    record[6] = ( calib_epoch >> 16 ) & 0xFF;
+    record[7] = calib_epoch >> 24;
+
+    nv_write( addr, record, RTC_CALIB_RECORD_SIZE );
+}
+
+void rtc_calib_reset()
+{
+    calib_samples = 0;
+}
+
+int rtc_calib_add_reference( uint32_t ref_epoch )
+{
+    uint32_t now = rtc_get_gmt_unix_time();
+    int32_t offset = ( int32_t )( now - ref_epoch );
+
+    if( !now )
+        return -1;
+
+    if( calib_samples == 0 )
+    {
+        calib_ref_first = ref_epoch;
+        calib_offset_first = offset;
+    }
+
+    calib_ref_last = ref_epoch;
+    calib_offset_last = offset;
+
+    if( calib_samples < 255 )
+        calib_samples++;
+
+    return calib_samples;
+}
+
+int16_t rtc_calib_get_drift()
+{
+    float drift;
+
+    if( calib_samples < 2 || calib_ref_last == calib_ref_first )
+        return 0;
+
+    drift = ( float )( calib_offset_last - calib_offset_first ) * 10000000.0;
+    drift /= ( float )( calib_ref_last - calib_ref_first );
+
+    if( drift > RTC_CALIB_DRIFT_MAX )
+        return RTC_CALIB_DRIFT_MAX;
+    else if( drift < -RTC_CALIB_DRIFT_MAX )
+        return -RTC_CALIB_DRIFT_MAX;
+
+    return ( int16_t )( drift < 0 ? drift - 0.5 : drift + 0.5 );
+}
+
+int rtc_calib_apply()
+{
+    int16_t measured;
+    float correction;
+    float magnitude;
+    float step;
+    uint8_t trim = 0;
+    uint8_t control;
+    int16_t aging;
+    uint16_t errors = bus_errors;
+
+    TRACE_OP( RTC_OP_TRIM );
+
+    if( calib_samples < 2 || calib_ref_last == calib_ref_first )
+        return -1;
+
+    measured = rtc_calib_get_drift();
+
+    if( !calib_loaded )
+        calib_load();
+
+    switch( current_type )
+    {
+        case RTC6_MCP7941X:
+            // the measurement ran with the current trim in place, add on top
+            bus_read( RTC6_OSCTRIM_ADDR, &trim, 1 );
+            bus_read( 0x07, &control, 1 );
+            if( bus_errors != errors )
+                return -1;
+            step = ( control & RTC6_CRSTRIM ) ? RTC6_COARSE_STEP : RTC6_TRIM_STEP;
+            correction = ( float )( trim & 0x7F ) * step;
+            if( !( trim & RTC6_OSCTRIM_SIGN ) )
+                correction = -correction;
+            correction -= measured;
+
+            magnitude = ( correction < 0 ) ? -correction : correction;
+            control &= ~RTC6_CRSTRIM;
+            step = RTC6_TRIM_STEP;
+            if( magnitude > 127.5 * RTC6_TRIM_STEP )
+            {
+                control |= RTC6_CRSTRIM;
+                step = RTC6_COARSE_STEP;
+            }
+
+            magnitude = magnitude / step + 0.5;
+            trim = ( magnitude > 127 ) ? 127 : ( uint8_t )magnitude;
+            if( correction > 0 && trim )
+                trim |= RTC6_OSCTRIM_SIGN;
+
+            bus_write( RTC6_OSCTRIM_ADDR, &trim, 1 );
+            bus_write( 0x07, &control, 1 );
+            calib_drift = 0;
+            break;
+
+        case RTC_DS3231:
+            // one aging step is about 0.1ppm, positive slows the clock
+            aging = rtc_get_aging_offset() + measured;
+            if( bus_errors != errors )
+                return -1;
+            if( aging > 127 )
+                aging = 127;
+            else if( aging < -128 )
+                aging = -128;
+            rtc_set_aging_offset( ( int8_t )aging );
+            calib_drift = 0;
+            break;
+
+        default:
+            // no trim hardware, rtc_calib_correct() steps the clock
+            TRACE_HOLD();
+            rtc_calib_correct();
+            if( ( int32_t )calib_drift + measured > RTC_CALIB_DRIFT_MAX )
+                calib_drift = RTC_CALIB_DRIFT_MAX;
+            else if( ( int32_t )calib_drift + measured < -RTC_CALIB_DRIFT_MAX )
+                calib_drift = -RTC_CALIB_DRIFT_MAX;
+            else
+                calib_drift += measured;
+            calib_epoch = rtc_get_gmt_unix_time();
+            TRACE_RELEASE();
+            break;
+    }
+
+    // keep the samples when the trim did not make it to the chip
+    if( bus_errors != errors )
+        return -1;
+
+    calib_save( trim );
+    calib_samples = 0;
+
+    return 0;
+}
+
+int rtc_calib_correct()
+{
+    uint32_t now;
+    float error;
+    float residual;
+    long step;
+    int step_failed;
+    rtc_time_t corrected;
+
+    TRACE_OP( RTC_OP_TRIM );
+
+    if( current_type == RTC6_MCP7941X || current_type == RTC_DS3231 )
+        return 0;
+
+    if( !calib_loaded )
+        calib_load();
+
+    if( calib_drift == 0 )
+        return 0;
+
+    TRACE_HOLD();
+    now = rtc_get_gmt_unix_time();
+    TRACE_RELEASE();
+    if( !now )
+        return 0;
+
+    if( calib_epoch == 0 || now < calib_epoch )
+    {
+        // clock was set since, restart the correction window
+        calib_epoch = now;
+        calib_save( 0 );
+        return 0;
+    }
+
+    error = ( float )( now - calib_epoch ) * calib_drift / 10000000.0;
+    step = ( long )error;
+
+    if( step == 0 )
+        return 0;
+
+    time_epoch_to_date( ( long )now - step, &corrected );
+    TRACE_HOLD();
+    step_failed = rtc_set_gmt_time( corrected );
+    TRACE_RELEASE();
+    if( step_failed )
+        return 0;
+
+    // keep the fraction of a second that was not corrected yet
+    residual = error - step;
+    calib_epoch = now - step - ( uint32_t )( residual * 10000000.0 / calib_drift );
+    calib_save( 0 );
+
+    return ( int )-step;
+}
+
+/****************************************
+ ********* Alarms ***********************
+ ***************************************/
+
+void rtc_set_alarm( rtc_alarm_t alarm, rtc_alarm_trigger_t trigger,
+                    rtc_time_t time )
+{
+    uint8_t buffer[6];
+    uint8_t temp;
+
+    TRACE_OP( RTC_OP_ALARM );
+
+    if ( current_type == RTC_PCF8583 )
+    {
+        bus_read( 0, &temp, 1 );
+        temp |= ( 1 << 2 );
+        bus_write( 0, &temp, 1 );
+
+        buffer[0] = BIN2BCD( time.seconds );
+        buffer[1] = BIN2BCD( time.minutes );
+        buffer[2] = BIN2BCD( time.hours );
+        buffer[3] = BIN2BCD( time.monthday ); // date
+        buffer[4] = BIN2BCD( time.month );
+
+        // weekday alarms use the month register as a weekday mask
+        if( trigger == RTC_ALARM_WEEKDAY )
+            buffer[4] = 1 << ( ( time.weekday - 1 ) % 7 );
+
+        bus_write( 0x0A, buffer, 5 );
+
+
+        bus_read( 8, &temp, 1 );
+        temp &= ~( 1 << 4 );
+        temp &= ~( 1 << 5 );
+        temp |= ( 1 << 7 );
+
+        switch ( trigger )
+        {
+            case RTC_ALARM_DAY:
+                temp |= ( 1 << 4 );
+                break;
+            case RTC_ALARM_WEEKDAY:
+                temp |= ( 1 << 5 );
+                break;
+            case RTC_ALARM_DATE:
+            case RTC_ALARM_SEC_MIN_HOUR_DAY_DATE_MONTH:
+                temp |= ( 1 << 4 );
+                temp |= ( 1 << 5 );
+                break;
+        }
+        bus_write( 8, &temp, 1 );
+    }
+
+    else if ( current_type == RTC6_MCP7941X )
+    {
+        switch ( alarm )
+        {
+            case RTC_ALARM_0:
+
+                bus_read( 0x0A, buffer, 6 );
+                // Set time values for the alarm
+                buffer[RTC_SECONDS_BYTE] = RTC_SECONDS_CLEAR( buffer[RTC_SECONDS_BYTE] );
+                buffer[RTC_SECONDS_BYTE] |= BIN2BCD( time.seconds );
+
+                buffer[RTC_MINUTES_BYTE] = RTC_MINUTES_CLEAR( buffer[RTC_MINUTES_BYTE] );
+                buffer[RTC_MINUTES_BYTE] |= BIN2BCD( time.minutes );
+
+                buffer[RTC_HOUR_BYTE] = RTC_HOURS_CLEAR( buffer[RTC_HOUR_BYTE] );
+                buffer[RTC_HOUR_BYTE] |= BIN2BCD( time.hours );
+
+                buffer[RTC_DAY_BYTE] = RTC_DAY_CLEAR( buffer[RTC_DAY_BYTE] );
+                buffer[RTC_DAY_BYTE] |= BIN2BCD( time.weekday );
+
+                buffer[RTC_DATE_BYTE] = RTC_DATE_CLEAR( buffer[RTC_DATE_BYTE] );
+                buffer[RTC_DATE_BYTE] |= BIN2BCD( time.monthday );
+
+                buffer[RTC_MONTH_BYTE] = RTC_MONTH_CLEAR( buffer[RTC_MONTH_BYTE] );
+                buffer[RTC_MONTH_BYTE] |= BIN2BCD( time.month );
+
+                bus_write( 0x0A, buffer, 6 );
+
+                // set the trigger
+                bus_read( 0x0D, &temp, 1 );
+                switch ( trigger )
+                {
+                    case RTC_ALARM_SECONDS:
+                        temp &= ~( 0b01111000 );
+                        break;
+                    case RTC_ALARM_MINUTES:
+                        temp &= ~( 0b01111000 );
+                        temp |= ( 1 << 4 );
+                        break;
+                    case RTC_ALARM_HOURS:
+                        temp &= ~( 0b01111000 );
+                        temp |= ( 1 << 5 );
+                        break;
+                    case RTC_ALARM_DAY:
+                        temp &= ~( 0b01111000 );
+                        temp |= ( 1 << 4 );
+                        temp |= ( 1 << 5 );
+                        break;
+                    case RTC_ALARM_DATE:
+                        temp &= ~( 0b01111000 );
+                        temp |= ( 1 << 6 );
+                        break;
+                    case RTC_ALARM_SEC_MIN_HOUR_DAY_DATE_MONTH:
+                        temp &= ~( 0b01111000 );
+                        temp |=  ( 0b01110000 );
+                    default:
+                        break;
+                }
+                temp |= ( 1 << 7 ); // set the polarity to one
+                temp &= ~( 1 << 3 ); // clear a stale interrupt flag
+                bus_write( 0x0D, &temp, 1 );
+                bus_read( 0x03, &temp, 1 ); // enable battery
+                temp |= ( 1 << 3 );
+                bus_write( 0x03, &temp, 1 );
+
+                bus_read( 0x07, &temp, 1 );
+                //              temp |= (1<<7);
+                temp &= ~( 1 << 6 ); // disable SQWO
+                temp |= ( 1 << 4 ); // activate alarm 0
+                bus_write( 0x07, &temp, 1 );
+                break;
+
+            case RTC_ALARM_1:
+
+                bus_read( 0x11, buffer, 6 );
+                // Set time values for the alarm
+                buffer[RTC_SECONDS_BYTE] = RTC_SECONDS_CLEAR( buffer[RTC_SECONDS_BYTE] );
+                buffer[RTC_SECONDS_BYTE] |= BIN2BCD( time.seconds );
+
+                buffer[RTC_MINUTES_BYTE] = RTC_MINUTES_CLEAR( buffer[RTC_MINUTES_BYTE] );
+                buffer[RTC_MINUTES_BYTE] |= BIN2BCD( time.minutes );
+
+                buffer[RTC_HOUR_BYTE] = RTC_HOURS_CLEAR( buffer[RTC_HOUR_BYTE] );
+                buffer[RTC_HOUR_BYTE] |= BIN2BCD( time.hours );
+
+                buffer[RTC_DAY_BYTE] = RTC_DAY_CLEAR( buffer[RTC_DAY_BYTE] );
+                buffer[RTC_DAY_BYTE] |= BIN2BCD( time.weekday );
+
+                buffer[RTC_DATE_BYTE] = RTC_DATE_CLEAR( buffer[RTC_DATE_BYTE] );
+                buffer[RTC_DATE_BYTE] |= BIN2BCD( time.monthday );
+
+                buffer[RTC_MONTH_BYTE] = RTC_MONTH_CLEAR( buffer[RTC_MONTH_BYTE] );
+                buffer[RTC_MONTH_BYTE] |= BIN2BCD( time.month );
+
+                bus_write( 0x11, buffer, 6 );
+
+                bus_read( 0x14, &temp, 1 );
+                switch ( trigger )
+                {
+                    case RTC_ALARM_SECONDS:
+                        temp &= ~( 0b01111000 );
+                        break;
+                    case RTC_ALARM_MINUTES:
+                        temp &= ~( 0b01111000 );
+                        temp |= ( 1 << 4 );
+                        break;
+                    case RTC_ALARM_HOURS:
+                        temp &= ~( 0b01111000 );
+                        temp |= ( 1 << 5 );
+                        break;
+                    case RTC_ALARM_DAY:
+                        temp &= ~( 0b01111000 );
+                        temp |= ( 1 << 4 );
+                        temp |= ( 1 << 5 );
+                        break;
+                    case RTC_ALARM_DATE:
+                        temp &= ~( 0b01111000 );
+                        temp |= ( 1 << 6 );
+                        break;
+                    case RTC_ALARM_SEC_MIN_HOUR_DAY_DATE_MONTH:
+                        temp &= ~( 0b01111000 );
+                        temp |=  ( 0b01110000 );
+                    default:
+                        break;
+                }
+                temp |= ( 1 << 7 ); // set the polarity to one
+                temp &= ~( 1 << 3 ); // clear a stale interrupt flag
+                bus_write( 0x14, &temp, 1 );
+
+                bus_read( 0x03, &temp, 1 ); // enable battery
+                temp |= ( 1 << 3 );
+                bus_write( 0x03, &temp, 1 );
+
+                bus_read( 0x07, &temp, 1 );
+                //              temp |= (1<<7);
+                temp &= ~( 1 << 6 ); // disable SQWO
+                temp |= ( 1 << 5 ); // activate alarm 1
+                bus_write( 0x07, &temp, 1 );
+                break;
+        }
+    }
+
+    else if ( current_type == RTC_DS3231 )
+        ds3231_set_alarm( alarm, trigger, time );
+}
+
+
+/*
+ * DS3231 alarms match cumulatively, the AxMx bits mask the fields that are
+ * ignored. Alarm 2 has no seconds register so the mask is shifted by one,
+ * a seconds trigger on alarm 2 fires once per minute.
+ */
+static void ds3231_set_alarm( rtc_alarm_t alarm, rtc_alarm_trigger_t trigger,
+                              rtc_time_t time )
+{
+    uint8_t buffer[4];
+    uint8_t mask;
+    uint8_t temp;
+
+    switch( trigger )
+    {
+        case RTC_ALARM_SECONDS:
+            mask = 0x0E;
+            break;
+        case RTC_ALARM_MINUTES:
+            mask = 0x0C;
+            break;
+        case RTC_ALARM_HOURS:
+            mask = 0x08;
+            break;
+        default:
+            mask = 0x00;
+            break;
+    }
+
+    buffer[0] = BIN2BCD( time.seconds );
+    buffer[1] = BIN2BCD( time.minutes );
+    buffer[2] = BIN2BCD( time.hours );
+
+    if( trigger == RTC_ALARM_DAY || trigger == RTC_ALARM_WEEKDAY )
+        buffer[3] = BIN2BCD( time.weekday ) | RTC_DS3231_DYDT;
+    else
+        buffer[3] = BIN2BCD( time.monthday );
+
+    for( temp = 0; temp < 4; temp++ )
+        if( mask & ( 1 << temp ) )
+            buffer[temp] |= RTC_DS3231_AXMX;
+
+    if( alarm == RTC_ALARM_0 )
+        bus_write( RTC_DS3231_ALARM1_ADDR, buffer, 4 );
+    else
+        bus_write( RTC_DS3231_ALARM2_ADDR, &buffer[1], 3 );
+
+    // clear a stale flag before enabling the interrupt
+    bus_read( RTC_DS3231_STATUS, &temp, 1 );
+    temp &= ( alarm == RTC_ALARM_0 ) ? ~RTC_DS3231_A1F : ~RTC_DS3231_A2F;
+    bus_write( RTC_DS3231_STATUS, &temp, 1 );
+
+    bus_read( RTC_DS3231_CONTROL, &temp, 1 );
+    temp |= RTC_DS3231_INTCN;
+    temp |= ( alarm == RTC_ALARM_0 ) ? RTC_DS3231_A1IE : RTC_DS3231_A2IE;
+    bus_write( RTC_DS3231_CONTROL, &temp, 1 );
+}
+
+
+void rtc_disable_alarm( rtc_alarm_t alarm )
+{
+    uint8_t temp;
+
+    TRACE_OP( RTC_OP_ALARM );
+
+    switch( current_type )
+    {
+        case RTC_PCF8583:
+            bus_read( 0x00, &temp, 1 );
+            temp &= ~( 1 << 2 );
+            bus_write( 0x00, &temp, 1 );
+            break;
+        case RTC2_DS1307:
+            // Not supported
+            break;
+        case RTC3_BQ32000:
+            // not supported
+            break;
+        case RTC6_MCP7941X:
+            bus_read( 0x07, &temp, 1 );
+            switch( alarm )
+            {
+                case RTC_ALARM_0:
+                    temp &= ~( 1 << 4 );
+                    bus_write( 0x07, &temp, 1 );
+                    break;
+                case RTC_ALARM_1:
+                    temp &= ~( 1 << 5 );
+                    bus_write( 0x07, &temp, 1 );
+                    break;
+            }
+            break;
+        case RTC_DS3231:
+            bus_read( RTC_DS3231_CONTROL, &temp, 1 );
+            temp &= ( alarm == RTC_ALARM_0 ) ? ~RTC_DS3231_A1IE : ~RTC_DS3231_A2IE;
+            bus_write( RTC_DS3231_CONTROL, &temp, 1 );
+            break;
+    }
+}
+
+
+rtc_time_t *rtc_read_alarm( rtc_alarm_t alarm )
+{
+    uint8_t buffer[6];
+    static rtc_time_t temp_time = {0};
+
+    TRACE_OP( RTC_OP_ALARM );
+
+    switch( current_type )
+    {
+        case RTC_PCF8583:
+        {
+            bus_read( 0x0A, &temp_time.seconds, 1 );
+            bus_read( 0x0B, &temp_time.minutes, 1 );
+            bus_read( 0x0C, &temp_time.hours, 1 );
+            bus_read( 0x0D, &temp_time.monthday, 1 );
+            bus_read( 0x0E, &temp_time.month, 1 );
+
+            return &temp_time;
+            break;
+        }
+        case RTC2_DS1307:
+            // Not supported
+            return &temp_time;
+            break;
+        case RTC3_BQ32000:
+            // not supported
+            return &temp_time;
+            break;
+        case RTC6_MCP7941X:
+            switch( alarm )
+            {
+                case RTC_ALARM_0:
+                    bus_read( 0x0A, &buffer, 6 );
+                    temp_time.seconds = BCD2BIN( RTC_SECONDS_MASK( buffer[RTC_SECONDS_BYTE] ) );
+                    temp_time.minutes = BCD2BIN( RTC_MINUTES_MASK( buffer[RTC_MINUTES_BYTE] ) );
+                    temp_time.hours = BCD2BIN( RTC_HOURS_MASK( buffer[RTC_HOUR_BYTE] ) );
+                    temp_time.weekday = BCD2BIN( RTC_DAY_MASK( buffer[RTC_DAY_BYTE] ) );
+                    temp_time.monthday = BCD2BIN( RTC_DATE_MASK( buffer[RTC_DATE_BYTE] ) );
+                    temp_time.month = BCD2BIN( RTC_MONTH_MASK( buffer[RTC_MONTH_BYTE] ) );
+                    break;
+                case RTC_ALARM_1:
+                    bus_read( 0x11, &buffer, 6 );
+                    temp_time.seconds = BCD2BIN( RTC_SECONDS_MASK( buffer[RTC_SECONDS_BYTE] ) );
+                    temp_time.minutes = BCD2BIN( RTC_MINUTES_MASK( buffer[RTC_MINUTES_BYTE] ) );
+                    temp_time.hours = BCD2BIN( RTC_HOURS_MASK( buffer[RTC_HOUR_BYTE] ) );
+                    temp_time.weekday = BCD2BIN( RTC_DAY_MASK( buffer[RTC_DAY_BYTE] ) );
+                    temp_time.monthday = BCD2BIN( RTC_DATE_MASK( buffer[RTC_DATE_BYTE] ) );
+                    temp_time.month = BCD2BIN( RTC_MONTH_MASK( buffer[RTC_MONTH_BYTE] ) );
+                    break;
+            }
+            return &temp_time;
+            break;
+        case RTC_DS3231:
+            memset( buffer, 0, sizeof( buffer ) );
+            if( alarm == RTC_ALARM_0 )
+                bus_read( RTC_DS3231_ALARM1_ADDR, buffer, 4 );
+            else
+                bus_read( RTC_DS3231_ALARM2_ADDR, &buffer[1], 3 );
+
+            temp_time.seconds = BCD2BIN( RTC_SECONDS_MASK( buffer[0] ) );
+            temp_time.minutes = BCD2BIN( RTC_MINUTES_MASK( buffer[1] ) );
+            temp_time.hours = BCD2BIN( RTC_HOURS_MASK( buffer[2] ) );
+            if( buffer[3] & RTC_DS3231_DYDT )
+                temp_time.weekday = BCD2BIN( buffer[3] & 0x0F );
+            else
+                temp_time.monthday = BCD2BIN( RTC_DATE_MASK( buffer[3] ) );
+            return &temp_time;
+            break;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Reads the flags selected by mask and clears the ones that fired
+ */
+static uint8_t alarm_service( uint8_t mask )
+{
+    uint8_t buffer[RTC6_ALM1WKDAY_ADDR - RTC6_ALM0WKDAY_ADDR + 1];
+    uint8_t fired = 0;
+
+    switch( current_type )
+    {
+        case RTC_PCF8583:
+            bus_read( 0x00, buffer, 1 );
+            if( ( mask & RTC_ALARM_0_FIRED ) && ( buffer[0] & RTC_PCF8583_ALARM_FLAG ) )
+            {
+                buffer[0] &= ~RTC_PCF8583_ALARM_FLAG;
+                bus_write( 0x00, buffer, 1 );
+                fired = RTC_ALARM_0_FIRED;
+            }
+            break;
+
+        case RTC6_MCP7941X:
+            // ALM0WKDAY and ALM1WKDAY are 7 bytes apart, span both in one burst
+            if( mask == RTC_ALARM_0_FIRED )
+                bus_read( RTC6_ALM0WKDAY_ADDR, buffer, 1 );
+            else
+                bus_read( RTC6_ALM0WKDAY_ADDR, buffer, sizeof( buffer ) );
+
+            if( ( mask & RTC_ALARM_0_FIRED ) && ( buffer[0] & RTC6_ALMXIF ) )
+                fired |= RTC_ALARM_0_FIRED;
+            if( ( mask & RTC_ALARM_1_FIRED ) &&
+                ( buffer[sizeof( buffer ) - 1] & RTC6_ALMXIF ) )
+                fired |= RTC_ALARM_1_FIRED;
+
+            buffer[0] &= ~RTC6_ALMXIF;
+            buffer[sizeof( buffer ) - 1] &= ~RTC6_ALMXIF;
+
+            if( fired == ( RTC_ALARM_0_FIRED | RTC_ALARM_1_FIRED ) )
+                bus_write( RTC6_ALM0WKDAY_ADDR, buffer, sizeof( buffer ) );
+            else if( fired == RTC_ALARM_0_FIRED )
+                bus_write( RTC6_ALM0WKDAY_ADDR, buffer, 1 );
+            else if( fired == RTC_ALARM_1_FIRED )
+                bus_write( RTC6_ALM1WKDAY_ADDR, &buffer[sizeof( buffer ) - 1], 1 );
+            break;
+
+        case RTC_DS3231:
+            bus_read( RTC_DS3231_STATUS, buffer, 1 );
+            if( ( mask & RTC_ALARM_0_FIRED ) && ( buffer[0] & RTC_DS3231_A1F ) )
+                fired |= RTC_ALARM_0_FIRED;
+            if( ( mask & RTC_ALARM_1_FIRED ) && ( buffer[0] & RTC_DS3231_A2F ) )
+                fired |= RTC_ALARM_1_FIRED;
+
+            if( fired )
+            {
+                // writing 1 leaves a flag untouched, only the fired ones clear
+                buffer[0] |= RTC_DS3231_A1F | RTC_DS3231_A2F;
+                if( fired & RTC_ALARM_0_FIRED )
+                    buffer[0] &= ~RTC_DS3231_A1F;
+                if( fired & RTC_ALARM_1_FIRED )
+                    buffer[0] &= ~RTC_DS3231_A2F;
+                bus_write( RTC_DS3231_STATUS, buffer, 1 );
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    return fired;
+}
+
+uint8_t rtc_alarm_service()
+{
+    TRACE_OP( RTC_OP_ALARM );
+
+    return alarm_service( RTC_ALARM_0_FIRED | RTC_ALARM_1_FIRED );
+}
+
+/****************************************
+ ********* Timers ***********************
+ ***************************************/
+static void timer_setup()
+{
+    uint16_t i;
+
+    for( i = 0; i < RTC_TIMER_MAX; i++ )
+    {
+        timer_slots[i].pos = TIMER_FREE;
+        timer_free[i] = RTC_TIMER_MAX - 1 - i;
+    }
+
+    timer_free_count = RTC_TIMER_MAX;
+    timer_count = 0;
+    timer_armed = 0;
+    timer_ready = true;
+}
+
+static void timer_place( uint16_t pos, uint16_t slot )
+{
+    timer_heap[pos] = slot;
+    timer_slots[slot].pos = pos;
+}
+
+static void timer_sift_up( uint16_t pos )
+{
+    uint16_t slot = timer_heap[pos];
+    uint32_t deadline = timer_slots[slot].deadline;
+
+    while( pos )
+    {
+        uint16_t parent = ( pos - 1 ) / 2;
+
+        if( timer_slots[timer_heap[parent]].deadline <= deadline )
+            break;
+
+        timer_place( pos, timer_heap[parent] );
+        pos = parent;
+    }
+
+    timer_place( pos, slot );
+}
+
+static void timer_sift_down( uint16_t pos )
+{
+    uint16_t slot = timer_heap[pos];
+    uint32_t deadline = timer_slots[slot].deadline;
+
+    for( ;; )
+    {
+        uint16_t child = pos * 2 + 1;
+
+        if( child >= timer_count )
+            break;
+
+        if( child + 1 < timer_count &&
+            timer_slots[timer_heap[child + 1]].deadline <
+            timer_slots[timer_heap[child]].deadline )
+            child++;
+
+        if( deadline <= timer_slots[timer_heap[child]].deadline )
+            break;
+
+        timer_place( pos, timer_heap[child] );
+        pos = child;
+    }
+
+    timer_place( pos, slot );
+}
+
+static void timer_remove( uint16_t pos )
+{
+    uint16_t slot = timer_heap[pos];
+
+    timer_slots[slot].pos = TIMER_FREE;
+    timer_free[timer_free_count++] = slot;
+
+    if( --timer_count == pos )
+        return;
+
+    // move the last leaf into the hole, it can go either way
+    timer_place( pos, timer_heap[timer_count] );
+
+    if( pos && timer_slots[timer_heap[pos]].deadline <
+               timer_slots[timer_heap[( pos - 1 ) / 2]].deadline )
+        timer_sift_up( pos );
+    else
+        timer_sift_down( pos );
+}
+
+/*
+ * Runs the timers due at now. Callbacks may start and cancel timers, the
+ * alarm is armed once the run is over.
+ */
+static uint16_t timer_run( uint32_t now )
+{
+    uint16_t fired = 0;
+    uint16_t slot;
+
+    timer_in_service = true;
+    while( timer_count && timer_slots[timer_heap[0]].deadline <= now )
+    {
+        slot = timer_heap[0];
+        timer_remove( 0 );
+        timer_slots[slot].cb( slot, timer_slots[slot].arg );
+        fired++;
+    }
+    timer_in_service = false;
+
+    // the callbacks tag their own calls
+    TRACE_OP( RTC_OP_TIMER );
+    return fired;
+}
+
+/*
+ * Programs the nearest deadline into alarm 0, only when it changed. Chips
+ * without alarms rely on rtc_timer_tick() running the shadow clock.
+ *
+ * The alarm matches the calendar but not the year, a match missed while
+ * the registers are written fires a year late. Deadlines within a second
+ * and ones that passed during arming run from here, the count is returned.
+ */
+static uint16_t timer_arm( uint32_t now )
+{
+    rtc_time_t when;
+    uint32_t deadline;
+    uint8_t weekday;
+    uint16_t fired = 0;
+    uint16_t errors;
+
+    if( timer_in_service )
+        return 0;
+
+    while( timer_count )
+    {
+        deadline = timer_slots[timer_heap[0]].deadline;
+        if( deadline == timer_armed )
+            return fired;
+
+        switch( current_type )
+        {
+            case RTC_PCF8583:
+            case RTC6_MCP7941X:
+            case RTC_DS3231:
+                if( deadline <= now + 1 )
+                {
+                    fired += timer_run( now + 1 );
+                    break;
+                }
+
+                // follow the weekday numbering the chip was set with
+                weekday = current_gmt_time.weekday ? current_gmt_time.weekday - 1 : 0;
+                time_epoch_to_date( deadline, &when );
+                when.weekday = ( weekday + ( deadline / TIME_SEC_IN_24_HOURS -
+                                             now / TIME_SEC_IN_24_HOURS ) % 7 ) % 7 + 1;
+                errors = bus_errors;
+                TRACE_HOLD();
+                rtc_set_alarm( RTC_ALARM_0, RTC_ALARM_SEC_MIN_HOUR_DAY_DATE_MONTH, when );
+                TRACE_RELEASE();
+                if( bus_errors != errors )
+                {
+                    // unknown alarm contents, the next arm writes it again
+                    timer_armed = 0;
+                    return fired;
+                }
+                timer_armed = deadline;
+
+                TRACE_HOLD();
+                now = rtc_get_gmt_unix_time();
+                TRACE_RELEASE();
+                if( !now || deadline > now )
+                    return fired;
+                fired += timer_run( now );
+                break;
+            default:
+                if( !timer_shadow )
+                {
+                    TRACE_HOLD();
+                    timer_shadow = rtc_get_gmt_unix_time();
+                    TRACE_RELEASE();
+                }
+                timer_armed = deadline;
+                return fired;
+        }
+    }
+
+    if( timer_armed )
+    {
+        TRACE_HOLD();
+        rtc_disable_alarm( RTC_ALARM_0 );
+        TRACE_RELEASE();
+    }
+    timer_armed = 0;
+
+    return fired;
+}
+
+int rtc_timer_start( uint32_t deadline, rtc_timer_cb_t cb, void *arg )
+{
+    uint32_t now;
+    uint16_t slot;
+
+    TRACE_OP( RTC_OP_TIMER );
+
+    if( !timer_ready )
+        timer_setup();
+
+    if( cb == NULL || timer_free_count == 0 )
+        return -1;
+
+    slot = timer_free[--timer_free_count];
+    timer_slots[slot].deadline = deadline;
+    timer_slots[slot].cb = cb;
+    timer_slots[slot].arg = arg;
+
+    timer_place( timer_count, slot );
+    timer_sift_up( timer_count++ );
+
+    if( timer_slots[slot].pos == 0 )
+    {
+        TRACE_HOLD();
+        now = rtc_get_cached_unix_time();
+        TRACE_RELEASE();
+        timer_arm( now );
+    }
+
+    return slot;
+}
+
+int rtc_timer_cancel( int id )
+{
+    uint32_t now;
+    uint16_t pos;
+
+    TRACE_OP( RTC_OP_TIMER );
+
+    if( !timer_ready || id < 0 || id >= RTC_TIMER_MAX ||
+        timer_slots[id].pos == TIMER_FREE )
+        return -1;
+
+    pos = timer_slots[id].pos;
+    timer_remove( pos );
+
+    if( pos == 0 )
+    {
+        TRACE_HOLD();
+        now = rtc_get_cached_unix_time();
+        TRACE_RELEASE();
+        timer_arm( now );
+    }
+
+    return 0;
+}
+
+uint32_t rtc_timer_next()
+{
+    if( !timer_ready || timer_count == 0 )
+        return 0;
+
+    return timer_slots[timer_heap[0]].deadline;
+}
+
+uint16_t rtc_timer_service()
+{
+    uint32_t now;
+    uint16_t fired;
+
+    TRACE_OP( RTC_OP_TIMER );
+
+    if( !timer_ready )
+        return 0;
+
+    alarm_service( RTC_ALARM_0_FIRED );
+    TRACE_HOLD();
+    now = rtc_get_gmt_unix_time();
+    TRACE_RELEASE();
+    if( !now )
+        return 0;
+    timer_shadow = now;
+
+    fired = timer_run( now );
+    return fired + timer_arm( now );
+}
+
+void rtc_timer_tick()
+{
+    TRACE_OP( RTC_OP_TIMER );
+
+    timer_shadow++;
+
+    if( timer_ready && timer_count &&
+        timer_slots[timer_heap[0]].deadline <= timer_shadow )
+        rtc_timer_service();
+}
+
+/****************************************
+ ********* Recurring Alarms *************
+ ***************************************/
+static uint32_t rule_range( uint8_t first, uint8_t last, uint8_t step )
+{
+    uint32_t mask = 0;
+
+    if( step == 0 )
+        step = 1;
+
+    while( first <= last && first < 32 )
+    {
+        mask |= 1UL << first;
+        first += step;
+    }
+
+    return mask;
+}
+
+static int8_t rule_next_bit( uint32_t mask, uint8_t from )
+{
+    if( from > 31 )
+        return -1;
+
+    mask >>= from;
+
+    while( mask )
+    {
+        if( mask & 1 )
+            return from;
+        mask >>= 1;
+        from++;
+    }
+
+    return -1;
+}
+
+static int8_t rule_next_minute( const rtc_rule_t *rule, uint8_t from )
+{
+    int8_t minute = -1;
+
+    if( from < 32 )
+        minute = rule_next_bit( rule->minutes_lo, from );
+
+    if( minute < 0 )
+    {
+        minute = rule_next_bit( rule->minutes_hi & 0x0FFFFFFFUL,
+                                ( from < 32 ) ? 0 : from - 32 );
+        if( minute >= 0 )
+            minute += 32;
+    }
+
+    return minute;
+}
+
+/*
+ * First match at or after a second of the day, -1 if none is left today
+ */
+static int32_t rule_in_day( const rtc_rule_t *rule, uint32_t sod )
+{
+    uint8_t hour = sod / TIME_SEC_IN_HOUR;
+    uint8_t minute = ( sod % TIME_SEC_IN_HOUR ) / TIME_SEC_IN_MIN;
+    int8_t h;
+    int8_t m = -1;
+
+    if( rule->second < sod % TIME_SEC_IN_MIN )
+        minute++;
+
+    h = rule_next_bit( rule->hours & 0x00FFFFFFUL, hour );
+    if( h == hour )
+    {
+        m = rule_next_minute( rule, minute );
+        if( m < 0 )
+            h = rule_next_bit( rule->hours & 0x00FFFFFFUL, hour + 1 );
+    }
+
+    if( h < 0 )
+        return -1;
+
+    if( m < 0 )
+        m = rule_next_minute( rule, 0 );
+
+    if( m < 0 )
+        return -1;
+
+    return ( int32_t )h * TIME_SEC_IN_HOUR + ( int32_t )m * TIME_SEC_IN_MIN +
+           rule->second;
+}
+
+void rtc_rule_init( rtc_rule_t *rule )
+{
+    rule->minutes_lo = 0xFFFFFFFFUL;
+    rule->minutes_hi = 0x0FFFFFFFUL;
+    rule->hours = 0x00FFFFFFUL;
+    rule->monthdays = 0xFFFFFFFEUL;
+    rule->months = 0x1FFE;
+    rule->weekdays = 0xFE;
+    rule->second = 0;
+}
+
+void rtc_rule_minutes( rtc_rule_t *rule, uint8_t first, uint8_t last,
+                       uint8_t step )
+{
+    uint8_t minute;
+
+    if( step == 0 )
+        step = 1;
+
+    rule->minutes_lo = 0;
+    rule->minutes_hi = 0;
+
+    for( minute = first; minute <= last && minute < 60; minute += step )
+    {
+        if( minute < 32 )
+            rule->minutes_lo |= 1UL << minute;
+        else
+            rule->minutes_hi |= 1UL << ( minute - 32 );
+    }
+}
+
+void rtc_rule_hours( rtc_rule_t *rule, uint8_t first, uint8_t last,
+                     uint8_t step )
+{
+    rule->hours = rule_range( first, last > 23 ? 23 : last, step );
+}
+
+void rtc_rule_monthdays( rtc_rule_t *rule, uint8_t first, uint8_t last,
+                         uint8_t step )
+{
+    rule->monthdays = rule_range( first ? first : 1, last, step );
+}
+
+void rtc_rule_months( rtc_rule_t *rule, rtc_month_t first, rtc_month_t last,
+                      uint8_t step )
+{
+    rule->months = rule_range( first, last > DECEMBER ? DECEMBER : last, step );
+}
+
+void rtc_rule_weekdays( rtc_rule_t *rule, rtc_day_t first, rtc_day_t last,
+                        uint8_t step )
+{
+    rule->weekdays = rule_range( first, last > SUNDAY ? SUNDAY : last, step );
+}
+
+/*
+ * Walks whole days from the start date, months that do not match are
+ * skipped at once, the first matching day is then searched by hour and
+ * minute masks.
+ */
+uint32_t rtc_rule_next( const rtc_rule_t *rule, uint32_t after )
+{
+    uint32_t t = after + 1;
+    uint32_t day = t / TIME_SEC_IN_24_HOURS;
+    uint32_t sod = t % TIME_SEC_IN_24_HOURS;
+    uint16_t yday;
+    uint16_t year;
+    uint8_t month = DECEMBER;
+    uint8_t mday;
+    uint8_t dim;
+    uint8_t weekday;
+    uint16_t n = 0;
+    int32_t found;
+
+    if( t == 0 )
+        return 0;
+
+    year = cal_split( t, &yday );
+    while( cal_days_before[rtc_cal_is_leap( year )][month] > yday )
+        month--;
+    mday = yday - cal_days_before[rtc_cal_is_leap( year )][month] + 1;
+    dim = rtc_cal_days_in_month( year, month );
+    weekday = cal_weekday( t );
+
+    while( n < RULE_MAX_DAYS )
+    {
+        if( rule->months & ( 1 << month ) )
+        {
+            if( ( rule->monthdays & ( 1UL << mday ) ) &&
+                ( rule->weekdays & ( 1 << ( weekday + 1 ) ) ) )
+            {
+                found = rule_in_day( rule, sod );
+                if( found >= 0 )
+                {
+                    if( day >= 0xFFFFFFFFUL / TIME_SEC_IN_24_HOURS )
+                        return 0;
+                    return day * TIME_SEC_IN_24_HOURS + found;
+                }
+            }
+
+            day++;
+            n++;
+            weekday = ( weekday + 1 ) % 7;
+            mday++;
+        } else {
+            // jump to the first of the next month
+            n += dim - mday + 1;
+            day += dim - mday + 1;
+            weekday = ( weekday + dim - mday + 1 ) % 7;
+            mday = dim + 1;
+        }
+
+        sod = 0;
+
+        if( mday > dim )
+        {
+            mday = 1;
+            if( ++month > DECEMBER )
+            {
+                month = JANUARY;
+                year++;
+            }
+            dim = rtc_cal_days_in_month( year, month );
+        }
+    }
+
+    return 0;
+}
+
+int rtc_rule_schedule( const rtc_rule_t *rule, rtc_timer_cb_t cb, void *arg )
+{
+    uint32_t now = rtc_get_gmt_unix_time();
+    uint32_t next;
+
+    if( now == 0 )
+        return -1;
+
+    next = rtc_rule_next( rule, now );
+    if( next == 0 )
+        return -1;
+
+    return rtc_timer_start( next, cb, arg );
+}
+
+/****************************************
+ ********* Memory ***********************
+ ***************************************/
+void rtc_write_sram( uint8_t addr, uint8_t data_in )
+{
+    TRACE_OP( RTC_OP_SRAM );
+
+    switch( current_type )
+    {
+        case RTC2_DS1307:
+            if( addr + RTC2_RAM_START < RTC2_RAM_END )
+                bus_write( RTC2_RAM_START + addr, &data_in, 1 );
+            break;
+        case RTC6_MCP7941X:
+            if( addr + RTC6_RAM_START < RTC6_RAM_END )
+            {
+                bus_slave( RTC6_MCP7941X_SRAM_SLAVE );
+                bus_write( RTC6_RAM_START + addr, &data_in, 1 );
+                bus_slave( RTC6_MCP7941X_SLAVE );
+            }
+            break;
+        case RTC_DS3231:
+            if( addr + RTC_DS3231_RAM_START <= RTC_DS3231_RAM_END )
+                bus_write( RTC_DS3231_RAM_START + addr, &data_in, 1 );
+            break;
+    }
+}
+
+void rtc_write_sram_bulk( uint8_t addr, void *data_in, size_t data_size )
+{
+    TRACE_OP( RTC_OP_SRAM );
+
+    switch( current_type )
+    {       
+        case RTC2_DS1307:
+            if( addr + RTC2_RAM_START + data_size < RTC2_RAM_END )
+            {
+                bus_write( RTC2_RAM_START + addr, data_in, data_size );
+            }
+            break;
+        case RTC6_MCP7941X:
+            if( addr + RTC6_RAM_START + data_size < RTC6_RAM_END )
+            {
+                bus_slave( RTC6_MCP7941X_SRAM_SLAVE );
+                bus_write( RTC6_RAM_START + addr, data_in, data_size );
+                bus_slave( RTC6_MCP7941X_SLAVE );
+            }
+            break;
+        case RTC_DS3231:
+            if( addr + RTC_DS3231_RAM_START + data_size <= RTC_DS3231_RAM_END + 1 )
+                bus_write( RTC_DS3231_RAM_START + addr, data_in, data_size );
+            break;
+    }
+}
+
+
+uint8_t rtc_read_sram( uint8_t addr )
+{
+    uint8_t temp = 0;
+
+    TRACE_OP( RTC_OP_SRAM );
+
+    switch( current_type )
+    {        
+        case RTC2_DS1307:
+            if( addr + RTC2_RAM_START < RTC2_RAM_END )
+                bus_read( RTC2_RAM_START + addr, &temp, 1 );
+        break;
+        case RTC6_MCP7941X:
+            if( addr + RTC6_RAM_START < RTC6_RAM_END )
+            {
+                bus_slave( RTC6_MCP7941X_SRAM_SLAVE );
+                bus_read( RTC6_RAM_START + addr, &temp, 1 );
+                bus_slave( RTC6_MCP7941X_SLAVE );
+            }
+            break;
+        case RTC_DS3231:
+            if( addr + RTC_DS3231_RAM_START <= RTC_DS3231_RAM_END )
+                bus_read( RTC_DS3231_RAM_START + addr, &temp, 1 );
+            break;
+    }
+
+    return temp;
+}
+
+
+void rtc_read_sram_bulk( uint8_t addr, void *data_out, uint8_t data_size )
+{
+    TRACE_OP( RTC_OP_SRAM );
+
+    switch( current_type )
+    {
+        case RTC2_DS1307:
+            if( addr + RTC2_RAM_START + data_size < RTC2_RAM_END )
+                bus_read( RTC2_RAM_START + addr, data_out, data_size );
+            break;
+        case RTC6_MCP7941X:
+            if( addr + RTC6_RAM_START + data_size < RTC6_RAM_END )
+            {
+                bus_slave( RTC6_MCP7941X_SRAM_SLAVE );
+                bus_read( RTC6_RAM_START + addr, data_out, data_size );
+                bus_slave( RTC6_MCP7941X_SLAVE );
+            }
+            break;
+        case RTC_DS3231:
+            if( addr + RTC_DS3231_RAM_START + data_size <= RTC_DS3231_RAM_END + 1 )
+                bus_read( RTC_DS3231_RAM_START + addr, data_out, data_size );
+            break;
+    }
+}
+
+/*
+ * STATUS is only changed through rtc_eeprom_set_protect, read it once
+ */
+static int eeprom_status_get( uint8_t *status )
+{
+    uint16_t errors = bus_errors;
+
+    if( !eeprom_status_loaded )
+    {
+        bus_slave( RTC6_MCP7941X_EEPROM_SLAVE );
+        bus_read( RTC6_EEPROM_STATUS, &eeprom_status, 1 );
+        bus_slave( RTC6_MCP7941X_SLAVE );
+        if( bus_errors != errors )
+            return -1;
+        eeprom_status_loaded = true;
+    }
+
+    *status = eeprom_status;
+    return 0;
+}
+
+int rtc_eeprom_set_protect( rtc_eeprom_protect_t region )
+{
+    uint8_t status;
+    uint16_t errors = bus_errors;
+
+    TRACE_OP( RTC_OP_EEPROM );
+
+    if( current_type != RTC6_MCP7941X || region > RTC_EEPROM_PROTECT_ALL ||
+        eeprom_status_get( &status ) )
+        return -1;
+
+    status = ( status & ~RTC6_EEPROM_BP_MASK ) |
+             ( region << RTC6_EEPROM_BP_SHIFT );
+    if( status == eeprom_status )
+        return 0;
+
+    bus_slave( RTC6_MCP7941X_EEPROM_SLAVE );
+    bus_write( RTC6_EEPROM_STATUS, &status, 1 );
+    rtc_hal_delay( RTC6_EEPROM_WRITE_MS );
+    bus_slave( RTC6_MCP7941X_SLAVE );
+
+    if( bus_errors != errors )
+    {
+        eeprom_status_loaded = false;
+        return -1;
+    }
+
+    eeprom_status = status;
+    return 0;
+}
+
+int rtc_eeprom_get_protect()
+{
+    uint8_t status;
+
+    TRACE_OP( RTC_OP_EEPROM );
+
+    if( current_type != RTC6_MCP7941X || eeprom_status_get( &status ) )
+        return -1;
+
+    return ( status & RTC6_EEPROM_BP_MASK ) >> RTC6_EEPROM_BP_SHIFT;
+}
+
+void rtc_eeprom_write_protect_on()
+{
+    rtc_eeprom_set_protect( RTC_EEPROM_PROTECT_ALL );
+}
+
+void rtc_eeprom_write_protect_off()
+{
+    rtc_eeprom_set_protect( RTC_EEPROM_PROTECT_NONE );
+}
+
+bool rtc_eeprom_is_locked()
+{
+    return ( rtc_eeprom_get_protect() == RTC_EEPROM_PROTECT_ALL ) ? true : false;
+}
+
+int rtc_eeprom_write_block( uint16_t addr, const void *data_in, size_t size )
+{
+    const uint8_t *data = ( const uint8_t * )data_in;
+    uint16_t errors = bus_errors;
+    size_t chunk;
+    size_t protect_start;
+    int region;
+
+    TRACE_OP( RTC_OP_EEPROM );
+
+    if( current_type != RTC6_MCP7941X || addr > RTC6_EEPROM_END ||
+        size > ( size_t )( RTC6_EEPROM_END - addr ) )
+        return -1;
+
+    // writes to a protected region are acknowledged and dropped
+    region = rtc_eeprom_get_protect();
+    if( region < 0 )
+        return -1;
+    protect_start = RTC6_EEPROM_SIZE - ( RTC6_EEPROM_SIZE >> ( 3 - region ) );
+    if( region && size && addr + size > protect_start )
+        return -1;
+
+    bus_slave( RTC6_MCP7941X_EEPROM_SLAVE );
+    while( size && bus_errors == errors )
+    {
+        // a page write wraps inside its page, split at the boundaries
+        chunk = RTC6_EEPROM_PAGE_SIZE - addr % RTC6_EEPROM_PAGE_SIZE;
+        if( chunk > size )
+            chunk = size;
+
+        bus_write( addr, ( void * )data, chunk );
+        rtc_hal_delay( RTC6_EEPROM_WRITE_MS );
+        addr += chunk;
+        data += chunk;
+        size -= chunk;
+    }
+    bus_slave( RTC6_MCP7941X_SLAVE );
+
+    return ( bus_errors != errors ) ? -1 : 0;
+}
+
+int rtc_eeprom_read_block( uint16_t addr, void *data_out, size_t size )
+{
+    uint16_t errors = bus_errors;
+
+    TRACE_OP( RTC_OP_EEPROM );
+
+    if( current_type != RTC6_MCP7941X || addr > RTC6_EEPROM_END ||
+        size > ( size_t )( RTC6_EEPROM_END - addr ) )
+        return -1;
+
+    // sequential reads run across pages
+    bus_slave( RTC6_MCP7941X_EEPROM_SLAVE );
+    bus_read( addr, data_out, size );
+    bus_slave( RTC6_MCP7941X_SLAVE );
+
+    return ( bus_errors != errors ) ? -1 : 0;
+}
+
+bool rtc_write_eeprom( uint8_t addr, void *data_in, uint8_t data_size )
+{
+    return rtc_eeprom_write_block( addr, data_in, data_size ) ? false : true;
+}
+
+void rtc_read_eeprom( uint8_t addr, void *data_out, uint8_t data_size )
+{
+    rtc_eeprom_read_block( addr, data_out, data_size );
+}
+
+/*
+ * Register start and size of a memory on the current chip
+ */
+static int mem_range( rtc_mem_t mem, uint8_t *start, uint16_t *size )
+{
+    if( mem == RTC_MEM_EEPROM )
+    {
+        if( current_type != RTC6_MCP7941X )
+            return -1;
+        *start = RTC6_EEPROM_START;
+        *size = RTC6_EEPROM_SIZE;
+        return 0;
+    }
+
+    switch( current_type )
+    {
+        case RTC2_DS1307:
+            *start = RTC2_RAM_START;
+            *size = RTC2_RAM_SIZE;
+            return 0;
+        case RTC6_MCP7941X:
+            *start = RTC6_RAM_START;
+            *size = RTC6_RAM_SIZE;
+            return 0;
+        case RTC_DS3231:
+            *start = RTC_DS3231_RAM_START;
+            *size = RTC_DS3231_RAM_SIZE;
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+int rtc_cursor_open( rtc_cursor_t *cursor, rtc_mem_t mem, uint16_t addr,
+                     uint16_t size )
+{
+    uint8_t start;
+    uint16_t mem_size;
+
+    if( mem_range( mem, &start, &mem_size ) || addr > mem_size )
+        return -1;
+
+    if( !size )
+        size = mem_size - addr;
+    if( size > mem_size - addr )
+        return -1;
+
+    cursor->mem = mem;
+    cursor->pos = addr;
+    cursor->end = addr + size;
+
+    return 0;
+}
+
+int rtc_cursor_read( rtc_cursor_t *cursor, void *data_out, uint16_t max )
+{
+    uint8_t start;
+    uint16_t size;
+    uint16_t errors = bus_errors;
+
+    TRACE_OP( cursor->mem == RTC_MEM_EEPROM ? RTC_OP_EEPROM : RTC_OP_SRAM );
+
+    if( mem_range( cursor->mem, &start, &size ) ||
+        cursor->end > size )
+        return -1;
+
+    size = cursor->end - cursor->pos;
+    if( size > max )
+        size = max;
+    if( !size )
+        return 0;
+
+    // the address pointer keeps counting, one transfer however long
+    if( cursor->mem == RTC_MEM_EEPROM )
+        bus_slave( RTC6_MCP7941X_EEPROM_SLAVE );
+    bus_read( start + cursor->pos, data_out, size );
+    if( cursor->mem == RTC_MEM_EEPROM )
+        bus_slave( RTC6_MCP7941X_SLAVE );
+
+    if( bus_errors != errors )
+        return -1;
+
+    cursor->pos += size;
+    return size;
+}
+
+static void cursor_sink( uint8_t data, void *arg )
+{
+    cursor_sink_t *sink = ( cursor_sink_t * )arg;
 
-                rtc_hal_read( 0x07, &temp, 1 );
-                //              temp |= (1<<7);
-                temp &= ~( 1 << 6 ); // disable SQWO
-                temp |= ( 1 << 5 ); // activate alarm 1
-                rtc_hal_write( 0x07, &temp, 1 );
-                break;
-        }
+    sink->buffer[sink->fill++] = data;
+    if( sink->fill == sink->size )
+    {
+        sink->cb( sink->buffer, sink->fill, sink->arg );
+        sink->flushed += sink->fill;
+        sink->fill = 0;
     }
+}
+
+int rtc_cursor_stream( rtc_cursor_t *cursor, uint8_t *buffer,
+                       uint16_t buffer_size, rtc_chunk_cb_t cb, void *arg )
+{
+    cursor_sink_t sink;
+    uint8_t start;
+    uint16_t size;
+    uint16_t errors = bus_errors;
 
+    TRACE_OP( cursor->mem == RTC_MEM_EEPROM ? RTC_OP_EEPROM : RTC_OP_SRAM );
 
-}
+    if( mem_range( cursor->mem, &start, &size ) ||
+        cursor->end > size )
+        return -1;
+
+    size = cursor->end - cursor->pos;
+    if( !size || !buffer_size )
+        return 0;
+
+    sink.buffer = buffer;
+    sink.size = buffer_size;
+    sink.fill = 0;
+    sink.flushed = 0;
+    sink.cb = cb;
+    sink.arg = arg;
+
+    // one transfer for the rest of the range, the buffer only sets the chunks
+    if( cursor->mem == RTC_MEM_EEPROM )
+        bus_slave( RTC6_MCP7941X_EEPROM_SLAVE );
+    if( rtc_hal_read_stream( start + cursor->pos, size, cursor_sink, &sink ) )
+        bus_errors++;
+    if( cursor->mem == RTC_MEM_EEPROM )
+        bus_slave( RTC6_MCP7941X_SLAVE );
+
+    // a partial chunk is dropped on failure and read again next time
+    cursor->pos += sink.flushed;
+    if( bus_errors != errors )
+        return -1;
 
+    if( sink.fill )
+        cb( buffer, sink.fill, arg );
+    cursor->pos = cursor->end;
 
-void rtc_disable_alarm( rtc_alarm_t alarm )
+    return 0;
+}
+
+uint8_t rtc_crc8( uint8_t crc, const void *data, size_t size )
 {
-    uint8_t temp;
-    switch( current_type )
+    const uint8_t *p = ( const uint8_t * )data;
+
+    while( size-- )
     {
-        case RTC_PCF8583:
-            rtc_hal_read( 0x00, &temp, 1 );
-            temp |= ( 1 << 2 );
-            rtc_hal_write( 0x00, &temp, 1 );
-            break;
-        case RTC2_DS1307:
-            // Not supported
-            break;
-        case RTC3_BQ32000:
-            // not supported
-            break;
-        case RTC6_MCP7941X:
-            rtc_hal_read( 0x07, &temp, 1 );
-            switch( alarm )
-            {
-                case RTC_ALARM_0:
-                    temp &= ~( 1 << 4 );
-                    rtc_hal_write( 0x07, &temp, 1 );
-                    break;
-                case RTC_ALARM_1:
-                    temp &= ~( 1 << 5 );
-                    rtc_hal_write( 0x07, &temp, 1 );
-                    break;
-            }
-            break;
+        CRC8_BYTE( crc, *p );
+        p++;
     }
+
+    return crc;
 }
 
+uint16_t rtc_crc16( uint16_t crc, const void *data, size_t size )
+{
+    const uint8_t *p = ( const uint8_t * )data;
 
-rtc_time_t *rtc_read_alarm( rtc_alarm_t alarm )
+    while( size-- )
+    {
+        CRC16_BYTE( crc, *p );
+        p++;
+    }
+
+    return crc;
+}
+
+/*
+ * Copies size bytes and returns their record CRC, one pass over the data.
+ * Records start from all ones so an all zero record never checks out.
+ */
+static uint16_t record_copy( uint8_t *dst, const uint8_t *src, uint8_t size )
 {
-    uint8_t buffer[6];
-    static rtc_time_t temp_time = {0};
+#ifdef RTC_RECORD_CRC8
+    uint8_t crc = 0xFF;
 
-    switch( current_type )
+    while( size-- )
     {
-        case RTC_PCF8583:
-        {
-            rtc_hal_read( 0x0A, &temp_time.seconds, 1 );
-            rtc_hal_read( 0x0B, &temp_time.minutes, 1 );
-            rtc_hal_read( 0x0C, &temp_time.hours, 1 );
-            rtc_hal_read( 0x0D, &temp_time.monthday, 1 );
-            rtc_hal_read( 0x0E, &temp_time.month, 1 );
+        CRC8_BYTE( crc, *src );
+        *dst++ = *src++;
+    }
+#else
+    uint16_t crc = 0xFFFF;
 
-            return &temp_time;
-            break;
-        }
-        case RTC2_DS1307:
-            // Not supported
-            return &temp_time;
-            break;
-        case RTC3_BQ32000:
-            // not supported
-            return &temp_time;
-            break;
-        case RTC6_MCP7941X:
-            switch( alarm )
-            {
-                case RTC_ALARM_0:
-                    rtc_hal_read( 0x0A, &buffer, 6 );
-                    temp_time.seconds = BCD2BIN( RTC_SECONDS_MASK( buffer[RTC_SECONDS_BYTE] ) );
-                    temp_time.minutes = BCD2BIN( RTC_MINUTES_MASK( buffer[RTC_MINUTES_BYTE] ) );
-                    temp_time.hours = BCD2BIN( RTC_HOURS_MASK( buffer[RTC_HOUR_BYTE] ) );
-                    temp_time.weekday = BCD2BIN( RTC_DAY_MASK( buffer[RTC_DAY_BYTE] ) );
-                    temp_time.monthday = BCD2BIN( RTC_DATE_MASK( buffer[RTC_DATE_BYTE] ) );
-                    temp_time.month = BCD2BIN( RTC_MONTH_MASK( buffer[RTC_MONTH_BYTE] ) );
-                    break;
-                case RTC_ALARM_1:
-                    rtc_hal_read( 0x11, &buffer, 6 );
-                    temp_time.seconds = BCD2BIN( RTC_SECONDS_MASK( buffer[RTC_SECONDS_BYTE] ) );
-                    temp_time.minutes = BCD2BIN( RTC_MINUTES_MASK( buffer[RTC_MINUTES_BYTE] ) );
-                    temp_time.hours = BCD2BIN( RTC_HOURS_MASK( buffer[RTC_HOUR_BYTE] ) );
-                    temp_time.weekday = BCD2BIN( RTC_DAY_MASK( buffer[RTC_DAY_BYTE] ) );
-                    temp_time.monthday = BCD2BIN( RTC_DATE_MASK( buffer[RTC_DATE_BYTE] ) );
-                    temp_time.month = BCD2BIN( RTC_MONTH_MASK( buffer[RTC_MONTH_BYTE] ) );
-                    break;
-            }
-            return &temp_time;
-            break;
+    while( size-- )
+    {
+        CRC16_BYTE( crc, *src );
+        *dst++ = *src++;
     }
+#endif
+
+    return crc;
+}
+
+static int mem_write( rtc_mem_t mem, uint16_t addr, void *data_in,
+                      uint16_t size )
+{
+    uint8_t start;
+    uint16_t mem_size;
+
+    if( mem_range( mem, &start, &mem_size ) || addr > mem_size ||
+        size > mem_size - addr )
+        return -1;
+
+    if( mem == RTC_MEM_EEPROM )
+        return rtc_eeprom_write_block( addr, data_in, size );
+
+    TRACE_OP( RTC_OP_SRAM );
+    return nv_write( start + addr, data_in, size );
+}
+
+static int mem_read( rtc_mem_t mem, uint16_t addr, void *data_out,
+                     uint16_t size )
+{
+    rtc_cursor_t cursor;
+
+    if( rtc_cursor_open( &cursor, mem, addr, size ) ||
+        rtc_cursor_read( &cursor, data_out, size ) != size )
+        return -1;
 
     return 0;
 }
 
+int rtc_record_write( rtc_mem_t mem, uint16_t addr, const void *data_in,
+                      uint8_t size )
+{
+    uint8_t frame[RTC_RECORD_MAX + RTC_RECORD_CRC_SIZE];
+    uint16_t crc;
 
-/****************************************
- ********* Memory ***********************
- ***************************************/
-void rtc_write_sram( uint8_t addr, uint8_t data_in )
+    if( size > RTC_RECORD_MAX )
+        return -1;
+
+    crc = record_copy( frame, ( const uint8_t * )data_in, size );
+    frame[size] = crc & 0xFF;
+#ifndef RTC_RECORD_CRC8
+    frame[size + 1] = crc >> 8;
+#endif
+
+    return mem_write( mem, addr, frame, size + RTC_RECORD_CRC_SIZE );
+}
+
+/*
+ * Copies the record out of a frame read from the chip and checks its CRC
+ */
+static int record_check( uint8_t *dst, const uint8_t *frame, uint8_t size )
 {
-    switch( current_type )
+    uint16_t crc = record_copy( dst, frame, size );
+
+#ifdef RTC_RECORD_CRC8
+    return ( frame[size] == crc ) ? 0 : -1;
+#else
+    return ( frame[size] == ( crc & 0xFF ) && frame[size + 1] == ( crc >> 8 ) ) ? 0 : -1;
+#endif
+}
+
+static void record_sink( uint8_t data, void *arg )
+{
+    record_sink_t *sink = ( record_sink_t * )arg;
+
+    if( sink->count < sink->size )
     {
-        case RTC2_DS1307:
-            if( addr + RTC2_RAM_START < RTC2_RAM_END )
-                rtc_hal_write( RTC2_RAM_START + addr, &data_in, 1 );
-            break;
-        case RTC6_MCP7941X:
-            if( addr + RTC6_RAM_START < RTC6_RAM_END )
-            {
-                rtc_hal_set_slave( RTC6_MCP7941X_SRAM_SLAVE );
-                rtc_hal_write( RTC6_RAM_START + addr, &data_in, 1 );
-                rtc_hal_set_slave( RTC6_MCP7941X_SLAVE );
-            }
-            break;
+#ifdef RTC_RECORD_CRC8
+        CRC8_BYTE( sink->crc, data );
+#else
+        CRC16_BYTE( sink->crc, data );
+#endif
+        sink->dst[sink->count] = data;
     }
+    else
+        sink->stored[sink->count - sink->size] = data;
+    sink->count++;
 }
 
-void rtc_write_sram_bulk( uint8_t addr, void *data_in, size_t data_size )
+int rtc_record_read( rtc_mem_t mem, uint16_t addr, void *data_out,
+                     uint8_t size )
 {
-    switch( current_type )
-    {       
-        case RTC2_DS1307:
-            if( addr + RTC2_RAM_START + data_size < RTC2_RAM_END )
-            {
-                rtc_hal_write( RTC2_RAM_START + addr, data_in, data_size );
-            }
-            break;
-        case RTC6_MCP7941X:
-            if( addr + RTC6_RAM_START + data_size < RTC6_RAM_END )
-            {
-                rtc_hal_set_slave( RTC6_MCP7941X_SRAM_SLAVE );
-                rtc_hal_write( RTC6_RAM_START + addr, data_in, data_size );
-                rtc_hal_set_slave( RTC6_MCP7941X_SLAVE );
-            }
-            break;
+    record_sink_t sink;
+    uint8_t start;
+    uint16_t mem_size;
+    int result;
+
+    TRACE_OP( mem == RTC_MEM_EEPROM ? RTC_OP_EEPROM : RTC_OP_SRAM );
+
+    if( size > RTC_RECORD_MAX || mem_range( mem, &start, &mem_size ) ||
+        addr > mem_size || size + RTC_RECORD_CRC_SIZE > mem_size - addr )
+        return -1;
+
+    sink.dst = ( uint8_t * )data_out;
+    sink.size = size;
+    sink.count = 0;
+#ifdef RTC_RECORD_CRC8
+    sink.crc = 0xFF;
+#else
+    sink.crc = 0xFFFF;
+#endif
+
+    // record and CRC in one transfer, no frame buffer
+    if( mem == RTC_MEM_EEPROM )
+        bus_slave( RTC6_MCP7941X_EEPROM_SLAVE );
+    result = rtc_hal_read_stream( start + addr, size + RTC_RECORD_CRC_SIZE,
+                                  record_sink, &sink );
+    if( mem == RTC_MEM_EEPROM )
+        bus_slave( RTC6_MCP7941X_SLAVE );
+
+    if( result )
+    {
+        bus_errors++;
+        return -1;
     }
+
+#ifdef RTC_RECORD_CRC8
+    return ( sink.stored[0] == sink.crc ) ? 0 : -1;
+#else
+    return ( sink.stored[0] == ( sink.crc & 0xFF ) &&
+             sink.stored[1] == ( sink.crc >> 8 ) ) ? 0 : -1;
+#endif
 }
 
+/*
+ * Layout: sequence byte, then slots A and B each holding a record. The
+ * low bit of the sequence selects the slot with the committed copy.
+ */
+int rtc_commit_write( uint16_t addr, const void *data_in, uint8_t size )
+{
+    uint8_t seq;
 
-uint8_t rtc_read_sram( uint8_t addr )
+    if( size > RTC_COMMIT_MAX ||
+        mem_read( RTC_MEM_SRAM, addr, &seq, 1 ) )
+        return -1;
+
+    // the new copy goes to the inactive slot, the single byte write of the
+    // sequence is the commit, a power loss before it keeps the old copy
+    seq++;
+    if( rtc_record_write( RTC_MEM_SRAM,
+                          addr + 1 + ( seq & 1 ) * ( size + RTC_RECORD_CRC_SIZE ),
+                          data_in, size ) )
+        return -1;
+
+    return mem_write( RTC_MEM_SRAM, addr, &seq, 1 );
+}
+
+int rtc_commit_read( uint16_t addr, void *data_out, uint8_t size )
 {
-    uint8_t temp = 0;
+    uint8_t frame[RTC_COMMIT_SIZE( RTC_COMMIT_MAX )];
+    uint8_t slot;
 
-    switch( current_type )
-    {        
-        case RTC2_DS1307:
-            if( addr + RTC2_RAM_START < RTC2_RAM_END )
-                rtc_hal_read( RTC2_RAM_START + addr, &temp, 1 );
-        break;
-        case RTC6_MCP7941X:
-            if( addr + RTC6_RAM_START < RTC6_RAM_END )
-            {
-                rtc_hal_set_slave( RTC6_MCP7941X_SRAM_SLAVE );
-                rtc_hal_read ( RTC6_RAM_START + addr, &temp, 1 );
-                rtc_hal_set_slave( RTC6_MCP7941X_SLAVE );
-            }
-            break;
-    }
+    if( size > RTC_COMMIT_MAX ||
+        mem_read( RTC_MEM_SRAM, addr, frame, RTC_COMMIT_SIZE( size ) ) )
+        return -1;
 
-    return temp;
+    slot = frame[0] & 1;
+    if( !record_check( ( uint8_t * )data_out,
+                       &frame[1 + slot * ( size + RTC_RECORD_CRC_SIZE )], size ) )
+        return 0;
+
+    // committed slot damaged after the fact, the other one is a version older
+    slot ^= 1;
+    if( record_check( ( uint8_t * )data_out,
+                      &frame[1 + slot * ( size + RTC_RECORD_CRC_SIZE )], size ) )
+        return -1;
+
+    return 1;
 }
 
+uint32_t rtc_pack_time( const rtc_time_t *time )
+{
+    uint32_t epoch = cal_to_epoch( time );
+
+    return ( epoch > RTC_PACK_EPOCH ) ? epoch - RTC_PACK_EPOCH : 0;
+}
 
-void rtc_read_sram_bulk( uint8_t addr, void *data_out, uint8_t data_size )
+void rtc_unpack_time( uint32_t packed, rtc_time_t *time )
 {
-    switch( current_type )
-    {
-        case RTC2_DS1307:
-            if( addr + RTC2_RAM_START + data_size < RTC2_RAM_END )
-                rtc_hal_read( RTC2_RAM_START + addr, data_out, data_size );
-            break;
-        case RTC6_MCP7941X:
-            if( addr + RTC6_RAM_START + data_size < RTC6_RAM_END )
-            {
-                rtc_hal_set_slave( RTC6_MCP7941X_SRAM_SLAVE );
-                rtc_hal_read( RTC6_RAM_START + addr, data_out, data_size );
-                rtc_hal_set_slave( RTC6_MCP7941X_SLAVE );
-            }
-            break;
-    }
+    cal_from_epoch( packed + RTC_PACK_EPOCH, time );
 }
 
-void rtc_eeprom_write_protect_on()
+/*
+ * Little endian seconds since RTC_PACK_EPOCH, hundredths in the 5th byte
+ */
+static int stamp_pack( const rtc_stamp_t *stamp, uint8_t *buffer, uint8_t size )
 {
-    if( current_type == RTC6_MCP7941X )
-    {
-        uint8_t temp;
-        rtc_hal_set_slave( RTC6_MCP7941X_EEPROM_SLAVE );
-        rtc_hal_read( 0xff, &temp, 1 );
-        temp |= ( 1 << 3 ) | ( 1 << 2 );
-        rtc_hal_write( 0xff, &temp, 1 );
-        rtc_hal_set_slave( RTC6_MCP7941X_SLAVE );
-    }
+    uint32_t packed;
+    uint8_t i;
+
+    if( ( size != RTC_PACKED_SIZE && size != RTC_PACKED_HUNDREDTHS_SIZE ) ||
+        stamp->epoch < RTC_PACK_EPOCH )
+        return -1;
+
+    packed = stamp->epoch - RTC_PACK_EPOCH;
+    for( i = 0; i < 4; i++ )
+        buffer[i] = ( packed >> ( i * 8 ) ) & 0xFF;
+    buffer[4] = stamp->hundredths;
+
+    return 0;
 }
 
-void rtc_eeprom_write_protect_off()
+static int stamp_unpack( const uint8_t *buffer, rtc_stamp_t *stamp, uint8_t size )
 {
-    if( current_type == RTC6_MCP7941X )
-    {
-        uint8_t temp;
-        rtc_hal_set_slave( RTC6_MCP7941X_EEPROM_SLAVE );
-        rtc_hal_read( 0xff, &temp, 1 );
-        temp &= ~( 1 << 3 ) | ( 1 << 2 );
-        rtc_hal_write( 0xff, &temp, 1 );
-        rtc_hal_set_slave( RTC6_MCP7941X_SLAVE );
-    }
+    uint32_t packed = 0;
+    uint8_t i;
+
+    if( size != RTC_PACKED_SIZE && size != RTC_PACKED_HUNDREDTHS_SIZE )
+        return -1;
+
+    for( i = 0; i < 4; i++ )
+        packed |= ( uint32_t )buffer[i] << ( i * 8 );
+    stamp->epoch = packed + RTC_PACK_EPOCH;
+    stamp->hundredths = ( size == RTC_PACKED_HUNDREDTHS_SIZE ) ? buffer[4] : 0;
+
+    return 0;
 }
 
-bool rtc_eeprom_is_locked()
+/*
+ * mem_write() and mem_read() reject chips without the memory and ranges
+ * past its end, which the bulk SRAM calls skip silently
+ */
+int rtc_write_stamp_sram( uint8_t addr, const rtc_stamp_t *stamp, uint8_t size )
 {
-    if( current_type == RTC6_MCP7941X )
-    {
-        uint8_t temp;
-        rtc_hal_set_slave( RTC6_MCP7941X_EEPROM_SLAVE );
-        rtc_hal_read( 0xff, &temp, 1 );
-        rtc_hal_set_slave( RTC6_MCP7941X_SLAVE );
-        return ( temp & ( 1 << 3 ) | ( 1 << 2 ) ) ? true : false;
-    }
-    
-    return false;
+    uint8_t buffer[RTC_PACKED_HUNDREDTHS_SIZE];
+
+    if( stamp_pack( stamp, buffer, size ) )
+        return -1;
+
+    return mem_write( RTC_MEM_SRAM, addr, buffer, size );
 }
 
-bool rtc_write_eeprom( uint8_t addr, void *data_in, uint8_t data_size )
+int rtc_read_stamp_sram( uint8_t addr, rtc_stamp_t *stamp, uint8_t size )
 {
-    if( current_type == RTC6_MCP7941X )
-    {
-        if( ( addr >= RTC6_EEPROM_START ) &&
-            ( addr + data_size ) < RTC6_EEPROM_END )
-        {
-            rtc_hal_set_slave( RTC6_MCP7941X_EEPROM_SLAVE );
-                
-            if( data_size <= RTC6_EEPROM_PAGE_SIZE )
-                rtc_hal_write( addr, data_in, data_size );
-            else {
-                int i;
-                uint8_t count = data_size / RTC6_EEPROM_PAGE_SIZE;
-                uint8_t rem = data_size % RTC6_EEPROM_PAGE_SIZE;
-                    
-                for( i = 0; i < count; i++ )
-                    rtc_hal_write( addr + ( i * 8 ), data_in + ( i * 8 ), RTC6_EEPROM_PAGE_SIZE );
-
-                if( rem )
-                    rtc_hal_write( addr + ( count * 8 ), data_in + ( i * 8 ), rem );
-            }
-                
-                rtc_hal_set_slave( RTC6_MCP7941X_SLAVE );
-        }
-    }
+    uint8_t buffer[RTC_PACKED_HUNDREDTHS_SIZE];
+
+    if( size != RTC_PACKED_SIZE && size != RTC_PACKED_HUNDREDTHS_SIZE )
+        return -1;
+
+    if( mem_read( RTC_MEM_SRAM, addr, buffer, size ) )
+        return -1;
 
-    return true;
+    return stamp_unpack( buffer, stamp, size );
 }
 
+int rtc_write_stamp_eeprom( uint8_t addr, const rtc_stamp_t *stamp, uint8_t size )
+{
+    uint8_t buffer[RTC_PACKED_HUNDREDTHS_SIZE];
+
+    if( stamp_pack( stamp, buffer, size ) )
+        return -1;
 
-void rtc_read_eeprom( uint8_t addr, void *data_out, uint8_t data_size )
+    return mem_write( RTC_MEM_EEPROM, addr, buffer, size );
+}
+
+int rtc_read_stamp_eeprom( uint8_t addr, rtc_stamp_t *stamp, uint8_t size )
 {
-    if( current_type == RTC6_MCP7941X )
-    {
-        if( ( data_size < RTC6_EEPROM_SIZE ) &&
-            ( ( addr + data_size ) < RTC6_EEPROM_END ) &&
-            ( addr >= RTC6_EEPROM_START ) )
-        {
-            rtc_hal_set_slave( RTC6_MCP7941X_EEPROM_SLAVE );
-            rtc_hal_read( addr, data_out, data_size );
-            rtc_hal_set_slave( RTC6_MCP7941X_SLAVE );
-        }
-    }
+    uint8_t buffer[RTC_PACKED_HUNDREDTHS_SIZE];
+
+    if( size != RTC_PACKED_SIZE && size != RTC_PACKED_HUNDREDTHS_SIZE )
+        return -1;
+
+    if( mem_read( RTC_MEM_EEPROM, addr, buffer, size ) )
+        return -1;
+
+    return stamp_unpack( buffer, stamp, size );
 }
 
 uint8_t *rtc_read_unique_id()
 {
-    if( current_type == RTC6_MCP7941X )
+    uint16_t errors = bus_errors;
+
+    TRACE_OP( RTC_OP_EEPROM );
+
+    if( current_type != RTC6_MCP7941X )
+        return NULL;
+
+    if( !unique_id_loaded )
     {
-        static uint8_t unique_id[8];
-        rtc_hal_set_slave( RTC6_MCP7941X_EEPROM_SLAVE );
-        rtc_hal_read( 0xF0, unique_id, 8 );
-        rtc_hal_set_slave( RTC6_MCP7941X_SLAVE );
-        
-        return unique_id;
+        bus_slave( RTC6_MCP7941X_EEPROM_SLAVE );
+        bus_read( RTC6_EEPROM_ID_ADDR, unique_id, RTC6_EEPROM_ID_SIZE );
+        bus_slave( RTC6_MCP7941X_SLAVE );
+        if( bus_errors != errors )
+            return NULL;
+        unique_id_loaded = true;
     }
-    
-    return 0;
+
+    return unique_id;
 }
 
 void rtc_write_unique_id( uint8_t *id )
 {
-    #define RTC6_EEPROM_ID_UNLOCK_ADR 0x09
-    if( current_type == RTC6_MCP7941X )
-    {
-        uint8_t temp = 0x55;
-        
-        if( id == NULL )
-            return;
-        
-        rtc_hal_set_slave( RTC6_MCP7941X_EEPROM_SLAVE );
-        // Unlock EEPROM Unique ID
-        rtc_hal_write( RTC6_EEPROM_ID_UNLOCK_ADR, &temp, 1 );
-        temp = 0xAA;
-        rtc_hal_write( RTC6_EEPROM_ID_UNLOCK_ADR, &temp, 1 );
-        // Write ID
-        rtc_hal_write( 0xF0, id, 8 );
-        rtc_hal_set_slave( RTC6_MCP7941X_SLAVE );
-    }
+    uint8_t temp = 0x55;
+
+    TRACE_OP( RTC_OP_EEPROM );
+
+    if( current_type != RTC6_MCP7941X || id == NULL )
+        return;
+
+    // Unlock EEPROM Unique ID, EEUNLOCK is an RTCC register
+    bus_write( RTC6_EEUNLOCK, &temp, 1 );
+    temp = 0xAA;
+    bus_write( RTC6_EEUNLOCK, &temp, 1 );
+    // Write ID
+    bus_slave( RTC6_MCP7941X_EEPROM_SLAVE );
+    bus_write( RTC6_EEPROM_ID_ADDR, id, RTC6_EEPROM_ID_SIZE );
+    rtc_hal_delay( RTC6_EEPROM_WRITE_MS );
+    bus_slave( RTC6_MCP7941X_SLAVE );
+    unique_id_loaded = false;
 }
 
 /*************** END OF FUNCTIONS ***************************************************************************/
\ No newline at end of file
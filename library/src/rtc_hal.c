@@ -22,18 +22,90 @@
 #include <stddef.h>
 #include <string.h>
 #include "rtc_hal.h"
+#if defined( __linux__ ) && !defined( RTC_HAL_FAKE )
+#define LINUX_I2C
+#endif
+#if defined( LINUX_I2C )
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#endif
 /******************************************************************************
 * Module Preprocessor Constants
 *******************************************************************************/
+#if defined( __MIKROC_PRO_FOR_AVR__ ) || defined( __MIKROC_PRO_FOR_8051__ )
+#define TWI_STATUS_MASK         0xF8    // low bits hold the prescaler
+#define TWI_SLA_W_ACK           0x18
+#define TWI_DATA_ACK            0x28
+#define TWI_SLA_R_ACK           0x40
+#endif
+#if defined( LINUX_I2C )
+#define LINUX_BATCH_READS       16      // two messages each, I2C_RDWR takes 42
+#define LINUX_WRITE_MAX         256     // the whole 8-bit register space
+#endif
 
 /******************************************************************************
 * Module Preprocessor Macros
 *******************************************************************************/
 #define WRITE 0
 #define READ  1
+
+/*
+ * Primitives of the byte-wise backends, bytewise_transfer() drives them.
+ * Vendor byte writes return 0 on ACK, the AVR and 8051 ones return nothing
+ * and the TWI status tells.
+ */
+#if defined( __MIKROC_PRO_FOR_AVR__ ) || defined( __MIKROC_PRO_FOR_8051__ )
+#define BYTEWISE
+#define BUS_START()         i2c_start_p()
+#define BUS_RESTART()       i2c_start_p()
+#define BUS_STOP()          i2c_stop_p()
+#define BUS_WRITE( b )      ( i2c_write_p( b ), twi_acked() )
+#define BUS_READ( ack )     i2c_read_p( ( ack ) ? 1 : 0 )
+#elif defined( __MIKROC_PRO_FOR_PIC__ )
+#define BYTEWISE
+#define BUS_START()         i2c_start_p()
+#define BUS_RESTART()       i2c_restart_p()
+#define BUS_STOP()          i2c_stop_p()
+#define BUS_WRITE( b )      ( i2c_write_p( b ) == 0 )
+#define BUS_READ( ack )     i2c_read_p( ( ack ) ? 1 : 0 )
+#elif defined( __MIKROC_PRO_FOR_PIC32__ ) || defined( __MIKROC_PRO_FOR_DSPIC__ )
+#define BYTEWISE
+#define BUS_START()         i2c_start_p()
+#define BUS_RESTART()       i2c_restart_p()
+#define BUS_STOP()          i2c_stop_p()
+#define BUS_WRITE( b )      ( i2c_write_p( b ) == 0 )
+#define BUS_READ( ack )     i2c_read_p( ( ack ) ? 0 : 1 )    // 0 acknowledges
+#elif defined( RTC_HAL_FAKE )
+#define BYTEWISE
+#define BUS_START()         rtc_hal_fake_start()
+#define BUS_RESTART()       rtc_hal_fake_start()
+#define BUS_STOP()          rtc_hal_fake_stop()
+#define BUS_WRITE( b )      rtc_hal_fake_write( b )
+#define BUS_READ( ack )     rtc_hal_fake_read( ack )
+#endif
 /******************************************************************************
 * Module Typedefs
 *******************************************************************************/
+#if defined( BYTEWISE )
+typedef enum
+{
+    BUS_SEND_START,
+    BUS_SEND_ADDRESS,
+    BUS_SEND_REGISTER,
+    BUS_SEND_DATA,
+    BUS_SEND_RESTART,
+    BUS_RECEIVE_DATA,
+    BUS_FAILED,
+    BUS_SEND_STOP,
+    BUS_DONE
+} bus_state_t;
+#endif
+
 #if defined( __MIKROC_PRO_FOR_ARM__ )
 
 
@@ -124,13 +196,31 @@ static void ( *write_bytes_spi_p )( unsigned char *data_out,
                                     unsigned int count );
 static void ( *read_bytes_spi_p )( unsigned char *buffer,
                                    unsigned int count );
+
+#elif defined( LINUX_I2C )
+static int i2c_fd = -1;
 #endif
 /******************************************************************************
 * Module Variable Definitions
 *******************************************************************************/
 static uint8_t _i2c_address;
+static const rtc_hal_recovery_t *recovery_p;
+static rtc_hal_clock_t clock_p;
+static uint16_t clock_khz;          // wanted by the slave
+static uint16_t clock_set_khz;      // last passed to clock_p, 0 if unknown
+
+#ifdef RTC_HAL_TRACE
+// volatile keeps the entry stores ahead of the head increment
+static volatile rtc_hal_trace_t trace_ring[RTC_HAL_TRACE_SIZE];
+static volatile uint16_t trace_head;
+static uint8_t trace_current_op;
+static uint8_t trace_holds;
+static uint8_t trace_slave;     // 7-bit, _i2c_address is shifted on some targets
+static uint32_t ( *trace_tick_p )( void );
+#endif
 
 #define DUMMY                                                           0x00
+#define TRACE_FAILED                                                    0x80
 #if   defined( __MIKROC_PRO_FOR_ARM__ )
 #elif defined( __MIKROC_PRO_FOR_AVR__ )
 #elif defined( __MIKROC_PRO_FOR_PIC__ )
@@ -154,6 +244,30 @@ static uint8_t _i2c_address;
 * Function Prototypes
 *******************************************************************************/
 //static void advanced_init( uint8_t interface );
+#if defined( BYTEWISE )
+static int bytewise_transfer( uint8_t address, uint8_t *data, size_t num_bytes,
+                              uint8_t dir, rtc_hal_stream_t stream, void *arg );
+#endif
+#if defined( __MIKROC_PRO_FOR_AVR__ ) || defined( __MIKROC_PRO_FOR_8051__ )
+static bool twi_acked( void );
+#endif
+static int write_once( uint8_t address, void *data_in, size_t num_bytes );
+static int read_once( uint8_t address, void *data_out, size_t num_bytes );
+#if defined( BYTEWISE ) || defined( TIVA )
+static int stream_once( uint8_t address, size_t num_bytes,
+                        rtc_hal_stream_t cb, void *arg, size_t *delivered );
+#endif
+static bool retry_wait( uint8_t attempt );
+static void clock_apply( void );
+static void half_clock( void );
+#if defined( LINUX_I2C )
+static int linux_transfer( struct i2c_msg *msgs, size_t count );
+#endif
+#ifdef RTC_HAL_TRACE
+static uint32_t trace_start( void );
+static void trace_end( uint32_t start, uint8_t reg, size_t num_bytes,
+                       uint8_t read, int result );
+#endif
 
 /******************************************************************************
 * Function Definitions
@@ -187,6 +301,7 @@ void rtc_hal_init( uint8_t address_id )
 #elif defined( __MIKROC_PRO_FOR_PIC__ )
     i2c_start_p = I2C1_Start;
     i2c_stop_p = I2C1_Stop;
+    i2c_restart_p = I2C1_Repeated_Start;
     i2c_write_p = I2C1_Wr;
     i2c_read_p = I2C1_Rd;
 
@@ -197,10 +312,12 @@ void rtc_hal_init( uint8_t address_id )
     i2c_stop_p = I2C_Stop_Ptr;
     i2c_restart_p = I2C_Restart_Ptr;
     i2c_write_p = I2C_Write_Ptr;
+    i2c_read_p = I2C_Read_Ptr;
 
 #elif defined( __MIKROC_PRO_FOR_DSPIC__ )
     i2c_start_p = I2C1_Start;
     i2c_stop_p = I2C1_Stop;
+    i2c_restart_p = I2C1_Restart;
     i2c_write_p = I2C1_Write;
     i2c_read_p = I2C1_Read;
 
@@ -222,160 +339,655 @@ void rtc_hal_init( uint8_t address_id )
     i2c_read_p = I2CM_Read_Ptr;
     i2c_write_bytes_p = I2CM_Write_Bytes_Ptr;
     i2c_read_bytes_p = I2CM_Read_Bytes_Ptr;
-#endif
 
-#if defined( __MIKROC_PRO_FOR_ARM__ ) || defined(__MIKROC_PRO_FOR_FT90x__)
-    _i2c_address = address_id;
-#else
-    _i2c_address = ( address_id << 1 );
+#elif defined( LINUX_I2C )
+    if( i2c_fd < 0 )
+    {
+        const char *device = getenv( "RTC_I2C_DEV" );
+
+        i2c_fd = open( device ? device : RTC_HAL_I2C_DEV, O_RDWR );
+    }
 #endif
 
+    rtc_hal_set_slave( address_id );
 }
 
 void rtc_hal_set_slave( uint8_t address_id )
 {
+#ifdef RTC_HAL_TRACE
+    trace_slave = address_id;
+#endif
+#if defined( __MIKROC_PRO_FOR_ARM__ )   || \
+    defined( __MIKROC_PRO_FOR_FT90x__ ) || \
+    defined( LINUX_I2C )
     _i2c_address = address_id;
+#else
+    _i2c_address = ( address_id << 1 );
+#endif
 }
 
 
-void rtc_hal_write( uint8_t address, void *data_in, size_t num_bytes )
+static int write_once( uint8_t address, void *data_in, size_t num_bytes )
 {
-    uint8_t buffer[10];
-    buffer[0] = address;
-    memcpy( &buffer[1], data_in, num_bytes );
+#if defined( STM32 ) || defined( __MIKROC_PRO_FOR_FT90x__ )
+    uint8_t buffer[RTC_HAL_BURST_MAX + 1];
+    uint8_t *data = ( uint8_t * )data_in;
+    size_t chunk;
+#elif defined( TIVA )
+    uint8_t *data = ( uint8_t * )data_in;
+#endif
+
 #if defined( __MIKROC_PRO_FOR_ARM__ )
     #if defined( TIVA )
+    // register byte opens the burst, the last data byte closes it
     i2c_set_slave_address_p( _i2c_address, _I2C_DIR_MASTER_TRANSMIT );
-    i2c_write_p( address, _I2C_MASTER_MODE_BURST_SEND_START );
-    
-    if( num_bytes > 1 )
-    {
-        while( num_bytes-- > 1 )
-            i2c_write_p( *( ( uint8_t* )data_in++ ), _I2C_MASTER_MODE_BURST_SEND_CONT );
+    if( !num_bytes )
+        return i2c_write_p( address, _I2C_MASTER_MODE_SINGLE_SEND ) ? -1 : 0;
+
+    if( i2c_write_p( address, _I2C_MASTER_MODE_BURST_SEND_START ) )
+        return -1;
 
-        i2c_write_p( *( uint8_t* )data_in, _I2C_MASTER_MODE_BURST_SEND_FINISH );
-    } else {
-        i2c_write_p( *(uint8_t* )data_in, _I2C_MASTER_MODE_SINGLE_SEND );
+    while( num_bytes > 1 )
+    {
+        if( i2c_write_p( *data++, _I2C_MASTER_MODE_BURST_SEND_CONT ) )
+            return -1;
+        num_bytes--;
     }
 
+    if( i2c_write_p( *data, _I2C_MASTER_MODE_BURST_SEND_FINISH ) )
+        return -1;
+
     #else
-    i2c_start_p();
-    i2c_write_p( _i2c_address, buffer, num_bytes + 1, END_MODE_STOP );
+    // the frame is copied, longer writes go out as several bursts
+    do
+    {
+        chunk = ( num_bytes > RTC_HAL_BURST_MAX ) ? RTC_HAL_BURST_MAX : num_bytes;
+        buffer[0] = address;
+        memcpy( &buffer[1], data, chunk );
+        if( i2c_start_p() ||
+            i2c_write_p( _i2c_address, buffer, chunk + 1, END_MODE_STOP ) )
+            return -1;
+        address += chunk;
+        data += chunk;
+        num_bytes -= chunk;
+    } while( num_bytes );
     #endif
 #elif defined (__MIKROC_PRO_FOR_FT90x__)
-    i2cm1_set_slave_address ( _i2c_address );
-    i2c_write_p ( address );
-    i2c_write_bytes_p ( buffer, num_bytes );
-#elif defined(__MIKROC_PRO_FOR_AVR__) || \
-          defined(__MIKROC_PRO_FOR_8051__)  || \
-          defined(__MIKROC_PRO_FOR_DSPIC__) || \
-          defined(__MIKROC_PRO_FOR_PIC32__)
-
-    i2c_start_p();
-    i2c_write_p( _i2c_address | WRITE );
-    i2c_write_p( address );
-    while ( num_bytes >= 1 )
+    i2c_set_slave_address_p( _i2c_address );
+    do
     {
-        i2c_write_p ( *( ( uint8_t * ) data_in++ ) );
-        num_bytes--;
-    }
+        chunk = ( num_bytes > RTC_HAL_BURST_MAX ) ? RTC_HAL_BURST_MAX : num_bytes;
+        buffer[0] = address;
+        memcpy( &buffer[1], data, chunk );
+        if( i2c_write_bytes_p( buffer, chunk + 1 ) )
+            return -1;
+        address += chunk;
+        data += chunk;
+        num_bytes -= chunk;
+    } while( num_bytes );
+#elif defined( BYTEWISE )
+    return bytewise_transfer( address, ( uint8_t * )data_in, num_bytes, WRITE,
+                              NULL, NULL );
+
+#elif defined( LINUX_I2C )
+    struct i2c_msg msg;
+    uint8_t frame[LINUX_WRITE_MAX + 1];
+
+    if( num_bytes > LINUX_WRITE_MAX )
+        return -1;
+
+    frame[0] = address;
+    memcpy( &frame[1], data_in, num_bytes );
+    msg.addr = _i2c_address;
+    msg.flags = 0;
+    msg.len = num_bytes + 1;
+    msg.buf = frame;
+
+    return linux_transfer( &msg, 1 );
 
-    i2c_stop_p();
+#endif
 
-#elif  defined(__MIKROC_PRO_FOR_PIC__)
-    i2c_start_p();
-    i2c_write_p( _i2c_address + WRITE );
-    i2c_write_p( address );
-    while ( num_bytes >= 1 )
-    {
-        i2c_write_p ( *( ( uint8_t * ) data_in++ ) );
-        num_bytes--;
-    }
+    return 0;
+}
 
-    i2c_stop_p();
+#if defined( __MIKROC_PRO_FOR_AVR__ ) || defined( __MIKROC_PRO_FOR_8051__ )
+/*
+ * SLA+W, data and SLA+R acknowledged, a NACK or lost arbitration is not
+ */
+static bool twi_acked()
+{
+    uint8_t status = i2c_status_p() & TWI_STATUS_MASK;
 
+    return status == TWI_SLA_W_ACK || status == TWI_DATA_ACK ||
+           status == TWI_SLA_R_ACK;
+}
 #endif
 
-}
+#if defined( BYTEWISE )
+/*
+ * START, address, register, then either the data or a repeated START and
+ * the reads, every path ends with a STOP. The last read byte is NACKed.
+ * Read bytes go to the stream callback instead of data when it is given.
+ */
+static int bytewise_transfer( uint8_t address, uint8_t *data, size_t num_bytes,
+                              uint8_t dir, rtc_hal_stream_t stream, void *arg )
+{
+    bus_state_t state = BUS_SEND_START;
+    uint8_t byte;
+    int result = 0;
+
+    while( state != BUS_DONE )
+    {
+        switch( state )
+        {
+            case BUS_SEND_START:
+                BUS_START();
+                state = BUS_SEND_ADDRESS;
+                break;
+            case BUS_SEND_ADDRESS:
+                state = BUS_WRITE( _i2c_address | WRITE ) ? BUS_SEND_REGISTER
+                                                          : BUS_FAILED;
+                break;
+            case BUS_SEND_REGISTER:
+                if( !BUS_WRITE( address ) )
+                    state = BUS_FAILED;
+                else
+                    state = ( dir == READ ) ? BUS_SEND_RESTART : BUS_SEND_DATA;
+                break;
+            case BUS_SEND_DATA:
+                if( !num_bytes )
+                    state = BUS_SEND_STOP;
+                else if( !BUS_WRITE( *data++ ) )
+                    state = BUS_FAILED;
+                else
+                    num_bytes--;
+                break;
+            case BUS_SEND_RESTART:
+                BUS_RESTART();
+                state = BUS_WRITE( _i2c_address | READ ) ? BUS_RECEIVE_DATA
+                                                         : BUS_FAILED;
+                break;
+            case BUS_RECEIVE_DATA:
+                while( num_bytes )
+                {
+                    byte = BUS_READ( num_bytes > 1 );
+                    if( stream )
+                        stream( byte, arg );
+                    else
+                        *data++ = byte;
+                    num_bytes--;
+                }
+                state = BUS_SEND_STOP;
+                break;
+            case BUS_FAILED:
+                result = -1;
+                state = BUS_SEND_STOP;
+                break;
+            case BUS_SEND_STOP:
+                BUS_STOP();
+                state = BUS_DONE;
+                break;
+            default:
+                state = BUS_DONE;
+                break;
+        }
+    }
 
+    return result;
+}
+#endif
 
-void rtc_hal_read( uint8_t address, void *data_out, size_t num_bytes )
+static int read_once( uint8_t address, void *data_out, size_t num_bytes )
 {
+#if defined( TIVA )
+    uint8_t *data = ( uint8_t * )data_out;
+#endif
+
+    if( !num_bytes )
+        return 0;
+
 #if defined( __MIKROC_PRO_FOR_ARM__ )
     #if defined( TIVA )
     i2c_set_slave_address_p( _i2c_address, _I2C_DIR_MASTER_TRANSMIT );
-    i2c_write_p( address, _I2C_MASTER_MODE_SINGLE_SEND );
+    if( i2c_write_p( address, _I2C_MASTER_MODE_SINGLE_SEND ) )
+        return -1;
     i2c_set_slave_address_p( _i2c_address, _I2C_DIR_MASTER_RECEIVE );
 
-    if( num_bytes > 1 )
-    {
-        i2c_read_p( ( uint8_t * )data_out++, _I2C_MASTER_MODE_BURST_RECEIVE_START );
-        num_bytes--;
-        
-        while( num_bytes > 1 )
-            i2c_read_p( ( uint8_t * )data_out++, _I2C_MASTER_MODE_BURST_RECEIVE_CONT );
+    if( num_bytes == 1 )
+        return i2c_read_p( data, _I2C_MASTER_MODE_SINGLE_RECEIVE ) ? -1 : 0;
 
-        i2c_read_p( ( uint8_t * )data_out, _I2C_MASTER_MODE_BURST_RECEIVE_FINISH );
-    } else {
-        i2c_read_p( ( uint8_t * )data_out, _I2C_MASTER_MODE_SINGLE_RECEIVE );
-    }
+    if( i2c_read_p( data++, _I2C_MASTER_MODE_BURST_RECEIVE_START ) )
+        return -1;
+
+    while( --num_bytes > 1 )
+        if( i2c_read_p( data++, _I2C_MASTER_MODE_BURST_RECEIVE_CONT ) )
+            return -1;
+
+    if( i2c_read_p( data, _I2C_MASTER_MODE_BURST_RECEIVE_FINISH ) )
+        return -1;
     #else
-    i2c_start_p();
-    i2c_write_p ( _i2c_address, &address, 1, END_MODE_RESTART );
-    i2c_read_p  ( _i2c_address, ( uint8_t * )data_out, num_bytes, END_MODE_STOP );
+    // register write ends in a repeated START, the read is one burst
+    if( i2c_start_p() ||
+        i2c_write_p( _i2c_address, &address, 1, END_MODE_RESTART ) )
+        return -1;
+    i2c_read_p( _i2c_address, ( uint8_t * )data_out, num_bytes, END_MODE_STOP );
     #endif
-    
+
 #elif defined (__MIKROC_PRO_FOR_FT90x__)
     i2c_set_slave_address_p( _i2c_address );
-    i2c_write_p ( address );
-    i2c_read_bytes_p ( ( uint8_t * )data_out , num_bytes );
+    if( i2c_write_p( address ) ||
+        i2c_read_bytes_p( ( uint8_t * )data_out, num_bytes ) )
+        return -1;
+
+#elif defined( BYTEWISE )
+    return bytewise_transfer( address, ( uint8_t * )data_out, num_bytes, READ,
+                              NULL, NULL );
+
+#elif defined( LINUX_I2C )
+    struct i2c_msg msgs[2];
 
-#elif       defined(__MIKROC_PRO_FOR_8051__)  || \
-              defined(__MIKROC_PRO_FOR_DSPIC__) || \
-              defined(__MIKROC_PRO_FOR_PIC32__)
+    msgs[0].addr = _i2c_address;
+    msgs[0].flags = 0;
+    msgs[0].len = 1;
+    msgs[0].buf = &address;
+    msgs[1].addr = _i2c_address;
+    msgs[1].flags = I2C_M_RD;
+    msgs[1].len = num_bytes;
+    msgs[1].buf = ( uint8_t * )data_out;
 
+    return linux_transfer( msgs, 2 );
 
-#elif defined(__MIKROC_PRO_FOR_AVR__)
-    i2c_start_p ();
-    i2c_write_p ( _i2c_address + WRITE );
-    i2c_write_p ( address );
-    i2c_start_p ();
-    i2c_write_p ( _i2c_address + READ );
+#endif
+
+    return 0;
+}
+
+#if defined( BYTEWISE ) || defined( TIVA )
+/*
+ * The whole length as one transaction. Byte-wise reads cannot fail once
+ * the first byte is in, a TIVA burst can and counts in delivered.
+ */
+static int stream_once( uint8_t address, size_t num_bytes,
+                        rtc_hal_stream_t cb, void *arg, size_t *delivered )
+{
+#if defined( TIVA )
+    uint8_t mode = _I2C_MASTER_MODE_BURST_RECEIVE_START;
+    uint8_t data;
+#endif
+
+    *delivered = 0;
+    if( !num_bytes )
+        return 0;
+
+#if defined( TIVA )
+    i2c_set_slave_address_p( _i2c_address, _I2C_DIR_MASTER_TRANSMIT );
+    if( i2c_write_p( address, _I2C_MASTER_MODE_SINGLE_SEND ) )
+        return -1;
+    i2c_set_slave_address_p( _i2c_address, _I2C_DIR_MASTER_RECEIVE );
+
+    if( num_bytes == 1 )
+        mode = _I2C_MASTER_MODE_SINGLE_RECEIVE;
 
-    while( num_bytes >= 2 )
+    while( num_bytes )
     {
-        *( ( uint8_t * ) data_out++ ) = i2c_read_p( 1 );
+        if( i2c_read_p( &data, mode ) )
+            return -1;
+        cb( data, arg );
+        ( *delivered )++;
         num_bytes--;
+        mode = ( num_bytes > 1 ) ? _I2C_MASTER_MODE_BURST_RECEIVE_CONT
+                                 : _I2C_MASTER_MODE_BURST_RECEIVE_FINISH;
     }
 
-    *( ( uint8_t * ) data_out ) = i2c_read_p( 0 );
+    return 0;
+#else
+    return bytewise_transfer( address, NULL, num_bytes, READ, cb, arg );
+#endif
+}
+#endif
 
-    i2c_stop_p();
+#if defined( LINUX_I2C )
+static int linux_transfer( struct i2c_msg *msgs, size_t count )
+{
+    struct i2c_rdwr_ioctl_data xfer;
 
-#elif  defined(__MIKROC_PRO_FOR_PIC__)
-    uint8_t buffer;
-    i2c_start_p ();
-    i2c_write_p ( _i2c_address + WRITE );
-    i2c_write_p ( address );
-    i2c_start_p ();
-    i2c_write_p ( _i2c_address + READ );
+    xfer.msgs = msgs;
+    xfer.nmsgs = count;
 
-    while( num_bytes >= 2 )
+    return ( ioctl( i2c_fd, I2C_RDWR, &xfer ) < 0 ) ? -1 : 0;
+}
+#endif
+
+static void clock_apply()
+{
+    if( clock_p && clock_khz && clock_khz != clock_set_khz )
     {
-        *( ( uint8_t * ) data_out++ ) = i2c_read_p( 1 );
-        num_bytes--;
+        clock_p( clock_khz );
+        clock_set_khz = clock_khz;
     }
+}
 
-    *( ( uint8_t * ) data_out ) = i2c_read_p( 0 );
+/*
+ * Called after a failed attempt, false once the retries are used up.
+ * The bus is recovered first in case a slave holds SDA low.
+ */
+static bool retry_wait( uint8_t attempt )
+{
+    if( attempt >= RTC_HAL_RETRIES )
+        return false;
+
+    if( recovery_p )
+        rtc_hal_recover();
+
+    rtc_hal_delay( RTC_HAL_BACKOFF_MS << attempt );
+    return true;
+}
+
+int rtc_hal_write( uint8_t address, void *data_in, size_t num_bytes )
+{
+    uint8_t attempt = 0;
+    int result;
+#ifdef RTC_HAL_TRACE
+    uint32_t trace = trace_start();
+#endif
+
+    clock_apply();
+    while( ( result = write_once( address, data_in, num_bytes ) ) &&
+           retry_wait( attempt ) )
+        attempt++;
+
+#ifdef RTC_HAL_TRACE
+    trace_end( trace, address, num_bytes, WRITE, result );
+#endif
+    return result;
+}
+
+int rtc_hal_read( uint8_t address, void *data_out, size_t num_bytes )
+{
+    uint8_t attempt = 0;
+    int result;
+#ifdef RTC_HAL_TRACE
+    uint32_t trace = trace_start();
+#endif
+
+    clock_apply();
+    while( ( result = read_once( address, data_out, num_bytes ) ) &&
+           retry_wait( attempt ) )
+        attempt++;
+
+#ifdef RTC_HAL_TRACE
+    trace_end( trace, address, num_bytes, READ, result );
+#endif
+    return result;
+}
+
+int rtc_hal_read_stream( uint8_t address, size_t num_bytes,
+                         rtc_hal_stream_t cb, void *arg )
+{
+#if defined( BYTEWISE ) || defined( TIVA )
+    size_t delivered;
+#else
+    uint8_t buffer[RTC_HAL_BURST_MAX];
+    uint8_t reg = address;
+    size_t left = num_bytes;
+    size_t chunk;
+    size_t i;
+#endif
+    uint8_t attempt = 0;
+    int result = 0;
+#ifdef RTC_HAL_TRACE
+    uint32_t trace = trace_start();
+#endif
 
-    i2c_stop_p();
+    clock_apply();
+#if defined( BYTEWISE ) || defined( TIVA )
+    // bytes already handed over cannot be taken back, no retry after them
+    while( ( result = stream_once( address, num_bytes, cb, arg, &delivered ) ) &&
+           !delivered && retry_wait( attempt ) )
+        attempt++;
+#else
+    // a chunk is handed over once read, each one retries on its own
+    while( left )
+    {
+        chunk = ( left > RTC_HAL_BURST_MAX ) ? RTC_HAL_BURST_MAX : left;
+        attempt = 0;
+        while( ( result = read_once( reg, buffer, chunk ) ) &&
+               retry_wait( attempt ) )
+            attempt++;
+        if( result )
+            break;
+
+        for( i = 0; i < chunk; i++ )
+            cb( buffer[i], arg );
+        reg += chunk;
+        left -= chunk;
+    }
+#endif
 
+#ifdef RTC_HAL_TRACE
+    trace_end( trace, address, num_bytes, READ, result );
+#endif
+    return result;
+}
 
+int rtc_hal_read_batch( rtc_hal_read_t *reads, size_t count )
+{
+#if defined( LINUX_I2C )
+    /*
+     * Register pointer write and data read go out as one combined
+     * transaction with a repeated start, several reads per ioctl
+     */
+    struct i2c_msg msgs[LINUX_BATCH_READS * 2];
+    size_t nmsgs;
+    size_t i;
+    uint8_t attempt;
+    int result;
+#ifdef RTC_HAL_TRACE
+    uint32_t trace;
+    size_t total;
 #endif
 
+    clock_apply();
+    while( count )
+    {
+        nmsgs = 0;
+#ifdef RTC_HAL_TRACE
+        trace = trace_start();
+        total = 0;
+#endif
 
+        for( i = 0; i < count && i < LINUX_BATCH_READS; i++ )
+        {
+            msgs[nmsgs].addr = _i2c_address;
+            msgs[nmsgs].flags = 0;
+            msgs[nmsgs].len = 1;
+            msgs[nmsgs].buf = &reads[i].address;
+            nmsgs++;
+            msgs[nmsgs].addr = _i2c_address;
+            msgs[nmsgs].flags = I2C_M_RD;
+            msgs[nmsgs].len = reads[i].num_bytes;
+            msgs[nmsgs].buf = ( uint8_t * )reads[i].data_out;
+            nmsgs++;
+#ifdef RTC_HAL_TRACE
+            total += reads[i].num_bytes;
+#endif
+        }
+
+        attempt = 0;
+        while( ( result = linux_transfer( msgs, nmsgs ) ) && retry_wait( attempt ) )
+            attempt++;
+#ifdef RTC_HAL_TRACE
+        // one entry per ioctl, tagged with the first register
+        trace_end( trace, reads[0].address, total, READ, result );
+#endif
+        if( result )
+            return -1;
+
+        reads += i;
+        count -= i;
+    }
+#else
+    while( count-- )
+    {
+        if( rtc_hal_read( reads->address, reads->data_out, reads->num_bytes ) )
+            return -1;
+        reads++;
+    }
+#endif
+
+    return 0;
 }
 
+void rtc_hal_set_recovery( const rtc_hal_recovery_t *recovery )
+{
+    recovery_p = recovery;
+}
 
+void rtc_hal_set_clock( rtc_hal_clock_t clock )
+{
+    clock_p = clock;
+    clock_set_khz = 0;
+}
+
+void rtc_hal_set_speed( uint16_t khz )
+{
+    clock_khz = khz;
+}
+
+int rtc_hal_recover()
+{
+    uint8_t clocks;
+
+    if( !recovery_p )
+        return -1;
+
+    // clock out whatever byte the slave is stuck in, then a STOP
+    recovery_p->sda( 1 );
+    for( clocks = 0; clocks < 9 && !recovery_p->sda_read(); clocks++ )
+    {
+        recovery_p->scl( 0 );
+        half_clock();
+        recovery_p->scl( 1 );
+        half_clock();
+    }
+
+    recovery_p->scl( 0 );
+    half_clock();
+    recovery_p->sda( 0 );
+    half_clock();
+    recovery_p->scl( 1 );
+    half_clock();
+    recovery_p->sda( 1 );
+    half_clock();
+
+    clocks = recovery_p->sda_read();
+    if( recovery_p->restore )
+        recovery_p->restore();
+
+    return clocks ? 0 : -1;
+}
+
+/*
+ * 5us, half of a 100kHz clock
+ */
+static void half_clock()
+{
+#if defined( __MIKROC_PRO_FOR_ARM__ )   || \
+    defined( __MIKROC_PRO_FOR_AVR__ )   || \
+    defined( __MIKROC_PRO_FOR_PIC__ )   || \
+    defined( __MIKROC_PRO_FOR_PIC32__ ) || \
+    defined( __MIKROC_PRO_FOR_DSPIC__ ) || \
+    defined( __MIKROC_PRO_FOR_8051__ )  || \
+    defined( __MIKROC_PRO_FOR_FT90x__ )
+    Delay_us( 5 );
+#elif defined( LINUX_I2C )
+    struct timespec ts;
+
+    ts.tv_sec = 0;
+    ts.tv_nsec = 5000;
+    nanosleep( &ts, NULL );
+#endif
+}
+
+void rtc_hal_delay( uint16_t ms )
+{
+#if defined( __MIKROC_PRO_FOR_ARM__ )   || \
+    defined( __MIKROC_PRO_FOR_AVR__ )   || \
+    defined( __MIKROC_PRO_FOR_PIC__ )   || \
+    defined( __MIKROC_PRO_FOR_PIC32__ ) || \
+    defined( __MIKROC_PRO_FOR_DSPIC__ ) || \
+    defined( __MIKROC_PRO_FOR_8051__ )  || \
+    defined( __MIKROC_PRO_FOR_FT90x__ )
+    VDelay_ms( ms );
+#elif defined( LINUX_I2C )
+    struct timespec ts;
+
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = ( long )( ms % 1000 ) * 1000000L;
+    nanosleep( &ts, NULL );
+#elif defined( RTC_HAL_FAKE )
+    rtc_hal_fake_delay( ms );
+#else
+    ( void )ms;
+#endif
+}
+
+#ifdef RTC_HAL_TRACE
+static uint32_t trace_start()
+{
+    return trace_tick_p ? trace_tick_p() : 0;
+}
+
+static void trace_end( uint32_t start, uint8_t reg, size_t num_bytes,
+                       uint8_t read, int result )
+{
+    volatile rtc_hal_trace_t *entry = &trace_ring[trace_head & ( RTC_HAL_TRACE_SIZE - 1 )];
+
+    entry->ticks = trace_start() - start;
+    entry->op = trace_current_op | ( result ? TRACE_FAILED : 0 );
+    entry->slave = ( trace_slave << 1 ) | read;
+    entry->reg = reg;
+    entry->len = ( num_bytes > 255 ) ? 255 : num_bytes;
+    trace_head++;
+}
+
+void rtc_hal_trace_init( uint32_t ( *tick )( void ) )
+{
+    uint16_t i;
+
+    for( i = 0; i < RTC_HAL_TRACE_SIZE; i++ )
+    {
+        trace_ring[i].ticks = 0;
+        trace_ring[i].op = 0;
+        trace_ring[i].slave = 0;
+        trace_ring[i].reg = 0;
+        trace_ring[i].len = 0;
+    }
+    trace_head = 0;
+    trace_current_op = 0;
+    trace_holds = 0;
+    trace_tick_p = tick;
+}
+
+void rtc_hal_trace_op( uint8_t op )
+{
+    if( !trace_holds )
+        trace_current_op = op;
+}
+
+void rtc_hal_trace_hold( bool hold )
+{
+    if( hold )
+        trace_holds++;
+    else if( trace_holds )
+        trace_holds--;
+}
+
+const volatile rtc_hal_trace_t *rtc_hal_trace_ring( uint16_t *head )
+{
+    *head = trace_head;
+    return trace_ring;
+}
+#endif
 
 /*************** END OF FUNCTIONS *********************************************/
\ No newline at end of file
@@ -0,0 +1,270 @@
+/*******************************************************************************
+* Title                 :   Fake I2C bus
+* Filename              :   rtc_hal_fake.c
+* Notes                 :   Host builds only, compile with RTC_HAL_FAKE
+*******************************************************************************/
+/** @file rtc_hal_fake.c
+ *
+ *  @brief In-process I2C bus with register file slaves.
+ *
+ *  rtc_hal.c drives it through the byte-wise backend, so the library sends
+ *  the same START, address, register, data and STOP sequence as on the
+ *  PIC, AVR and 8051 targets. Slaves behave like the RTC chips: a register
+ *  pointer that auto-increments, page wrap and a busy write cycle for the
+ *  EEPROM. Time is simulated, nothing sleeps.
+ */
+/******************************************************************************
+* Includes
+*******************************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "rtc_hal.h"
+
+#ifdef RTC_HAL_FAKE
+/******************************************************************************
+* Module Preprocessor Constants
+*******************************************************************************/
+#define FAKE_SLAVES             4
+#define FAKE_DEFAULT_KHZ        100
+
+/******************************************************************************
+* Module Typedefs
+*******************************************************************************/
+typedef enum
+{
+    FAKE_IDLE,
+    FAKE_ADDRESS,       // START seen, next byte is the address
+    FAKE_REGISTER,      // addressed for writing, next byte is the pointer
+    FAKE_DATA,          // writing data
+    FAKE_READING,       // addressed for reading
+    FAKE_IGNORE         // not addressed, wait for START
+} fake_state_t;
+
+typedef struct
+{
+    uint8_t  slave;
+    uint8_t  page;
+    uint8_t  write_ms;
+    uint8_t  pointer;
+    bool     written;           // data stored since the last START
+    uint64_t busy_until_ns;     // write cycle end
+    uint8_t  regs[256];
+} fake_slave_t;
+
+/******************************************************************************
+* Module Variable Definitions
+*******************************************************************************/
+static fake_slave_t slaves[FAKE_SLAVES];
+static uint8_t slave_count;
+static fake_slave_t *selected;
+static fake_state_t state;
+static int32_t cut_bytes = -1;
+static uint8_t nack_addresses;
+static uint16_t clock_khz = FAKE_DEFAULT_KHZ;
+static uint64_t now_ns;
+static uint64_t clear_ns;
+static rtc_hal_fake_stats_t stats;
+static uint16_t wire[RTC_HAL_FAKE_WIRE_SIZE];
+static size_t wire_count;
+
+/******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+static void bits( uint8_t count );
+static void log_wire( uint16_t entry );
+static void end_write( void );
+
+/******************************************************************************
+* Function Definitions
+*******************************************************************************/
+static void bits( uint8_t count )
+{
+    now_ns += ( uint64_t )count * 1000000UL / clock_khz;
+    stats.time_us = ( uint32_t )( ( now_ns - clear_ns ) / 1000 );
+}
+
+static void log_wire( uint16_t entry )
+{
+    if( wire_count < RTC_HAL_FAKE_WIRE_SIZE )
+        wire[wire_count++] = entry;
+}
+
+/*
+ * A write cycle starts with the STOP or repeated START after the data
+ */
+static void end_write()
+{
+    if( selected && selected->written && selected->write_ms )
+        selected->busy_until_ns = now_ns +
+                                  ( uint64_t )selected->write_ms * 1000000UL;
+    if( selected )
+        selected->written = false;
+}
+
+void rtc_hal_fake_reset()
+{
+    memset( slaves, 0, sizeof( slaves ) );
+    slave_count = 0;
+    selected = NULL;
+    state = FAKE_IDLE;
+    cut_bytes = -1;
+    nack_addresses = 0;
+    clock_khz = FAKE_DEFAULT_KHZ;
+    rtc_hal_fake_clear();
+}
+
+void rtc_hal_fake_clear()
+{
+    memset( &stats, 0, sizeof( stats ) );
+    wire_count = 0;
+    clear_ns = now_ns;
+}
+
+uint8_t *rtc_hal_fake_attach( uint8_t slave, uint8_t page, uint8_t write_ms )
+{
+    fake_slave_t *s;
+
+    if( slave_count == FAKE_SLAVES )
+        return NULL;
+
+    s = &slaves[slave_count++];
+    memset( s, 0, sizeof( *s ) );
+    s->slave = slave;
+    s->page = page;
+    s->write_ms = write_ms;
+
+    return s->regs;
+}
+
+void rtc_hal_fake_cut( int32_t bytes )
+{
+    cut_bytes = bytes;
+}
+
+void rtc_hal_fake_nack( uint8_t addresses )
+{
+    nack_addresses = addresses;
+}
+
+void rtc_hal_fake_clock( uint16_t khz )
+{
+    if( !khz )
+        return;
+
+    clock_khz = khz;
+    now_ns += RTC_HAL_FAKE_CLOCK_US * 1000UL;
+    stats.time_us = ( uint32_t )( ( now_ns - clear_ns ) / 1000 );
+}
+
+const rtc_hal_fake_stats_t *rtc_hal_fake_stats()
+{
+    return &stats;
+}
+
+const uint16_t *rtc_hal_fake_wire( size_t *count )
+{
+    *count = wire_count;
+    return wire;
+}
+
+void rtc_hal_fake_start()
+{
+    end_write();
+    bits( 1 );
+    stats.starts++;
+    log_wire( RTC_HAL_FAKE_START );
+    selected = NULL;
+    state = FAKE_ADDRESS;
+}
+
+void rtc_hal_fake_stop()
+{
+    end_write();
+    bits( 1 );
+    log_wire( RTC_HAL_FAKE_STOP );
+    selected = NULL;
+    state = FAKE_IDLE;
+}
+
+bool rtc_hal_fake_write( uint8_t data )
+{
+    bool ack = false;
+    uint8_t i;
+
+    bits( 9 );
+    stats.bytes++;
+
+    if( cut_bytes == 0 )
+        state = FAKE_IGNORE;
+    else if( cut_bytes > 0 )
+        cut_bytes--;
+
+    switch( state )
+    {
+        case FAKE_ADDRESS:
+            state = FAKE_IGNORE;
+            if( nack_addresses )
+            {
+                nack_addresses--;
+                break;
+            }
+            for( i = 0; i < slave_count; i++ )
+                if( slaves[i].slave == data >> 1 &&
+                    slaves[i].busy_until_ns <= now_ns )
+                {
+                    selected = &slaves[i];
+                    state = ( data & 1 ) ? FAKE_READING : FAKE_REGISTER;
+                    ack = true;
+                }
+            break;
+        case FAKE_REGISTER:
+            selected->pointer = data;
+            state = FAKE_DATA;
+            ack = true;
+            break;
+        case FAKE_DATA:
+            selected->regs[selected->pointer] = data;
+            selected->written = true;
+            if( selected->page )
+                selected->pointer = ( selected->pointer & ~( selected->page - 1 ) ) |
+                                    ( ( selected->pointer + 1 ) & ( selected->page - 1 ) );
+            else
+                selected->pointer++;
+            ack = true;
+            break;
+        default:
+            break;
+    }
+
+    if( !ack )
+        stats.nacks++;
+    log_wire( data | ( ack ? 0 : RTC_HAL_FAKE_NACK ) );
+
+    return ack;
+}
+
+uint8_t rtc_hal_fake_read( bool ack )
+{
+    uint8_t data = 0xFF;        // released bus reads as ones
+
+    bits( 9 );
+    stats.bytes++;
+
+    // a cut shows at the next byte the master writes, reads finish
+    if( state == FAKE_READING )
+        data = selected->regs[selected->pointer++];
+
+    log_wire( RTC_HAL_FAKE_READ | data | ( ack ? 0 : RTC_HAL_FAKE_NACK ) );
+
+    return data;
+}
+
+void rtc_hal_fake_delay( uint16_t ms )
+{
+    now_ns += ( uint64_t )ms * 1000000UL;
+    stats.time_us = ( uint32_t )( ( now_ns - clear_ns ) / 1000 );
+}
+#endif
+
+/*************** END OF FUNCTIONS *********************************************/
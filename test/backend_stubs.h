@@ -0,0 +1,67 @@
+/*******************************************************************************
+* Title                 :   Vendor library stubs
+* Filename              :   backend_stubs.h
+*******************************************************************************/
+/** @file backend_stubs.h
+ *
+ *  @brief The mikroC I2C calls rtc_hal.c uses on STM32, TIVA, FT90x and
+ *  AVR, forced into a host build of it. test_backends.c records every
+ *  call so the transfers can be compared call by call.
+ */
+#ifndef BACKEND_STUBS_H_
+#define BACKEND_STUBS_H_
+
+// STM32
+#define END_MODE_RESTART                        0
+#define END_MODE_STOP                           1
+
+unsigned int I2C_Start_Ptr( void );
+#if defined( STM32 )
+unsigned int I2C_Write_Ptr( unsigned char slave_address, unsigned char *buffer,
+                            unsigned long count, unsigned long end_mode );
+void I2C_Read_Ptr( unsigned char slave_address, unsigned char *buffer,
+                   unsigned long count, unsigned long end_mode );
+#endif
+
+// TIVA
+#define _I2C_DIR_MASTER_TRANSMIT                0
+#define _I2C_DIR_MASTER_RECEIVE                 1
+#define _I2C_MASTER_MODE_SINGLE_SEND            0x10
+#define _I2C_MASTER_MODE_BURST_SEND_START       0x11
+#define _I2C_MASTER_MODE_BURST_SEND_CONT        0x12
+#define _I2C_MASTER_MODE_BURST_SEND_FINISH      0x13
+#define _I2C_MASTER_MODE_SINGLE_RECEIVE         0x20
+#define _I2C_MASTER_MODE_BURST_RECEIVE_START    0x21
+#define _I2C_MASTER_MODE_BURST_RECEIVE_CONT     0x22
+#define _I2C_MASTER_MODE_BURST_RECEIVE_FINISH   0x23
+
+#if defined( TIVA )
+void I2C_Enable_Ptr( void );
+void I2C_Disable_Ptr( void );
+void I2C_Master_Slave_Addr_Set_Ptr( unsigned char slave_address,
+                                    unsigned char dir );
+unsigned char I2C_Write_Ptr( unsigned char data_out, unsigned char mode );
+unsigned char I2C_Read_Ptr( unsigned char *data_in, unsigned char mode );
+#endif
+
+// FT90x
+void I2CM_Soft_Reset_Ptr( void );
+void I2CM_Set_Slave_Address_Ptr( unsigned char slave_address );
+unsigned char I2CM_Write_Ptr( unsigned char data_out );
+unsigned char I2CM_Read_Ptr( unsigned char *data_in );
+unsigned char I2CM_Write_Bytes_Ptr( unsigned char *buffer, unsigned int count );
+unsigned char I2CM_Read_Bytes_Ptr( unsigned char *buffer, unsigned int count );
+
+// AVR
+unsigned char TWIC_Busy( void );
+unsigned char TWIC_Status( void );
+void TWIC_Close( void );
+unsigned char TWIC_Start( void );
+void TWIC_Stop( void );
+void TWIC_Write( unsigned char data_out );
+unsigned char TWIC_Read( unsigned char ack );
+
+void Delay_us( unsigned long us );
+void VDelay_ms( unsigned int ms );
+
+#endif /* BACKEND_STUBS_H_ */
@@ -0,0 +1,83 @@
+/*******************************************************************************
+* Title                 :   Calendar conversion throughput
+* Filename              :   bench_cal.c
+*******************************************************************************/
+/** @file bench_cal.c
+ *
+ *  @brief Records per second of the array conversions, scalar AoS against
+ *  the SoA kernels. make bench builds it for the default instruction set
+ *  and with -mavx2.
+ */
+#include <stdlib.h>
+#include <time.h>
+#include "test.h"
+
+#define COUNT       ( 1UL << 20 )
+#define ROUNDS      20
+
+static uint32_t epochs[COUNT];
+static uint32_t back[COUNT];
+static rtc_time_t times[COUNT];
+static uint8_t fields[7][COUNT];
+
+static double now_s()
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void report( const char *name, double seconds )
+{
+    printf( "%-28s %8.1f M records/s\n", name, COUNT * ROUNDS / seconds / 1e6 );
+}
+
+int main()
+{
+    rtc_time_soa_t soa =
+    {
+        fields[0], fields[1], fields[2], fields[3], fields[4], fields[5], fields[6]
+    };
+    double t;
+    size_t i;
+    int r;
+
+    srand( 1 );
+    for( i = 0; i < COUNT; i++ )
+        epochs[i] = 946684800UL + ( uint32_t )rand() % ( 100UL * 365 * 86400 );
+
+#if defined( __AVX2__ )
+    printf( "AVX2 kernels\n" );
+#elif defined( __SSE2__ )
+    printf( "SSE2 kernels\n" );
+#elif defined( __ARM_NEON )
+    printf( "NEON kernels\n" );
+#else
+    printf( "scalar only\n" );
+#endif
+
+    t = now_s();
+    for( r = 0; r < ROUNDS; r++ )
+        rtc_cal_to_times( epochs, times, COUNT );
+    report( "rtc_cal_to_times", now_s() - t );
+
+    t = now_s();
+    for( r = 0; r < ROUNDS; r++ )
+        rtc_cal_to_times_soa( epochs, &soa, COUNT );
+    report( "rtc_cal_to_times_soa", now_s() - t );
+
+    t = now_s();
+    for( r = 0; r < ROUNDS; r++ )
+        rtc_cal_to_epochs( times, back, COUNT );
+    report( "rtc_cal_to_epochs", now_s() - t );
+    CHECK( !memcmp( back, epochs, sizeof( back ) ) );
+
+    t = now_s();
+    for( r = 0; r < ROUNDS; r++ )
+        rtc_cal_to_epochs_soa( &soa, back, COUNT );
+    report( "rtc_cal_to_epochs_soa", now_s() - t );
+    CHECK( !memcmp( back, epochs, sizeof( back ) ) );
+
+    return TEST_DONE();
+}
@@ -0,0 +1,59 @@
+/*******************************************************************************
+* Title                 :   A/B commit throughput
+* Filename              :   bench_commit.c
+*******************************************************************************/
+/** @file bench_commit.c
+ *
+ *  @brief Commits per second over the MCP7941X SRAM, simulated bus time
+ *  at 400 kHz plus the host CPU time of the library.
+ */
+#include <time.h>
+#include "test.h"
+
+#define ROUNDS      2000
+
+static double now_s()
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main()
+{
+    static const uint8_t sizes[] = { 4, 8, 16, RTC_COMMIT_MAX };
+    uint8_t data[RTC_COMMIT_MAX];
+    double cpu;
+    uint32_t bus_us;
+    uint32_t i;
+    size_t s;
+
+    test_chip( RTC6_MCP7941X, NULL );
+    CHECK( rtc_init( RTC6_MCP7941X, 0 ) == 0 );
+    memset( data, 0xA5, sizeof( data ) );
+
+    printf( "size  bus us/commit  commits/s  bus us/read  host ns/commit\n" );
+    for( s = 0; s < sizeof( sizes ); s++ )
+    {
+        rtc_hal_fake_clear();
+        cpu = now_s();
+        for( i = 0; i < ROUNDS; i++ )
+        {
+            data[0] = ( uint8_t )i;
+            CHECK( rtc_commit_write( 0, data, sizes[s] ) == 0 );
+        }
+        cpu = now_s() - cpu;
+        bus_us = rtc_hal_fake_stats()->time_us;
+
+        rtc_hal_fake_clear();
+        CHECK( rtc_commit_read( 0, data, sizes[s] ) == 0 );
+
+        printf( "%4u  %13.1f  %9.0f  %11lu  %14.0f\n", sizes[s],
+                ( double )bus_us / ROUNDS, ROUNDS * 1e6 / bus_us,
+                ( unsigned long )rtc_hal_fake_stats()->time_us,
+                cpu * 1e9 / ROUNDS );
+    }
+
+    return TEST_DONE();
+}
@@ -0,0 +1,56 @@
+/*******************************************************************************
+* Title                 :   EEPROM block throughput
+* Filename              :   bench_eeprom.c
+*******************************************************************************/
+/** @file bench_eeprom.c
+ *
+ *  @brief Simulated time to fill and read the MCP7941X EEPROM, a 5 ms
+ *  write cycle per page, page-aware blocks against single bytes.
+ */
+#include "test.h"
+
+static void report( const char *name, uint32_t bytes )
+{
+    const rtc_hal_fake_stats_t *stats = rtc_hal_fake_stats();
+
+    printf( "%-30s %8lu us %4lu STARTs %3lu NACKs %8.0f bytes/s\n", name,
+            ( unsigned long )stats->time_us, ( unsigned long )stats->starts,
+            ( unsigned long )stats->nacks, bytes * 1e6 / stats->time_us );
+}
+
+int main()
+{
+    uint8_t data[128];
+    uint8_t back[128];
+    uint8_t *eeprom;
+    uint8_t i;
+
+    test_chip( RTC6_MCP7941X, &eeprom );
+    CHECK( rtc_init( RTC6_MCP7941X, 0 ) == 0 );
+    CHECK( rtc_eeprom_get_protect() == RTC_EEPROM_PROTECT_NONE );
+    for( i = 0; i < sizeof( data ); i++ )
+        data[i] = i ^ 0x5A;
+
+    rtc_hal_fake_clear();
+    CHECK( rtc_eeprom_write_block( 0, data, sizeof( data ) ) == 0 );
+    report( "write_block 128 bytes", sizeof( data ) );
+    CHECK( !memcmp( eeprom, data, sizeof( data ) ) );
+
+    rtc_hal_fake_clear();
+    CHECK( rtc_eeprom_write_block( 5, data, 20 ) == 0 );
+    report( "write_block 20 bytes at 5", 20 );
+
+    memset( eeprom, 0xFF, 128 );
+    rtc_hal_fake_clear();
+    for( i = 0; i < sizeof( data ); i++ )
+        CHECK( rtc_write_eeprom( i, &data[i], 1 ) );
+    report( "write_eeprom 128 x 1 byte", sizeof( data ) );
+    CHECK( !memcmp( eeprom, data, sizeof( data ) ) );
+
+    rtc_hal_fake_clear();
+    CHECK( rtc_eeprom_read_block( 0, back, sizeof( back ) ) == 0 );
+    report( "read_block 128 bytes", sizeof( back ) );
+    CHECK( !memcmp( back, data, sizeof( data ) ) );
+
+    return TEST_DONE();
+}
@@ -0,0 +1,127 @@
+/*******************************************************************************
+* Title                 :   Recurrence rule search
+* Filename              :   bench_rules.c
+*******************************************************************************/
+/** @file bench_rules.c
+ *
+ *  @brief Next-fire times for 10,000 random rules per round, the first
+ *  ones checked against a minute by minute scan.
+ */
+#include <stdlib.h>
+#include <time.h>
+#include "test.h"
+
+#define RULES       10000
+#define ROUNDS      20
+#define CHECKED     200
+
+static rtc_rule_t rules[RULES];
+static uint32_t afters[RULES];
+static uint32_t nexts[RULES];
+
+static double now_s()
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static bool matches( const rtc_rule_t *rule, uint32_t epoch )
+{
+    rtc_time_t t;
+
+    rtc_cal_to_times( &epoch, &t, 1 );
+    return t.seconds == rule->second &&
+           ( t.minutes < 32 ? rule->minutes_lo >> t.minutes
+                            : rule->minutes_hi >> ( t.minutes - 32 ) ) & 1 &&
+           ( rule->hours >> t.hours ) & 1 &&
+           ( rule->monthdays >> t.monthday ) & 1 &&
+           ( rule->months >> t.month ) & 1 &&
+           ( rule->weekdays >> t.weekday ) & 1;
+}
+
+static void random_rule( rtc_rule_t *rule )
+{
+    uint8_t first;
+
+    rtc_rule_init( rule );
+    rule->second = rand() % 60;
+    if( rand() % 2 )
+    {
+        first = rand() % 60;
+        rtc_rule_minutes( rule, first, first + rand() % 60, 1 + rand() % 20 );
+    }
+    if( rand() % 2 )
+    {
+        first = rand() % 24;
+        rtc_rule_hours( rule, first, first + rand() % 24, 1 + rand() % 6 );
+    }
+    if( rand() % 3 == 0 )
+    {
+        first = 1 + rand() % 31;
+        rtc_rule_monthdays( rule, first, first + rand() % 31, 1 + rand() % 10 );
+    }
+    if( rand() % 3 == 0 )
+    {
+        first = 1 + rand() % 12;
+        rtc_rule_months( rule, first, first + rand() % 12, 1 + rand() % 4 );
+    }
+    if( rand() % 2 )
+    {
+        first = 1 + rand() % 7;
+        rtc_rule_weekdays( rule, first, first + rand() % 7, 1 + rand() % 3 );
+    }
+}
+
+int main()
+{
+    uint32_t epoch;
+    uint32_t never = 0;
+    double t;
+    int bad = 0;
+    int r;
+    int i;
+
+    srand( 1 );
+    for( i = 0; i < RULES; i++ )
+    {
+        random_rule( &rules[i] );
+        afters[i] = 1451606400UL + ( uint32_t )rand() % ( 15UL * 365 * 86400 );
+    }
+
+    t = now_s();
+    for( r = 0; r < ROUNDS; r++ )
+        for( i = 0; i < RULES; i++ )
+            nexts[i] = rtc_rule_next( &rules[i], afters[i] );
+    t = now_s() - t;
+    printf( "rtc_rule_next %10.0f rules/s, %.0f ns each\n",
+            RULES * ROUNDS / t, t * 1e9 / ( RULES * ROUNDS ) );
+    CHECK( RULES * ROUNDS / t > 10000 );
+
+    for( i = 0; i < RULES; i++ )
+        if( !nexts[i] )
+            never++;
+    printf( "%lu of %d rules have no occurrence within 8 years\n",
+            ( unsigned long )never, RULES );
+
+    // every second up to the result, skipped when it is over 60 days out
+    for( i = 0; i < CHECKED; i++ )
+    {
+        if( !nexts[i] )
+            continue;
+        if( !matches( &rules[i], nexts[i] ) )
+            bad++;
+        if( nexts[i] - afters[i] > 60UL * 86400 )
+            continue;
+        for( epoch = afters[i] + 1; epoch < nexts[i]; epoch++ )
+            if( matches( &rules[i], epoch ) )
+            {
+                bad++;
+                break;
+            }
+    }
+    CHECK( bad == 0 );
+
+    return TEST_DONE();
+}
@@ -0,0 +1,83 @@
+/*******************************************************************************
+* Title                 :   Mixed bus speed
+* Filename              :   bench_speed.c
+*******************************************************************************/
+/** @file bench_speed.c
+ *
+ *  @brief Total bus time of a DS1307 and an MCP7941X sharing the bus, with
+ *  the whole bus at 100 kHz against switching per target through the
+ *  rtc_hal_set_clock hook.
+ *
+ *  The library drives the MCP7941X and sets its own speed, the DS1307 is
+ *  the application's and read through the HAL. Every clock switch costs
+ *  the fake's peripheral re-init time.
+ */
+#include "test.h"
+
+#define TRANSFERS   1000
+
+static uint32_t switches;
+
+static void bus_clock( uint16_t khz )
+{
+    rtc_hal_fake_clock( khz );
+    switches++;
+}
+
+/*
+ * Nine MCP7941X EEPROM and SRAM reads for every DS1307 read
+ */
+static uint32_t run( const char *name )
+{
+    uint8_t data[16];
+    uint32_t i;
+    uint32_t time_us;
+
+    rtc_hal_fake_clear();
+    switches = 0;
+    for( i = 0; i < TRANSFERS; i++ )
+    {
+        if( i % 10 == 0 )
+        {
+            rtc_hal_set_slave( 0x68 );
+            rtc_hal_set_speed( rtc_get_bus_khz( RTC2_DS1307 ) );
+            CHECK( rtc_hal_read( 0x00, data, 7 ) == 0 );
+        } else if( i & 1 ) {
+            CHECK( rtc_eeprom_read_block( 0x00, data, 8 ) == 0 );
+        } else {
+            rtc_read_sram_bulk( 0x00, data, 16 );
+        }
+    }
+    time_us = rtc_hal_fake_stats()->time_us;
+    printf( "%-22s %8lu us bus time %5lu clock switches\n", name,
+            ( unsigned long )time_us, ( unsigned long )switches );
+
+    return time_us;
+}
+
+int main()
+{
+    uint32_t fixed;
+    uint32_t switched;
+
+    test_chip( RTC6_MCP7941X, NULL );
+    rtc_hal_fake_attach( 0x68, 0, 0 );
+    CHECK( rtc_init( RTC6_MCP7941X, 0 ) == 0 );
+
+    CHECK( rtc_get_bus_khz( RTC2_DS1307 ) == 100 );
+    CHECK( rtc_get_bus_khz( RTC6_MCP7941X ) == 400 );
+
+    // no hook, the bus stays at the 100 kHz the DS1307 needs
+    rtc_hal_set_clock( NULL );
+    rtc_hal_fake_clock( 100 );
+    fixed = run( "fixed 100 kHz" );
+
+    rtc_hal_set_clock( bus_clock );
+    switched = run( "per target" );
+    printf( "bus time saved %.0f%%\n", 100.0 - switched * 100.0 / fixed );
+    CHECK( rtc_get_error() == 0 );
+    CHECK( switched < fixed / 2 );
+    CHECK( switches == 2 * TRANSFERS / 10 );
+
+    return TEST_DONE();
+}
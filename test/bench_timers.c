@@ -0,0 +1,97 @@
+/*******************************************************************************
+* Title                 :   Software timer heap
+* Filename              :   bench_timers.c
+*******************************************************************************/
+/** @file bench_timers.c
+ *
+ *  @brief 1,000 timers on the MCP7941X alarm: host time per insert, cancel
+ *  and expiry, and how often the alarm is rewritten.
+ *
+ *  Built with RTC_TIMER_MAX=1000, see the Makefile.
+ */
+#include <stdlib.h>
+#include <time.h>
+#include "test.h"
+
+#define TIMERS      1000
+
+static int ids[TIMERS];
+static uint32_t last_deadline;
+static int fired;
+static int out_of_order;
+
+static double now_s()
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void on_timer( int id, void *arg )
+{
+    uint32_t deadline = ( uint32_t )( uintptr_t )arg;
+
+    ( void )id;
+    if( deadline < last_deadline )
+        out_of_order++;
+    last_deadline = deadline;
+    fired++;
+}
+
+static void report( const char *name, double seconds, int count )
+{
+    const rtc_hal_fake_stats_t *stats = rtc_hal_fake_stats();
+
+    printf( "%-24s %5d ops %7.0f ns/op %5lu bus STARTs %7lu bus us\n", name, count,
+            seconds * 1e9 / count, ( unsigned long )stats->starts,
+            ( unsigned long )stats->time_us );
+}
+
+int main()
+{
+    uint8_t *regs;
+    uint32_t now;
+    uint32_t deadline;
+    double t;
+    int cancelled = 0;
+    int i;
+
+    regs = test_chip( RTC6_MCP7941X, NULL );
+    CHECK( rtc_init( RTC6_MCP7941X, 0 ) == 0 );
+    now = rtc_get_gmt_unix_time();
+    CHECK( now == 1451606400UL );
+    srand( 1 );
+
+    rtc_hal_fake_clear();
+    t = now_s();
+    for( i = 0; i < TIMERS; i++ )
+    {
+        deadline = now + 1 + rand() % 3600;
+        ids[i] = rtc_timer_start( deadline, on_timer, ( void * )( uintptr_t )deadline );
+        CHECK( ids[i] >= 0 );
+    }
+    report( "rtc_timer_start", now_s() - t, TIMERS );
+    CHECK( rtc_timer_start( now + 1, on_timer, NULL ) == -1 );   // full
+
+    rtc_hal_fake_clear();
+    t = now_s();
+    for( i = 0; i < TIMERS; i += 2 )
+    {
+        CHECK( rtc_timer_cancel( ids[i] ) == 0 );
+        cancelled++;
+    }
+    report( "rtc_timer_cancel", now_s() - t, cancelled );
+
+    // two hours later every deadline is due, one service call fires them
+    regs[0x02] = 0x02;
+    rtc_hal_fake_clear();
+    t = now_s();
+    CHECK( rtc_timer_service() == TIMERS - cancelled );
+    report( "rtc_timer_service fire", now_s() - t, fired );
+    CHECK( fired == TIMERS - cancelled );
+    CHECK( out_of_order == 0 );
+    CHECK( rtc_timer_next() == 0 );
+
+    return TEST_DONE();
+}
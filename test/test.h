@@ -0,0 +1,82 @@
+/*******************************************************************************
+* Title                 :   Host test helpers
+* Filename              :   test.h
+*******************************************************************************/
+/** @file test.h
+ *
+ *  @brief Check macros and chip models for the host tests, built with
+ *  RTC_HAL_FAKE so the library talks to library/src/rtc_hal_fake.c.
+ */
+#ifndef TEST_H_
+#define TEST_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "rtc.h"
+#include "rtc_hal.h"
+
+static int test_failures;
+
+#define CHECK( cond )                                                       \
+    do {                                                                    \
+        if( !( cond ) )                                                     \
+        {                                                                   \
+            printf( "%s:%d: CHECK( %s ) failed\n", __FILE__, __LINE__, #cond ); \
+            test_failures++;                                                \
+        }                                                                   \
+    } while( 0 )
+
+#define TEST_DONE()                                                         \
+    ( printf( "%s: %s\n", __FILE__, test_failures ? "FAILED" : "ok" ),      \
+      test_failures ? 1 : 0 )
+
+#ifdef RTC_HAL_FAKE
+/*
+ * Register file of the chip, the MCP7941X EEPROM is returned through
+ * eeprom. Oscillators run and the time is 2016-01-01 00:00:00.
+ */
+static inline uint8_t *test_chip( rtc_type_t type, uint8_t **eeprom )
+{
+    uint8_t *regs = NULL;
+
+    rtc_hal_fake_reset();
+    rtc_hal_set_clock( rtc_hal_fake_clock );
+    if( eeprom )
+        *eeprom = NULL;
+
+    switch( type )
+    {
+        case RTC_PCF8583:
+            regs = rtc_hal_fake_attach( 0x50, 0, 0 );
+            regs[0x05] = 0x01;          // year 0, day 1
+            regs[0x06] = 0x01;          // month 1
+            break;
+        case RTC2_DS1307:
+        case RTC3_BQ32000:
+        case RTC_DS3231:
+            regs = rtc_hal_fake_attach( 0x68, 0, 0 );
+            regs[0x03] = 0x05;          // Friday
+            regs[0x04] = 0x01;
+            regs[0x05] = 0x01;
+            regs[0x06] = 0x16;
+            break;
+        case RTC6_MCP7941X:
+            regs = rtc_hal_fake_attach( 0x6F, 0, 0 );
+            regs[0x00] = 0x80;          // ST
+            regs[0x03] = 0x20 | 0x05;   // OSCRUN, Friday
+            regs[0x04] = 0x01;
+            regs[0x05] = 0x01;
+            regs[0x06] = 0x16;
+            if( eeprom )
+                *eeprom = rtc_hal_fake_attach( 0x57, 8, 5 );
+            else
+                rtc_hal_fake_attach( 0x57, 8, 5 );
+            break;
+    }
+
+    return regs;
+}
+#endif
+
+#endif /* TEST_H_ */
@@ -0,0 +1,472 @@
+/*******************************************************************************
+* Title                 :   Vendor backend transfers
+* Filename              :   test_backends.c
+*******************************************************************************/
+/** @file test_backends.c
+ *
+ *  @brief Call by call sequences of the STM32, FT90x, TIVA and AVR
+ *  backends, rtc_hal.c built for one of them against the recording stubs
+ *  in backend_stubs.h, see the Makefile.
+ *
+ *  Each call is logged as a token: S start, P stop, W write with its
+ *  bytes, R read with its count, A slave address, w and r single bytes.
+ */
+#include <stdarg.h>
+#include "test.h"
+
+#define SLAVE       0x68
+#define LONG_SIZE   ( RTC_HAL_BURST_MAX + 6 )
+
+static char wire[8192];
+static size_t wire_len;
+static uint8_t next_byte;       // reads return 0x00, 0x01, ... per case
+static bool present = true;
+
+static void log_add( const char *fmt, ... )
+{
+    va_list args;
+
+    va_start( args, fmt );
+    wire_len += vsnprintf( &wire[wire_len], sizeof( wire ) - wire_len, fmt, args );
+    va_end( args );
+}
+
+#if defined( STM32 ) || defined( __MIKROC_PRO_FOR_FT90x__ )
+static void log_bytes( const uint8_t *data, size_t count )
+{
+    size_t i;
+
+    for( i = 0; i < count; i++ )
+        log_add( i ? " %02X" : "%02X", data[i] );
+}
+#endif
+
+static void fill( uint8_t *data, size_t count )
+{
+    while( count-- )
+        *data++ = next_byte++;
+}
+
+static void clear()
+{
+    wire_len = 0;
+    wire[0] = '\0';
+    next_byte = 0;
+}
+
+/*
+ * The log since clear() is want, tokens separated by one space
+ */
+static bool wire_is( const char *want )
+{
+    const char *got = ( wire_len && wire[0] == ' ' ) ? &wire[1] : wire;
+
+    if( strcmp( got, want ) )
+    {
+        printf( "  got  %s\n  want %s\n", got, want );
+        return false;
+    }
+
+    return true;
+}
+
+void Delay_us( unsigned long us )
+{
+    ( void )us;
+}
+
+void VDelay_ms( unsigned int ms )
+{
+    ( void )ms;
+}
+
+/******************************************************************************
+* Stubs
+*******************************************************************************/
+#if defined( STM32 )
+unsigned int I2C_Start_Ptr()
+{
+    log_add( " S" );
+    return 0;
+}
+
+unsigned int I2C_Write_Ptr( unsigned char slave_address, unsigned char *buffer,
+                            unsigned long count, unsigned long end_mode )
+{
+    log_add( " W%02X[", slave_address );
+    log_bytes( buffer, count );
+    log_add( "]%s", end_mode == END_MODE_STOP ? "P" : "R" );
+    return present ? 0 : 1;
+}
+
+void I2C_Read_Ptr( unsigned char slave_address, unsigned char *buffer,
+                   unsigned long count, unsigned long end_mode )
+{
+    log_add( " R%02X[%lu]%s", slave_address, count,
+             end_mode == END_MODE_STOP ? "P" : "R" );
+    fill( buffer, count );
+}
+
+#elif defined( TIVA )
+static const char *mode_name( unsigned char mode )
+{
+    switch( mode )
+    {
+        case _I2C_MASTER_MODE_SINGLE_SEND:          return "SS";
+        case _I2C_MASTER_MODE_BURST_SEND_START:     return "BSS";
+        case _I2C_MASTER_MODE_BURST_SEND_CONT:      return "BSC";
+        case _I2C_MASTER_MODE_BURST_SEND_FINISH:    return "BSF";
+        case _I2C_MASTER_MODE_SINGLE_RECEIVE:       return "SR";
+        case _I2C_MASTER_MODE_BURST_RECEIVE_START:  return "BRS";
+        case _I2C_MASTER_MODE_BURST_RECEIVE_CONT:   return "BRC";
+        case _I2C_MASTER_MODE_BURST_RECEIVE_FINISH: return "BRF";
+        default:                                    return "?";
+    }
+}
+
+void I2C_Enable_Ptr()
+{
+}
+
+void I2C_Disable_Ptr()
+{
+}
+
+void I2C_Master_Slave_Addr_Set_Ptr( unsigned char slave_address,
+                                    unsigned char dir )
+{
+    log_add( " A%02X%s", slave_address,
+             dir == _I2C_DIR_MASTER_RECEIVE ? "R" : "T" );
+}
+
+unsigned char I2C_Write_Ptr( unsigned char data_out, unsigned char mode )
+{
+    log_add( " w%02X:%s", data_out, mode_name( mode ) );
+    return present ? 0 : 1;
+}
+
+unsigned char I2C_Read_Ptr( unsigned char *data_in, unsigned char mode )
+{
+    log_add( " r:%s", mode_name( mode ) );
+    fill( data_in, 1 );
+    return 0;
+}
+
+#elif defined( __MIKROC_PRO_FOR_FT90x__ )
+void I2CM_Soft_Reset_Ptr()
+{
+}
+
+void I2CM_Set_Slave_Address_Ptr( unsigned char slave_address )
+{
+    log_add( " A%02X", slave_address );
+}
+
+unsigned char I2CM_Write_Ptr( unsigned char data_out )
+{
+    log_add( " w%02X", data_out );
+    return present ? 0 : 1;
+}
+
+unsigned char I2CM_Read_Ptr( unsigned char *data_in )
+{
+    log_add( " r" );
+    fill( data_in, 1 );
+    return 0;
+}
+
+unsigned char I2CM_Write_Bytes_Ptr( unsigned char *buffer, unsigned int count )
+{
+    log_add( " W[" );
+    log_bytes( buffer, count );
+    log_add( "]" );
+    return present ? 0 : 1;
+}
+
+unsigned char I2CM_Read_Bytes_Ptr( unsigned char *buffer, unsigned int count )
+{
+    log_add( " R[%u]", count );
+    fill( buffer, count );
+    return 0;
+}
+
+#elif defined( __MIKROC_PRO_FOR_AVR__ )
+static bool twi_address;        // next write is SLA+R/W
+static unsigned char twi_status;
+
+unsigned char TWIC_Busy()
+{
+    return 0;
+}
+
+unsigned char TWIC_Status()
+{
+    return twi_status | 0x01;   // prescaler bits are masked off
+}
+
+void TWIC_Close()
+{
+}
+
+unsigned char TWIC_Start()
+{
+    log_add( " S" );
+    twi_address = true;
+    return 0;
+}
+
+void TWIC_Stop()
+{
+    log_add( " P" );
+}
+
+void TWIC_Write( unsigned char data_out )
+{
+    log_add( " w%02X", data_out );
+    if( !twi_address )
+        twi_status = 0x28;                              // data ACK
+    else if( !present )
+        twi_status = ( data_out & 1 ) ? 0x48 : 0x20;    // SLA NACK
+    else
+        twi_status = ( data_out & 1 ) ? 0x40 : 0x18;
+    twi_address = false;
+}
+
+unsigned char TWIC_Read( unsigned char ack )
+{
+    uint8_t data;
+
+    log_add( " r%s", ack ? "+" : "-" );
+    fill( &data, 1 );
+    return data;
+}
+#endif
+
+/******************************************************************************
+* Expected sequences
+*******************************************************************************/
+/*
+ * Register 0x08 and data 0x11 0x22 0x33
+ */
+static const char *want_write3()
+{
+#if defined( STM32 )
+    return "S W68[08 11 22 33]P";
+#elif defined( TIVA )
+    return "A68T w08:BSS w11:BSC w22:BSC w33:BSF";
+#elif defined( __MIKROC_PRO_FOR_FT90x__ )
+    return "A68 W[08 11 22 33]";
+#else
+    return "S wD0 w08 w11 w22 w33 P";
+#endif
+}
+
+/*
+ * Pointer write to 0x0E, no data
+ */
+static const char *want_write0()
+{
+#if defined( STM32 )
+    return "S W68[0E]P";
+#elif defined( TIVA )
+    return "A68T w0E:SS";
+#elif defined( __MIKROC_PRO_FOR_FT90x__ )
+    return "A68 W[0E]";
+#else
+    return "S wD0 w0E P";
+#endif
+}
+
+/*
+ * LONG_SIZE bytes of data[] from 0x08, STM32 and FT90x split it into
+ * RTC_HAL_BURST_MAX bursts each starting at its own register
+ */
+static void want_long( char *want, const uint8_t *data )
+{
+    size_t len = 0;
+    size_t i;
+
+#if defined( STM32 ) || defined( __MIKROC_PRO_FOR_FT90x__ )
+#if defined( STM32 )
+    len += sprintf( &want[len], "S W68[08" );
+#else
+    len += sprintf( &want[len], "A68 W[08" );
+#endif
+    for( i = 0; i < RTC_HAL_BURST_MAX; i++ )
+        len += sprintf( &want[len], " %02X", data[i] );
+#if defined( STM32 )
+    len += sprintf( &want[len], "]P S W68[%02X", 0x08 + RTC_HAL_BURST_MAX );
+#else
+    len += sprintf( &want[len], "] W[%02X", 0x08 + RTC_HAL_BURST_MAX );
+#endif
+    for( ; i < LONG_SIZE; i++ )
+        len += sprintf( &want[len], " %02X", data[i] );
+#if defined( STM32 )
+    sprintf( &want[len], "]P" );
+#else
+    sprintf( &want[len], "]" );
+#endif
+#elif defined( TIVA )
+    len += sprintf( &want[len], "A68T w08:BSS" );
+    for( i = 0; i < LONG_SIZE - 1; i++ )
+        len += sprintf( &want[len], " w%02X:BSC", data[i] );
+    sprintf( &want[len], " w%02X:BSF", data[i] );
+#else
+    len += sprintf( &want[len], "S wD0 w08" );
+    for( i = 0; i < LONG_SIZE; i++ )
+        len += sprintf( &want[len], " w%02X", data[i] );
+    sprintf( &want[len], " P" );
+#endif
+}
+
+/*
+ * LONG_SIZE bytes streamed from 0x08, one transaction where the backend
+ * hands bytes over as they come, RTC_HAL_BURST_MAX chunks elsewhere
+ */
+static void want_stream( char *want )
+{
+#if defined( STM32 )
+    sprintf( want, "S W68[08]R R68[%d]P S W68[%02X]R R68[6]P", RTC_HAL_BURST_MAX,
+             0x08 + RTC_HAL_BURST_MAX );
+#elif defined( __MIKROC_PRO_FOR_FT90x__ )
+    sprintf( want, "A68 w08 R[%d] A68 w%02X R[6]", RTC_HAL_BURST_MAX,
+             0x08 + RTC_HAL_BURST_MAX );
+#else
+    size_t len = 0;
+    size_t i;
+
+#if defined( TIVA )
+    len += sprintf( &want[len], "A68T w08:SS A68R r:BRS" );
+    for( i = 2; i < LONG_SIZE; i++ )
+        len += sprintf( &want[len], " r:BRC" );
+    sprintf( &want[len], " r:BRF" );
+#else
+    len += sprintf( &want[len], "S wD0 w08 S wD1" );
+    for( i = 1; i < LONG_SIZE; i++ )
+        len += sprintf( &want[len], " r+" );
+    sprintf( &want[len], " r- P" );
+#endif
+#endif
+}
+
+static uint8_t streamed[LONG_SIZE];
+static size_t streamed_count;
+
+static void stream_byte( uint8_t data, void *arg )
+{
+    ( void )arg;
+    streamed[streamed_count++] = data;
+}
+
+/*
+ * Three bytes from 0x08
+ */
+static const char *want_read3()
+{
+#if defined( STM32 )
+    return "S W68[08]R R68[3]P";
+#elif defined( TIVA )
+    return "A68T w08:SS A68R r:BRS r:BRC r:BRF";
+#elif defined( __MIKROC_PRO_FOR_FT90x__ )
+    return "A68 w08 R[3]";
+#else
+    return "S wD0 w08 S wD1 r+ r+ r- P";
+#endif
+}
+
+/*
+ * One byte from 0x08
+ */
+static const char *want_read1()
+{
+#if defined( STM32 )
+    return "S W68[08]R R68[1]P";
+#elif defined( TIVA )
+    return "A68T w08:SS A68R r:SR";
+#elif defined( __MIKROC_PRO_FOR_FT90x__ )
+    return "A68 w08 R[1]";
+#else
+    return "S wD0 w08 S wD1 r- P";
+#endif
+}
+
+/*
+ * Address byte NACKed on every attempt
+ */
+static const char *want_absent()
+{
+#if defined( STM32 )
+    return "S W68[08 11]P S W68[08 11]P S W68[08 11]P";
+#elif defined( TIVA )
+    return "A68T w08:BSS A68T w08:BSS A68T w08:BSS";
+#elif defined( __MIKROC_PRO_FOR_FT90x__ )
+    return "A68 W[08 11] A68 W[08 11] A68 W[08 11]";
+#else
+    return "S wD0 P S wD0 P S wD0 P";
+#endif
+}
+
+int main()
+{
+    static char want[8192];
+    uint8_t data[LONG_SIZE];
+    uint8_t back[LONG_SIZE];
+    size_t i;
+
+#if defined( STM32 )
+    printf( "STM32\n" );
+#elif defined( TIVA )
+    printf( "TIVA\n" );
+#elif defined( __MIKROC_PRO_FOR_FT90x__ )
+    printf( "FT90x\n" );
+#else
+    printf( "AVR\n" );
+#endif
+    rtc_hal_init( SLAVE );
+
+    clear();
+    memcpy( data, "\x11\x22\x33", 3 );
+    CHECK( rtc_hal_write( 0x08, data, 3 ) == 0 );
+    CHECK( wire_is( want_write3() ) );
+
+    clear();
+    CHECK( rtc_hal_write( 0x0E, data, 0 ) == 0 );
+    CHECK( wire_is( want_write0() ) );
+
+    for( i = 0; i < LONG_SIZE; i++ )
+        data[i] = ( uint8_t )( i * 3 + 1 );
+    clear();
+    CHECK( rtc_hal_write( 0x08, data, LONG_SIZE ) == 0 );
+    want_long( want, data );
+    CHECK( wire_is( want ) );
+
+    clear();
+    CHECK( rtc_hal_read( 0x08, back, 3 ) == 0 );
+    CHECK( wire_is( want_read3() ) );
+    CHECK( back[0] == 0 && back[1] == 1 && back[2] == 2 );
+
+    clear();
+    CHECK( rtc_hal_read( 0x08, back, 1 ) == 0 );
+    CHECK( wire_is( want_read1() ) );
+    CHECK( back[0] == 0 );
+
+    clear();
+    CHECK( rtc_hal_read( 0x08, back, 0 ) == 0 );
+    CHECK( wire_is( "" ) );
+
+    clear();
+    CHECK( rtc_hal_read_stream( 0x08, LONG_SIZE, stream_byte, NULL ) == 0 );
+    want_stream( want );
+    CHECK( wire_is( want ) );
+    CHECK( streamed_count == LONG_SIZE );
+    for( i = 0; i < LONG_SIZE; i++ )
+        CHECK( streamed[i] == i );
+
+    present = false;
+    clear();
+    memcpy( data, "\x11", 1 );
+    CHECK( rtc_hal_write( 0x08, data, 1 ) == -1 );
+    CHECK( RTC_HAL_RETRIES != 2 || wire_is( want_absent() ) );
+
+    return TEST_DONE();
+}
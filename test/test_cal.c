@@ -0,0 +1,91 @@
+/*******************************************************************************
+* Title                 :   Calendar helpers
+* Filename              :   test_cal.c
+*******************************************************************************/
+/** @file test_cal.c
+ *
+ *  @brief Every day from 2000 to 2099 against gmtime() and strftime( %V ).
+ */
+#include <stdlib.h>
+#include <time.h>
+#include "test.h"
+
+int main()
+{
+    static const uint32_t seconds[] = { 0, 43199, 86399 };
+    uint32_t start = 946684800UL;           // 2000-01-01
+    uint32_t end = 4102444800UL;            // 2100-01-01
+    uint32_t day;
+    uint32_t epoch;
+    uint16_t year;
+    uint8_t month;
+    time_t t;
+    struct tm tm;
+    struct tm next;
+    char week[4];
+    int monday;
+    int first;
+    int days;
+    int bad = 0;
+    size_t s;
+    rtc_time_t ts;
+
+    for( day = start; day < end; day += 86400 )
+    {
+        for( s = 0; s < sizeof( seconds ) / sizeof( seconds[0] ); s++ )
+        {
+            epoch = day + seconds[s];
+            t = epoch;
+            gmtime_r( &t, &tm );
+            strftime( week, sizeof( week ), "%V", &tm );
+            monday = ( tm.tm_wday + 6 ) % 7;                        // 0 is Monday
+            first = ( monday - ( tm.tm_mday - 1 ) % 7 + 7 ) % 7;    // weekday of the 1st
+
+            if( rtc_cal_day_of_year( epoch ) != tm.tm_yday + 1 ||
+                rtc_cal_iso_week( epoch ) != atoi( week ) ||
+                rtc_cal_week_of_month( epoch ) != ( tm.tm_mday - 1 + first ) / 7 + 1 )
+            {
+                if( !bad++ )
+                    printf( "  %04d-%02d-%02d: day %u week %u week of month %u\n",
+                            tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+                            rtc_cal_day_of_year( epoch ), rtc_cal_iso_week( epoch ),
+                            rtc_cal_week_of_month( epoch ) );
+            }
+
+            rtc_cal_to_times( &epoch, &ts, 1 );
+            if( ts.year != tm.tm_year - 100 || ts.month != tm.tm_mon + 1 ||
+                ts.monthday != tm.tm_mday || ts.weekday != monday + 1 ||
+                ts.hours != tm.tm_hour || ts.minutes != tm.tm_min ||
+                ts.seconds != tm.tm_sec )
+                bad++;
+            ts.weekday = 0;
+            rtc_cal_to_epochs( &ts, &epoch, 1 );
+            if( epoch != day + seconds[s] )
+                bad++;
+        }
+    }
+    CHECK( bad == 0 );
+
+    // month lengths from the first of the next month
+    for( year = 2000; year < 2100; year++ )
+    {
+        for( month = JANUARY; month <= DECEMBER; month++ )
+        {
+            memset( &next, 0, sizeof( next ) );
+            next.tm_year = year - 1900;
+            next.tm_mon = month;        // next month, 0 based
+            next.tm_mday = 0;           // the day before its 1st
+            t = timegm( &next );
+            gmtime_r( &t, &next );
+            days = next.tm_mday;
+            CHECK( rtc_cal_days_in_month( year, month ) == days );
+        }
+        CHECK( rtc_cal_is_leap( year ) == ( rtc_cal_days_in_month( year, FEBRUARY ) == 29 ) );
+        CHECK( rtc_cal_is_leap( year ) == ( year % 4 == 0 ) );
+    }
+    CHECK( rtc_cal_days_in_month( 2016, 0 ) == 0 );
+    CHECK( rtc_cal_days_in_month( 2016, 13 ) == 0 );
+    CHECK( !rtc_cal_is_leap( 2100 ) && rtc_cal_is_leap( 2000 ) );
+
+    return TEST_DONE();
+}
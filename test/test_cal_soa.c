@@ -0,0 +1,135 @@
+/*******************************************************************************
+* Title                 :   SoA calendar kernels
+* Filename              :   test_cal_soa.c
+*******************************************************************************/
+/** @file test_cal_soa.c
+ *
+ *  @brief The vector kernels against the scalar conversions.
+ *
+ *  Built once for the default instruction set and once with -mavx2.
+ */
+#include <stdlib.h>
+#include "test.h"
+
+#define COUNT       4099        // not a multiple of the lanes, the tail is scalar
+
+static uint8_t fields[7][COUNT];
+static rtc_time_soa_t soa =
+{
+    fields[0], fields[1], fields[2], fields[3], fields[4], fields[5], fields[6]
+};
+
+static uint32_t epochs[COUNT];
+static uint32_t back[COUNT];
+static rtc_time_t times[COUNT];
+
+static uint32_t next_random()
+{
+    static uint32_t x = 2463534242UL;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+static int compare_times( size_t count )
+{
+    size_t i;
+    int bad = 0;
+
+    rtc_cal_to_times( epochs, times, count );
+    rtc_cal_to_times_soa( epochs, &soa, count );
+
+    for( i = 0; i < count; i++ )
+        if( soa.seconds[i] != times[i].seconds ||
+            soa.minutes[i] != times[i].minutes ||
+            soa.hours[i] != times[i].hours ||
+            soa.weekday[i] != times[i].weekday ||
+            soa.monthday[i] != times[i].monthday ||
+            soa.month[i] != times[i].month ||
+            soa.year[i] != times[i].year )
+        {
+            if( !bad++ )
+                printf( "  epoch %lu differs\n", ( unsigned long )epochs[i] );
+        }
+
+    return bad;
+}
+
+static int compare_epochs( size_t count )
+{
+    size_t i;
+    int bad = 0;
+
+    for( i = 0; i < count; i++ )
+    {
+        times[i].seconds = soa.seconds[i];
+        times[i].minutes = soa.minutes[i];
+        times[i].hours = soa.hours[i];
+        times[i].weekday = soa.weekday[i];
+        times[i].monthday = soa.monthday[i];
+        times[i].month = soa.month[i];
+        times[i].year = soa.year[i];
+    }
+    rtc_cal_to_epochs( times, epochs, count );
+    rtc_cal_to_epochs_soa( &soa, back, count );
+
+    for( i = 0; i < count; i++ )
+        if( back[i] != epochs[i] && !bad++ )
+            printf( "  %u-%u-%u differs\n", soa.year[i], soa.month[i],
+                    soa.monthday[i] );
+
+    return bad;
+}
+
+int main()
+{
+    uint32_t day;
+    size_t n;
+    size_t i;
+    int r;
+
+    // every day from 1970 to 2106 at a random second
+    for( day = 0; day <= 0xFFFFFFFFUL / 86400; day += COUNT )
+    {
+        n = 0;
+        for( i = 0; i < COUNT && day + i <= 0xFFFFFFFFUL / 86400; i++ )
+            epochs[n++] = ( day + i ) * 86400UL + next_random() % 86400;
+        CHECK( compare_times( n ) == 0 );
+        CHECK( compare_epochs( n ) == 0 );
+    }
+
+    // random epochs, both ends, and every count for the tail handling
+    for( r = 0; r < 2000; r++ )
+    {
+        for( i = 0; i < COUNT; i++ )
+            epochs[i] = next_random();
+        epochs[0] = 0;
+        epochs[1] = 0xFFFFFFFFUL;
+        epochs[2] = 0x7FFFFFFFUL;
+        epochs[3] = 0x80000000UL;
+        CHECK( compare_times( COUNT ) == 0 );
+    }
+    for( n = 0; n < 20; n++ )
+        CHECK( compare_times( n ) == 0 );
+
+    // out of range fields wrap like the scalar code
+    for( r = 0; r < 200; r++ )
+    {
+        for( i = 0; i < COUNT; i++ )
+        {
+            uint32_t x = next_random();
+
+            soa.seconds[i] = x;
+            soa.minutes[i] = x >> 8;
+            soa.hours[i] = x >> 16;
+            soa.monthday[i] = x >> 24;
+            soa.month[i] = next_random();
+            soa.year[i] = next_random();
+        }
+        CHECK( compare_epochs( COUNT ) == 0 );
+    }
+
+    return TEST_DONE();
+}
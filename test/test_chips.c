@@ -0,0 +1,69 @@
+/*******************************************************************************
+* Title                 :   Chip round trips
+* Filename              :   test_chips.c
+*******************************************************************************/
+/** @file test_chips.c
+ *
+ *  @brief Init, time write and read back on every supported chip, packed
+ *  stamps where there is SRAM.
+ */
+#include "test.h"
+
+static const char *names[] =
+{
+    "PCF8583", "DS1307", "BQ32000", "MCP7941X", "DS3231"
+};
+
+int main()
+{
+    rtc_time_t set = { 56, 34, 12, 3, 15, 6, 21 };  // Tue 2021-06-15 12:34:56
+    rtc_stamp_t stamp = { 1623760496UL, 42 };
+    rtc_stamp_t back;
+    rtc_time_t *got;
+    rtc_type_t type;
+    bool sram;
+
+    for( type = RTC_PCF8583; type <= RTC_DS3231; type++ )
+    {
+        test_chip( type, NULL );
+        printf( "%s\n", names[type] );
+
+        CHECK( rtc_init( type, 0 ) == 0 );
+        CHECK( rtc_set_gmt_time( set ) == 0 );
+        got = rtc_get_gmt_time();
+        CHECK( got != NULL );
+        if( !got )
+            continue;
+        CHECK( got->seconds == set.seconds );
+        CHECK( got->minutes == set.minutes );
+        CHECK( got->hours == set.hours );
+        CHECK( got->monthday == set.monthday );
+        CHECK( got->month == set.month );
+        CHECK( got->year == set.year );
+        CHECK( rtc_get_gmt_unix_time() == 1623760496UL );
+        CHECK( rtc_get_error() == 0 );
+
+        // no SRAM or past its end is refused, not read back uninitialized
+        sram = type == RTC2_DS1307 || type == RTC6_MCP7941X || type == RTC_DS3231;
+        CHECK( rtc_write_stamp_sram( 0, &stamp, RTC_PACKED_HUNDREDTHS_SIZE ) ==
+               ( sram ? 0 : -1 ) );
+        memset( &back, 0, sizeof( back ) );
+        CHECK( rtc_read_stamp_sram( 0, &back, RTC_PACKED_HUNDREDTHS_SIZE ) ==
+               ( sram ? 0 : -1 ) );
+        CHECK( !sram || ( back.epoch == stamp.epoch && back.hundredths == 42 ) );
+        CHECK( rtc_write_stamp_sram( 250, &stamp, RTC_PACKED_SIZE ) == -1 );
+        CHECK( rtc_read_stamp_sram( 250, &back, RTC_PACKED_SIZE ) == -1 );
+        CHECK( rtc_write_stamp_eeprom( 0, &stamp, RTC_PACKED_SIZE ) ==
+               ( type == RTC6_MCP7941X ? 0 : -1 ) );
+        CHECK( rtc_read_stamp_eeprom( 0, &back, RTC_PACKED_SIZE ) ==
+               ( type == RTC6_MCP7941X ? 0 : -1 ) );
+        CHECK( rtc_get_error() == 0 );
+    }
+
+    // nothing on the bus, every access NACKs
+    rtc_hal_fake_reset();
+    CHECK( rtc_init( RTC2_DS1307, 0 ) == -1 );
+    CHECK( rtc_hal_fake_stats()->nacks > 0 );
+
+    return TEST_DONE();
+}
@@ -0,0 +1,89 @@
+/*******************************************************************************
+* Title                 :   A/B commit under power loss
+* Filename              :   test_commit.c
+*******************************************************************************/
+/** @file test_commit.c
+ *
+ *  @brief Cuts the power at every byte of rtc_commit_write.
+ *
+ *  The fake SRAM keeps the bytes written before the cut. Afterwards
+ *  rtc_commit_read must return the old or the new copy, never a mix.
+ */
+#include "test.h"
+
+#define SRAM        0x20
+#define ADDR        4
+#define SIZE        13
+
+static void version( uint8_t *data, uint8_t v )
+{
+    uint8_t i;
+
+    for( i = 0; i < SIZE; i++ )
+        data[i] = ( uint8_t )( v * 31 + i );
+}
+
+int main()
+{
+    uint8_t old_data[SIZE];
+    uint8_t new_data[SIZE];
+    uint8_t data[SIZE];
+    uint8_t saved[64];
+    uint8_t *regs;
+    uint8_t v;
+    int32_t cut;
+    int cuts = 0;
+    int result;
+
+    regs = test_chip( RTC6_MCP7941X, NULL );
+    CHECK( rtc_init( RTC6_MCP7941X, 0 ) == 0 );
+
+    // never written
+    CHECK( rtc_commit_read( ADDR, data, SIZE ) == -1 );
+    CHECK( rtc_commit_write( ADDR, old_data, RTC_COMMIT_MAX + 1 ) == -1 );
+
+    version( old_data, 0 );
+    CHECK( rtc_commit_write( ADDR, old_data, SIZE ) == 0 );
+
+    // both slot parities
+    for( v = 1; v <= 2; v++ )
+    {
+        version( new_data, v );
+        memcpy( saved, &regs[SRAM], sizeof( saved ) );
+
+        for( cut = 0; ; cut++ )
+        {
+            memcpy( &regs[SRAM], saved, sizeof( saved ) );
+            rtc_hal_fake_cut( cut );
+            result = rtc_commit_write( ADDR, new_data, SIZE );
+            rtc_hal_fake_cut( -1 );
+
+            CHECK( rtc_commit_read( ADDR, data, SIZE ) == 0 );
+            if( result == 0 )
+            {
+                CHECK( !memcmp( data, new_data, SIZE ) );
+                break;
+            }
+            CHECK( !memcmp( data, old_data, SIZE ) ||
+                   !memcmp( data, new_data, SIZE ) );
+            cuts++;
+        }
+        memcpy( old_data, new_data, SIZE );
+    }
+    printf( "%d cut writes survived\n", cuts );
+    CHECK( cuts > 2 * ( SIZE + RTC_RECORD_CRC_SIZE ) );
+
+    // committed slot damaged later, the older copy comes back flagged
+    version( old_data, 2 );
+    version( new_data, 3 );
+    CHECK( rtc_commit_write( ADDR, new_data, SIZE ) == 0 );
+    regs[SRAM + ADDR + 1 + ( regs[SRAM + ADDR] & 1 ) * ( SIZE + RTC_RECORD_CRC_SIZE )] ^= 0x40;
+    CHECK( rtc_commit_read( ADDR, data, SIZE ) == 1 );
+    CHECK( !memcmp( data, old_data, SIZE ) );
+
+    // both damaged
+    regs[SRAM + ADDR + 1 + ( ~regs[SRAM + ADDR] & 1 ) * ( SIZE + RTC_RECORD_CRC_SIZE )] ^= 0x40;
+    CHECK( rtc_commit_read( ADDR, data, SIZE ) == -1 );
+
+    return TEST_DONE();
+}
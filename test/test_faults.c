@@ -0,0 +1,149 @@
+/*******************************************************************************
+* Title                 :   Bus faults
+* Filename              :   test_faults.c
+*******************************************************************************/
+/** @file test_faults.c
+ *
+ *  @brief Error paths with the bus cut at every byte, and retry latency.
+ *
+ *  A failed read returns NULL, 0 or -1 and leaves the cached time alone.
+ *  No partly read time may reach the caller.
+ */
+#include "test.h"
+
+static bool same_time( const rtc_time_t *a, const rtc_time_t *b )
+{
+    return a->seconds == b->seconds && a->minutes == b->minutes &&
+           a->hours == b->hours && a->monthday == b->monthday &&
+           a->month == b->month && a->year == b->year;
+}
+
+int main()
+{
+    rtc_time_t set = { 56, 34, 12, 3, 15, 6, 21 };
+    rtc_time_t *got;
+    rtc_type_t type;
+    int32_t cut;
+    uint32_t cached;
+    uint32_t time_us;
+    int failed;
+    int result;
+    uint8_t *regs;
+    rtc_outage_t outage;
+    uint32_t down;
+    uint32_t up;
+    uint8_t *eeprom;
+
+    for( type = RTC_PCF8583; type <= RTC_DS3231; type++ )
+    {
+        test_chip( type, NULL );
+        CHECK( rtc_init( type, 0 ) == 0 );
+        CHECK( rtc_set_gmt_time( set ) == 0 );
+        CHECK( rtc_get_gmt_time() != NULL );
+        cached = rtc_get_cached_unix_time();
+        rtc_get_error();
+
+        // every byte boundary of a time read, the PCF8583 also reads its year record
+        failed = 0;
+        for( cut = 0; cut < 12; cut++ )
+        {
+            rtc_hal_fake_cut( cut );
+            got = rtc_get_gmt_time();
+            rtc_hal_fake_cut( -1 );
+            if( got )
+                CHECK( same_time( got, &set ) );
+            else
+                failed++;
+        }
+        CHECK( failed > 0 );
+        CHECK( rtc_get_cached_unix_time() == cached );
+        CHECK( rtc_get_error() == -1 );
+
+        // dead bus, every getter reports it
+        rtc_hal_fake_cut( 0 );
+        CHECK( rtc_get_gmt_time() == NULL );
+        CHECK( rtc_get_local_time() == NULL );
+        CHECK( rtc_get_gmt_unix_time() == 0 );
+        CHECK( rtc_get_local_unix_time() == 0 );
+        CHECK( rtc_get_cached_unix_time() == cached );
+        CHECK( rtc_set_gmt_time( set ) == -1 );
+        CHECK( rtc_get_cached_unix_time() == 0 );     // chip time unknown
+        CHECK( rtc_init( type, 0 ) == -1 );
+        CHECK( rtc_get_error() == -1 );
+        rtc_hal_fake_cut( -1 );
+
+        // a write that returns 0 has landed
+        for( cut = 0; cut < 12; cut++ )
+        {
+            rtc_hal_fake_cut( cut );
+            failed = rtc_set_gmt_time( set );
+            rtc_hal_fake_cut( -1 );
+            got = rtc_get_gmt_time();
+            CHECK( got != NULL );
+            if( !failed && got )
+                CHECK( same_time( got, &set ) );
+        }
+        CHECK( rtc_init( type, 0 ) == 0 );
+    }
+
+    // MCP7941X SRAM writes return nothing, rtc_get_error catches them
+    test_chip( RTC6_MCP7941X, NULL );
+    CHECK( rtc_init( RTC6_MCP7941X, 0 ) == 0 );
+    rtc_get_error();
+    rtc_hal_fake_cut( 0 );
+    rtc_write_sram( 0x20, 0x5A );
+    CHECK( rtc_get_error() == -1 );
+    rtc_hal_fake_cut( -1 );
+    rtc_write_sram( 0x20, 0x5A );
+    CHECK( rtc_get_error() == 0 );
+    CHECK( rtc_read_sram( 0x20 ) == 0x5A );
+
+    // an outage stays pending until its log record has landed
+    regs = test_chip( RTC6_MCP7941X, &eeprom );
+    memset( eeprom, 0xFF, 32 );         // erased log
+    CHECK( rtc_init( RTC6_MCP7941X, 0 ) == 0 );
+    CHECK( rtc_outage_log_init( 0x00, 4 ) == 0 );
+    regs[0x03] |= 0x10;                 // PWRFAIL
+    failed = 0;
+    for( cut = 0; cut < 64; cut++ )
+    {
+        rtc_hal_fake_cut( cut );
+        result = rtc_get_outage( &outage );
+        rtc_hal_fake_cut( -1 );
+        if( result == 1 )
+            break;
+        CHECK( result == -1 );
+        CHECK( regs[0x03] & 0x10 );
+        failed++;
+    }
+    CHECK( result == 1 && failed > 0 );
+    CHECK( !( regs[0x03] & 0x10 ) );
+
+    // failed log writes did not move the log on, the first record is slot 0
+    CHECK( rtc_outage_log_read( 0, &down, &up ) == 0 );
+    CHECK( eeprom[0] == ( down & 0xFF ) && eeprom[4] == ( up & 0xFF ) );
+
+    // one NACK costs a retry after RTC_HAL_BACKOFF_MS
+    rtc_hal_fake_clear();
+    CHECK( rtc_get_gmt_time() != NULL );
+    time_us = rtc_hal_fake_stats()->time_us;
+    rtc_hal_fake_clear();
+    rtc_hal_fake_nack( 1 );
+    CHECK( rtc_get_gmt_time() != NULL );
+    CHECK( rtc_hal_fake_stats()->nacks == 1 );
+    printf( "time read %lu us, after one NACK %lu us\n",
+            ( unsigned long )time_us,
+            ( unsigned long )rtc_hal_fake_stats()->time_us );
+    CHECK( rtc_hal_fake_stats()->time_us >= time_us + RTC_HAL_BACKOFF_MS * 1000 );
+
+    // more NACKs than retries, the read gives up
+    rtc_hal_fake_clear();
+    rtc_hal_fake_nack( RTC_HAL_RETRIES + 1 );
+    CHECK( rtc_get_gmt_time() == NULL );
+    CHECK( rtc_hal_fake_stats()->starts == RTC_HAL_RETRIES + 1 );
+    printf( "gave up after %lu us\n",
+            ( unsigned long )rtc_hal_fake_stats()->time_us );
+    CHECK( rtc_get_gmt_time() != NULL );
+
+    return TEST_DONE();
+}
@@ -0,0 +1,72 @@
+/*******************************************************************************
+* Title                 :   Record CRC
+* Filename              :   test_record.c
+*******************************************************************************/
+/** @file test_record.c
+ *
+ *  @brief A damaged byte anywhere in a record or its CRC is caught, in
+ *  the SRAM and in the EEPROM with the record running across pages.
+ */
+#include "test.h"
+
+#define SRAM        0x20
+#define SIZE        13
+#define EEPROM_ADDR 4       // 4..18 runs across three 8 byte pages
+
+/*
+ * Flips every stored byte in turn, each one must fail the read
+ */
+static void damage( rtc_mem_t mem, uint16_t addr, uint8_t *stored,
+                    const uint8_t *data )
+{
+    uint8_t out[SIZE];
+    uint8_t i;
+
+    for( i = 0; i < SIZE + RTC_RECORD_CRC_SIZE; i++ )
+    {
+        stored[i] ^= 0x08;
+        CHECK( rtc_record_read( mem, addr, out, SIZE ) == -1 );
+        stored[i] ^= 0x08;
+    }
+    CHECK( rtc_record_read( mem, addr, out, SIZE ) == 0 );
+    CHECK( !memcmp( out, data, SIZE ) );
+}
+
+int main()
+{
+    uint8_t data[SIZE];
+    uint8_t out[SIZE];
+    uint8_t *regs;
+    uint8_t *eeprom;
+    uint8_t i;
+
+    for( i = 0; i < SIZE; i++ )
+        data[i] = ( uint8_t )( i * 37 + 1 );
+
+    regs = test_chip( RTC6_MCP7941X, &eeprom );
+    CHECK( rtc_init( RTC6_MCP7941X, 0 ) == 0 );
+
+    CHECK( rtc_record_write( RTC_MEM_SRAM, 0, data, RTC_RECORD_MAX + 1 ) == -1 );
+    CHECK( rtc_record_read( RTC_MEM_SRAM, 0, out, RTC_RECORD_MAX + 1 ) == -1 );
+    CHECK( rtc_record_read( RTC_MEM_SRAM, 64 - SIZE, out, SIZE ) == -1 );
+
+    CHECK( rtc_record_write( RTC_MEM_SRAM, 0, data, SIZE ) == 0 );
+    damage( RTC_MEM_SRAM, 0, &regs[SRAM], data );
+
+    CHECK( rtc_record_write( RTC_MEM_EEPROM, EEPROM_ADDR, data, SIZE ) == 0 );
+    damage( RTC_MEM_EEPROM, EEPROM_ADDR, &eeprom[EEPROM_ADDR], data );
+
+    // a failed read is not a record
+    rtc_get_error();
+    rtc_hal_fake_cut( 0 );
+    CHECK( rtc_record_read( RTC_MEM_EEPROM, EEPROM_ADDR, out, SIZE ) == -1 );
+    rtc_hal_fake_cut( -1 );
+    CHECK( rtc_get_error() == -1 );
+
+    // no SRAM on the BQ32000
+    test_chip( RTC3_BQ32000, NULL );
+    CHECK( rtc_init( RTC3_BQ32000, 0 ) == 0 );
+    CHECK( rtc_record_read( RTC_MEM_SRAM, 0, out, SIZE ) == -1 );
+
+    return TEST_DONE();
+}
@@ -0,0 +1,65 @@
+/*******************************************************************************
+* Title                 :   Timer arming
+* Filename              :   test_timers.c
+*******************************************************************************/
+/** @file test_timers.c
+ *
+ *  @brief Deadlines the alarm cannot catch run at once, a failed arm is
+ *  written again by the next one.
+ */
+#include "test.h"
+
+#define START_EPOCH 1451606400UL    // 2016-01-01 00:00:00
+
+static int fired;
+
+static void on_timer( int id, void *arg )
+{
+    ( void )id;
+    ( void )arg;
+    fired++;
+}
+
+int main()
+{
+    uint8_t *regs;
+    int id;
+
+    regs = test_chip( RTC_DS3231, NULL );
+    CHECK( rtc_init( RTC_DS3231, 0 ) == 0 );
+    CHECK( rtc_get_gmt_time() != NULL );
+
+    // due now and due next second: no alarm write, both run from start
+    rtc_hal_fake_clear();
+    CHECK( rtc_timer_start( START_EPOCH, on_timer, NULL ) >= 0 );
+    CHECK( rtc_timer_start( START_EPOCH + 1, on_timer, NULL ) >= 0 );
+    CHECK( fired == 2 );
+    CHECK( rtc_timer_next() == 0 );
+    CHECK( regs[0x07] == 0 && regs[0x08] == 0 );
+
+    // the cached time is stale, the chip passed the deadline meanwhile
+    regs[0x00] = 0x05;
+    CHECK( rtc_timer_start( START_EPOCH + 3, on_timer, NULL ) >= 0 );
+    CHECK( fired == 3 );
+    CHECK( rtc_timer_next() == 0 );
+
+    // a failed alarm write is not taken as armed
+    rtc_hal_fake_nack( 1 + RTC_HAL_RETRIES );
+    id = rtc_timer_start( START_EPOCH + 100, on_timer, NULL );
+    CHECK( id >= 0 );
+    CHECK( rtc_get_error() == -1 );
+    CHECK( regs[0x07] != 0x40 || regs[0x08] != 0x01 );
+
+    CHECK( rtc_timer_service() == 0 );
+    CHECK( regs[0x07] == 0x40 && regs[0x08] == 0x01 );      // 00:01:40
+    CHECK( rtc_get_error() == 0 );
+
+    // expiry through the alarm
+    regs[0x00] = 0x40;
+    regs[0x01] = 0x01;
+    CHECK( rtc_timer_service() == 1 );
+    CHECK( fired == 4 );
+    CHECK( rtc_timer_cancel( id ) == -1 );
+
+    return TEST_DONE();
+}
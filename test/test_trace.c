@@ -0,0 +1,94 @@
+/*******************************************************************************
+* Title                 :   Trace tags
+* Filename              :   test_trace.c
+*******************************************************************************/
+/** @file test_trace.c
+ *
+ *  @brief Transfers of nested library calls carry the outer call's tag,
+ *  built with RTC_HAL_TRACE.
+ */
+#include "test.h"
+
+#define START_EPOCH 1451606400UL    // 2016-01-01 00:00:00
+
+static uint16_t trace_from;
+static int fired;
+
+/*
+ * Every entry since the last call is tagged op, at least one is
+ */
+static bool tagged( uint8_t op )
+{
+    uint16_t head;
+    const volatile rtc_hal_trace_t *ring = rtc_hal_trace_ring( &head );
+    uint16_t i;
+    bool ok = head != trace_from;
+
+    for( i = trace_from; i != head; i++ )
+        if( ( ring[i & ( RTC_HAL_TRACE_SIZE - 1 )].op & 0x7F ) != op )
+        {
+            printf( "  entry %u is op %u, expected %u\n", i,
+                    ring[i & ( RTC_HAL_TRACE_SIZE - 1 )].op & 0x7F, op );
+            ok = false;
+        }
+    trace_from = head;
+
+    return ok;
+}
+
+static void on_timer( int id, void *arg )
+{
+    ( void )id;
+    ( void )arg;
+    CHECK( tagged( RTC_OP_TIMER ) );
+    rtc_get_temperature();
+    CHECK( tagged( RTC_OP_TRIM ) );
+    fired++;
+}
+
+int main()
+{
+    uint8_t *regs;
+    rtc_outage_t outage;
+    uint32_t down;
+    uint32_t up;
+    int id;
+
+    // outage log records go to the EEPROM under the power tag
+    regs = test_chip( RTC6_MCP7941X, NULL );
+    CHECK( rtc_init( RTC6_MCP7941X, 0 ) == 0 );
+    rtc_hal_trace_init( NULL );
+    trace_from = 0;
+    CHECK( rtc_outage_log_init( 0x40, 4 ) == 0 );
+    CHECK( tagged( RTC_OP_POWER ) );
+
+    regs[0x03] |= 0x10;         // PWRFAIL
+    CHECK( rtc_get_outage( &outage ) == 1 );
+    CHECK( tagged( RTC_OP_POWER ) );
+
+    CHECK( rtc_outage_log_read( 0, &down, &up ) == 0 );
+    CHECK( tagged( RTC_OP_POWER ) );
+
+    // the alarm and time reads of the timers stay timer transfers
+    regs = test_chip( RTC_DS3231, NULL );
+    CHECK( rtc_init( RTC_DS3231, 0 ) == 0 );
+    rtc_hal_trace_init( NULL );
+    trace_from = 0;
+    CHECK( rtc_timer_start( START_EPOCH + 10, on_timer, NULL ) >= 0 );
+    CHECK( tagged( RTC_OP_TIMER ) );
+    id = rtc_timer_start( START_EPOCH + 20, on_timer, NULL );
+    CHECK( id >= 0 );
+
+    // the callback tags its own calls, the re-arm after it is the timer's
+    regs[0x00] = 0x10;          // 10 seconds later
+    CHECK( rtc_timer_service() == 1 );
+    CHECK( fired == 1 );
+    CHECK( tagged( RTC_OP_TIMER ) );
+
+    CHECK( rtc_get_gmt_time() != NULL );
+    CHECK( tagged( RTC_OP_GET_TIME ) );
+    CHECK( rtc_timer_cancel( id ) == 0 );
+    CHECK( tagged( RTC_OP_TIMER ) );
+
+    return TEST_DONE();
+}
@@ -0,0 +1,176 @@
+/*******************************************************************************
+* Title                 :   Wire sequences
+* Filename              :   test_wire.c
+*******************************************************************************/
+/** @file test_wire.c
+ *
+ *  @brief Byte by byte conformance of the HAL transfers.
+ */
+#include "test.h"
+
+#define S   RTC_HAL_FAKE_START
+#define P   RTC_HAL_FAKE_STOP
+#define R   RTC_HAL_FAKE_READ
+#define N   RTC_HAL_FAKE_NACK
+
+#define EEPROM_SIZE 128
+
+static bool wire_is( const uint16_t *expect, size_t count )
+{
+    size_t got_count;
+    const uint16_t *got = rtc_hal_fake_wire( &got_count );
+    size_t i;
+
+    if( got_count != count )
+    {
+        printf( "  %lu entries, expected %lu\n", ( unsigned long )got_count,
+                ( unsigned long )count );
+        return false;
+    }
+    for( i = 0; i < count; i++ )
+        if( got[i] != expect[i] )
+        {
+            printf( "  entry %lu is %03X, expected %03X\n",
+                    ( unsigned long )i, got[i], expect[i] );
+            return false;
+        }
+
+    return true;
+}
+
+static uint8_t streamed[256];
+static size_t streamed_count;
+static size_t chunks;
+
+static void stream_byte( uint8_t data, void *arg )
+{
+    ( void )arg;
+    streamed[streamed_count++] = data;
+}
+
+static void stream_chunk( const uint8_t *data, uint16_t size, void *arg )
+{
+    ( void )arg;
+    memcpy( &streamed[streamed_count], data, size );
+    streamed_count += size;
+    chunks++;
+}
+
+int main()
+{
+    static const uint16_t write3[] = { S, 0xD0, 0x08, 0x11, 0x22, 0x33, P };
+    static const uint16_t write0[] = { S, 0xD0, 0x0E, P };
+    static const uint16_t read2[] = { S, 0xD0, 0x00, S, 0xD1,
+                                      R | 0x11, R | N | 0x22, P };
+    static const uint16_t nack[] = { S, 0xAE | N, P, S, 0xAE | N, P,
+                                     S, 0xAE | N, P };
+    static const uint16_t batch[] = { S, 0xD0, 0x00, S, 0xD1, R | N | 0x11, P,
+                                      S, 0xD0, 0x0A, S, 0xD1, R | 0x99,
+                                      R | N | 0x98, P };
+    uint8_t data[236];
+    uint8_t back[236];
+    uint8_t *regs;
+    uint8_t *eeprom;
+    uint8_t chunk[10];
+    rtc_cursor_t cursor;
+    uint16_t expect[2 + 1 + 236 + 1 + 1];
+    rtc_hal_read_t reads[2];
+    size_t i;
+
+    rtc_hal_fake_reset();
+    regs = rtc_hal_fake_attach( 0x68, 0, 0 );
+    rtc_hal_init( 0x68 );
+
+    // register, data, STOP
+    rtc_hal_fake_clear();
+    memcpy( data, "\x11\x22\x33", 3 );
+    CHECK( rtc_hal_write( 0x08, data, 3 ) == 0 );
+    CHECK( wire_is( write3, sizeof( write3 ) / sizeof( write3[0] ) ) );
+
+    // a pointer write carries no data
+    rtc_hal_fake_clear();
+    CHECK( rtc_hal_write( 0x0E, data, 0 ) == 0 );
+    CHECK( wire_is( write0, sizeof( write0 ) / sizeof( write0[0] ) ) );
+
+    // repeated START, the last byte is NACKed
+    regs[0] = 0x11;
+    regs[1] = 0x22;
+    rtc_hal_fake_clear();
+    CHECK( rtc_hal_read( 0x00, back, 2 ) == 0 );
+    CHECK( wire_is( read2, sizeof( read2 ) / sizeof( read2[0] ) ) );
+    CHECK( back[0] == 0x11 && back[1] == 0x22 );
+
+    // nothing to read, nothing on the wire
+    rtc_hal_fake_clear();
+    CHECK( rtc_hal_read( 0x00, back, 0 ) == 0 );
+    CHECK( rtc_hal_fake_stats()->starts == 0 );
+
+    // a full DS3232 SRAM, 0x14 to 0xFF, is one transaction
+    for( i = 0; i < sizeof( data ); i++ )
+        data[i] = ( uint8_t )( i * 7 + 1 );
+    expect[0] = S;
+    expect[1] = 0xD0;
+    expect[2] = 0x14;
+    for( i = 0; i < sizeof( data ); i++ )
+        expect[3 + i] = data[i];
+    expect[3 + sizeof( data )] = P;
+    rtc_hal_fake_clear();
+    CHECK( rtc_hal_write( 0x14, data, sizeof( data ) ) == 0 );
+    CHECK( wire_is( expect, 4 + sizeof( data ) ) );
+    CHECK( !memcmp( &regs[0x14], data, sizeof( data ) ) );
+
+    rtc_hal_fake_clear();
+    CHECK( rtc_hal_read( 0x14, back, sizeof( back ) ) == 0 );
+    CHECK( rtc_hal_fake_stats()->starts == 2 );
+    CHECK( !memcmp( back, data, sizeof( data ) ) );
+
+    // a stream hands the same bytes over without a buffer, still one transaction
+    streamed_count = 0;
+    rtc_hal_fake_clear();
+    CHECK( rtc_hal_read_stream( 0x14, sizeof( data ), stream_byte, NULL ) == 0 );
+    CHECK( rtc_hal_fake_stats()->starts == 2 );
+    CHECK( streamed_count == sizeof( data ) );
+    CHECK( !memcmp( streamed, data, sizeof( data ) ) );
+
+    // batch reads are separate transactions on the byte-wise backends
+    regs[0x0A] = 0x99;
+    regs[0x0B] = 0x98;
+    reads[0].address = 0x00;
+    reads[0].data_out = back;
+    reads[0].num_bytes = 1;
+    reads[1].address = 0x0A;
+    reads[1].data_out = &back[1];
+    reads[1].num_bytes = 2;
+    rtc_hal_fake_clear();
+    CHECK( rtc_hal_read_batch( reads, 2 ) == 0 );
+    CHECK( wire_is( batch, sizeof( batch ) / sizeof( batch[0] ) ) );
+
+    // an absent slave is tried 1 + RTC_HAL_RETRIES times, each ends in a STOP
+    rtc_hal_set_slave( 0x57 );
+    rtc_hal_fake_clear();
+    CHECK( rtc_hal_write( 0x00, data, 1 ) == -1 );
+    CHECK( RTC_HAL_RETRIES != 2 ||
+           wire_is( nack, sizeof( nack ) / sizeof( nack[0] ) ) );
+
+    // a cursor streams the whole MCP7941X EEPROM in one transaction
+    test_chip( RTC6_MCP7941X, &eeprom );
+    CHECK( rtc_init( RTC6_MCP7941X, 0 ) == 0 );
+    for( i = 0; i < EEPROM_SIZE; i++ )
+        eeprom[i] = ( uint8_t )( i ^ 0x5A );
+    streamed_count = 0;
+    chunks = 0;
+    CHECK( rtc_cursor_open( &cursor, RTC_MEM_EEPROM, 0, 0 ) == 0 );
+    rtc_hal_fake_clear();
+    CHECK( rtc_cursor_stream( &cursor, chunk, sizeof( chunk ), stream_chunk,
+                              NULL ) == 0 );
+    CHECK( rtc_hal_fake_stats()->starts == 2 );
+    CHECK( streamed_count == EEPROM_SIZE );
+    CHECK( chunks == ( EEPROM_SIZE + sizeof( chunk ) - 1 ) / sizeof( chunk ) );
+    CHECK( !memcmp( streamed, eeprom, EEPROM_SIZE ) );
+    CHECK( cursor.pos == cursor.end );
+    CHECK( rtc_cursor_stream( &cursor, chunk, sizeof( chunk ), stream_chunk,
+                              NULL ) == 0 );
+    CHECK( chunks == ( EEPROM_SIZE + sizeof( chunk ) - 1 ) / sizeof( chunk ) );
+
+    return TEST_DONE();
+}
@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+"""
+Decodes a dump of the rtc_hal trace ring into per operation latency
+histograms.
+
+Build the library with RTC_HAL_TRACE, call rtc_hal_trace_init() with a tick
+source and dump RTC_HAL_TRACE_SIZE * 8 bytes starting at the pointer
+returned by rtc_hal_trace_ring(), e.g. from the debugger memory view.
+
+    rtc_trace.py ring.bin --tick-hz 72000000
+"""
+import argparse
+import struct
+import sys
+
+# rtc_op_t, keep in order with rtc.h
+OPS = [
+    "none", "init", "config", "get_time", "set_time", "power",
+    "trim", "alarm", "timer", "sram", "eeprom",
+]
+
+ENTRY = struct.Struct("<IBBBB")     # rtc_hal_trace_t, little endian
+
+
+def decode(data):
+    for offset in range(0, len(data) - ENTRY.size + 1, ENTRY.size):
+        ticks, op, slave, reg, length = ENTRY.unpack_from(data, offset)
+        if slave == 0:              # never written
+            continue
+        yield ticks, op, slave, reg, length
+
+
+def bucket(value):
+    # power of two upper bound
+    top = 1
+    while top < value:
+        top <<= 1
+    return top
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().split("\n")[0])
+    parser.add_argument("dump", help="raw trace ring dump")
+    parser.add_argument("--tick-hz", type=float, default=0,
+                        help="tick frequency, durations are shown in us")
+    args = parser.parse_args()
+
+    with open(args.dump, "rb") as f:
+        entries = list(decode(f.read()))
+
+    if not entries:
+        print("no trace entries", file=sys.stderr)
+        return 1
+
+    scale = 1e6 / args.tick_hz if args.tick_hz else 1
+    unit = "us" if args.tick_hz else "ticks"
+    ops = {}
+
+    for ticks, op, slave, reg, length in entries:
+        ops.setdefault(op & 0x7F, []).append((ticks * scale, slave, reg, length,
+                                              op & 0x80))
+
+    for op in sorted(ops):
+        samples = ops[op]
+        times = [s[0] for s in samples]
+        name = OPS[op] if op < len(OPS) else "op%d" % op
+        reads = sum(1 for s in samples if s[1] & 1)
+        failed = sum(1 for s in samples if s[4])
+        worst = max(samples, key=lambda s: s[0])
+
+        print("%s: %d transfers (%d reads, %d writes, %d failed)"
+              % (name, len(samples), reads, len(samples) - reads, failed))
+        print("  min %.1f  mean %.1f  max %.1f %s, worst slave 0x%02X reg 0x%02X len %d"
+              % (min(times), sum(times) / len(times), max(times), unit,
+                 worst[1] >> 1, worst[2], worst[3]))
+
+        histogram = {}
+        for t in times:
+            top = bucket(int(t + 0.999))
+            histogram[top] = histogram.get(top, 0) + 1
+        peak = max(histogram.values())
+        for top in sorted(histogram):
+            bar = "#" * max(1, histogram[top] * 40 // peak)
+            print("  <= %8d %-5s %6d %s" % (top, unit, histogram[top], bar))
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())